@@ -26,15 +26,37 @@ The **des** library, a software library dedicated to the Data Encryption Standar
 #include <stdint.h>
 #include <inttypes.h>
 
+/** Identifier of the portable backend of the permutations: byte-indexed lookup tables. */
+#define DES_BACKEND_TABLES 0
+
+/** Identifier of the BMI2 backend of the permutations: `pext`/`pdep` instructions of x86-64 processors. */
+#define DES_BACKEND_BMI2 1
+
 /**
 Number of left shifts per round. `left_shifts[0]` corresponds to round #1, ... `left_shifts[15]` corresponds to round #16. A value of 0 means one shift. A value of 1 means two shifts.
 */
 extern uint8_t left_shifts[16];
 
+/** Selects the backend used by all permutations of the library (IP, FP, E, P, PC1, PC2 and their inverses). At program startup the BMI2 backend is selected if the processor supports it, except on AMD processors before Zen 3 (family 0x19), where `pext`/`pdep` are microcoded and much slower than the portable tables, which are selected instead. This function is mainly useful to compare the backends, for instance with `des_bench`. It is not thread safe: call it before starting threads.
+ * \return The selected backend, `DES_BACKEND_TABLES` if `backend` is not supported by the processor. */
+int des_set_backend (int backend /**< `DES_BACKEND_TABLES` or `DES_BACKEND_BMI2`. */ );
+
+/** Returns the backend currently used by the permutations.
+ * \return `DES_BACKEND_TABLES` or `DES_BACKEND_BMI2`. */
+int des_backend (void);
+
 /** Returns the Hamming weight of a 64 bits word. Note: the input's width can be anything between 0 and 64, as long as the unused bits are all zeroes.
  * \return The Hamming weight of the input as a 64 bits uint64_t. */
 int hamming_weight (uint64_t val /**< The 64 bits input. */ );
 
+/** Returns the Hamming weight of a 4 bits word, for instance a SBox output.
+ * \return The Hamming weight of the input, from 0 to 4. */
+int hamming_weight4 (uint64_t val /**< The 4 bits input. */ );
+
+/** Returns the Hamming weight of a 6 bits word, for instance a SBox input.
+ * \return The Hamming weight of the input, from 0 to 6. */
+int hamming_weight6 (uint64_t val /**< The 6 bits input. */ );
+
 /** Returns the Hamming distance between two 64 bits words. Note: the width of the inputs can be anything between 0 and 64, as long as they are the same, aligned and that the unused bits are all zeroes.
  * \return The Hamming distance between the two inputs as a 64 bits uint64_t. */
 int hamming_distance (uint64_t val1 /**< The first 64 bits input. */ ,
@@ -105,6 +127,10 @@ uint64_t des_sbox (int sbox /**< SBox number, from 1 to 8. */ ,
  * \return The 32 bits output of all SBoxes corresponding to the 48 bits input, as a 32 bits `uint64_t`. */
 uint64_t des_sboxes (uint64_t val /**< 48 bits input. */ );
 
+/** All SBoxes computation followed by the P permutation (48 to 32 bits). Same as `des_p (des_sboxes (val))` but uses the combined SP tables: 8 lookups and 7 XORs.
+ * \return The P-permutated 32 bits output of all SBoxes, as a 32 bits `uint64_t`. */
+uint64_t des_sp (uint64_t val /**< 48 bits input. */ );
+
 /** Returns the 32 bits right half of a 64 bits word.
  * \return The 32 bits right half of a 64 bits word, as a 32 bits `uint64_t`. */
 uint64_t des_right_half (uint64_t val /**< 64 bits input. */ );
@@ -128,6 +154,13 @@ uint64_t des_f (uint64_t rk /**< 48 bits round key. */ ,
 		 /**< 32 bits data input. */
   );
 
+/** Same as `des_f()` but uses the combined SP tables (see `des_sp()`).
+ * \return The transformed input, as a 32 bits `uint64_t`. */
+uint64_t des_f_sp (uint64_t rk /**< 48 bits round key. */ ,
+		   uint64_t val
+		 /**< 32 bits data input. */
+  );
+
 /** Computes the whole key schedule from a 64 bits secret key and stores the sixteen 48 bits round keys in an array. The sixteen 48 bits round keys are returned in the array passed as first parameter. */
 void des_ks (
     /** The array where to store the sixteen 48 bits round keys. On return `ks[0]` holds the first round key, ..., `ks[15]` holds the last round key. Must be allocated prior the call. */
@@ -149,7 +182,153 @@ uint64_t des_dec (uint64_t * ks /**< The pre-computed key schedule. */ ,
 		 /**< The 64 bits ciphertext. */
   );
 
-/** A functional verification of the DES implementation. Runs a number of encipherments with `des_enc()` and the corresponding decipherments with `des_dec()` and checks the results against pre-computed plaintext, ciphertexts and secret keys. If compiled in `DEBUG` mode, prints warnings on mismatches or a **OK** message if the tests pass.
+/** Runs rounds `from + 1` to `to` of the encipherment on a LR state: `state` holds L<sub>from</sub> (left half) and R<sub>from</sub> (right half) and the result holds L<sub>to</sub> and R<sub>to</sub>. Round `i` uses round key `ks[i - 1]`. L<sub>0</sub>R<sub>0</sub> is `des_ip()` of the plaintext; `des_ip()` of the ciphertext is R<sub>16</sub>L<sub>16</sub>, that is, L<sub>16</sub>R<sub>16</sub> with swapped halves. Example: `des_rounds_fwd(ks, des_ip(pt), 0, 16)` is L<sub>16</sub>R<sub>16</sub>.
+ * \return The LR state after round `to`, as a 64 bits `uint64_t`. */
+uint64_t des_rounds_fwd (uint64_t * ks /**< The pre-computed key schedule. */ ,
+			 uint64_t state /**< The 64 bits LR state after round `from` (0 for the initial state). */ ,
+			 int from /**< Index of the last round already applied, from 0 to 16. */ ,
+			 int to
+			 /**< Index of the last round to apply, from `from` to 16. */
+  );
+
+/** Undoes rounds `from` down to `to + 1` of the encipherment on a LR state: `state` holds L<sub>from</sub>R<sub>from</sub> and the result holds L<sub>to</sub>R<sub>to</sub> (same conventions as `des_rounds_fwd()`). Example: L<sub>15</sub>R<sub>15</sub> is `des_rounds_bwd(ks, s16, 16, 15)` where `s16` is `des_ip()` of the ciphertext with swapped halves.
+ * \return The LR state after round `to`, as a 64 bits `uint64_t`. */
+uint64_t des_rounds_bwd (uint64_t * ks /**< The pre-computed key schedule. Only the round keys of the undone rounds are used. */ ,
+			 uint64_t state /**< The 64 bits LR state after round `from`. */ ,
+			 int from /**< Index of the last applied round, from 0 to 16. */ ,
+			 int to
+			 /**< Index of the last round to keep, from 0 to `from`. */
+  );
+
+/** Enciphers `n` plaintexts and stores the 17 LR states of each: `states[17 * i + r]` is L<sub>r</sub>R<sub>r</sub> of plaintext `pt[i]`, for `r` from 0 (after IP) to 16 (before the final permutation, halves not swapped). The inputs are validated once and the rounds use the unchecked primitives of des_fast.h. */
+void des_states_n (uint64_t * ks /**< The pre-computed key schedule. */ ,
+		   uint64_t * pt /**< The `n` plaintexts. */ ,
+		   uint64_t * states /**< The `17 * n` LR states. Must be allocated prior the call. */ ,
+		   int n
+		   /**< Number of blocks. */
+  );
+
+/** Same as `des_states_n()` but starts from the `n` ciphertexts and runs the rounds backwards: `states[17 * i + r]` is L<sub>r</sub>R<sub>r</sub> of ciphertext `ct[i]`. With a partial key schedule (e.g. only `ks[15]`, the last round key, is known), the states from 16 down to the first unknown round key are right. */
+void des_states_bwd_n (uint64_t * ks /**< The pre-computed key schedule. */ ,
+		       uint64_t * ct /**< The `n` ciphertexts. */ ,
+		       uint64_t * states /**< The `17 * n` LR states. Must be allocated prior the call. */ ,
+		       int n
+		       /**< Number of blocks. */
+  );
+
+/** Same as `des_enc()` but uses `des_f_sp()` as F function.
+ * \return The enciphered plaintext as a 64 bits `uint64_t`. */
+uint64_t des_enc_sp (uint64_t * ks /**< The pre-computed key schedule. */ ,
+		     uint64_t val
+		 /**< The 64 bits plaintext. */
+  );
+
+/** Same as `des_dec()` but uses `des_f_sp()` as F function.
+ * \return The deciphered ciphertext as a 64 bits `uint64_t`. */
+uint64_t des_dec_sp (uint64_t * ks /**< The pre-computed key schedule. */ ,
+		     uint64_t val
+		 /**< The 64 bits ciphertext. */
+  );
+
+/** \name Array variants
+ * Apply a primitive to the `n` values of array `in` and store the results in array `out`: `out[i] = f(in[i])`. `in` and `out` may be the same array. The inputs are validated once, with a single pass over the array, before the results are computed with the unchecked primitives of des_fast.h, in a tight loop that does not call any function. On invalid inputs (or negative `n`) the program exits with an error message that gives the index of the first invalid value. Use them to pre-compute intermediate values for whole datasets. */
+/**@{*/
+
+/** Array variant of `des_ip()`. */
+void des_ip_n (uint64_t * in /**< `n` 64 bits inputs. */ ,
+	       uint64_t * out /**< `n` 64 bits outputs. Must be allocated prior the call. */ ,
+	       int n
+	       /**< Number of values. */
+  );
+
+/** Array variant of `des_n_ip()`. */
+void des_n_ip_n (uint64_t * in /**< `n` 64 bits inputs. */ ,
+		 uint64_t * out /**< `n` 64 bits outputs. Must be allocated prior the call. */ ,
+		 int n
+		 /**< Number of values. */
+  );
+
+/** Array variant of `des_fp()`. */
+void des_fp_n (uint64_t * in /**< `n` 64 bits inputs. */ ,
+	       uint64_t * out /**< `n` 64 bits outputs. Must be allocated prior the call. */ ,
+	       int n
+	       /**< Number of values. */
+  );
+
+/** Array variant of `des_n_fp()`. */
+void des_n_fp_n (uint64_t * in /**< `n` 64 bits inputs. */ ,
+		 uint64_t * out /**< `n` 64 bits outputs. Must be allocated prior the call. */ ,
+		 int n
+		 /**< Number of values. */
+  );
+
+/** Array variant of `des_e()`. */
+void des_e_n (uint64_t * in /**< `n` 32 bits inputs. */ ,
+	      uint64_t * out /**< `n` 48 bits outputs. Must be allocated prior the call. */ ,
+	      int n
+	      /**< Number of values. */
+  );
+
+/** Array variant of `des_p()`. */
+void des_p_n (uint64_t * in /**< `n` 32 bits inputs. */ ,
+	      uint64_t * out /**< `n` 32 bits outputs. Must be allocated prior the call. */ ,
+	      int n
+	      /**< Number of values. */
+  );
+
+/** Array variant of `des_n_p()`. */
+void des_n_p_n (uint64_t * in /**< `n` 32 bits inputs. */ ,
+		uint64_t * out /**< `n` 32 bits outputs. Must be allocated prior the call. */ ,
+		int n
+		/**< Number of values. */
+  );
+
+/** Array variant of `des_sboxes()`. */
+void des_sboxes_n (uint64_t * in /**< `n` 48 bits inputs. */ ,
+		   uint64_t * out /**< `n` 32 bits outputs. Must be allocated prior the call. */ ,
+		   int n
+		   /**< Number of values. */
+  );
+
+/** Array variant of `des_sp()`. */
+void des_sp_n (uint64_t * in /**< `n` 48 bits inputs. */ ,
+	       uint64_t * out /**< `n` 32 bits outputs. Must be allocated prior the call. */ ,
+	       int n
+	       /**< Number of values. */
+  );
+
+/** Array variant of `des_right_half()`. */
+void des_right_half_n (uint64_t * in /**< `n` 64 bits inputs. */ ,
+		       uint64_t * out /**< `n` 32 bits outputs. Must be allocated prior the call. */ ,
+		       int n
+		       /**< Number of values. */
+  );
+
+/** Array variant of `des_left_half()`. */
+void des_left_half_n (uint64_t * in /**< `n` 64 bits inputs. */ ,
+		      uint64_t * out /**< `n` 32 bits outputs. Must be allocated prior the call. */ ,
+		      int n
+		      /**< Number of values. */
+  );
+
+/** Array variant of `hamming_weight()`. On x86-64 processors that support them, uses the AVX-512 `vpopcntq` instruction or an AVX2 nibbles look-up table, 8 words at a time. The selection is done once, at program startup. */
+void hamming_weight_n (uint64_t * in /**< `n` 64 bits inputs. */ ,
+		       int *out /**< `n` Hamming weights. Must be allocated prior the call. */ ,
+		       int n
+		       /**< Number of values. */
+  );
+
+/** Array variant of `hamming_distance()`: `out[i]` is the Hamming distance between `in1[i]` and `in2[i]`. Same kernels as `hamming_weight_n()`. */
+void hamming_distance_n (uint64_t * in1 /**< `n` first 64 bits inputs. */ ,
+			 uint64_t * in2 /**< `n` second 64 bits inputs. */ ,
+			 int *out /**< `n` Hamming distances. Must be allocated prior the call. */ ,
+			 int n
+			 /**< Number of values. */
+  );
+
+/**@}*/
+
+/** A functional verification of the DES implementation. Runs a number of encipherments with `des_enc()` and `des_enc_sp()` and the corresponding decipherments with `des_dec()` and `des_dec_sp()` and checks the results against pre-computed plaintext, ciphertexts and secret keys. If compiled in `DEBUG` mode, prints warnings on mismatches or a **OK** message if the tests pass.
  * \returns One on success, zero on errors. */
 int des_check (void);
 
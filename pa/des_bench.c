@@ -0,0 +1,240 @@
+/*
+ * Copyright (C) Telecom Paris
+ *
+ * This file must be used under the terms of the CeCILL. This source
+ * file is licensed as described in the file COPYING, which you should
+ * have received as part of this distribution. The terms are also
+ * available at:
+ * http://www.cecill.info/licences/Licence_CeCILL_V1.1-US.txt
+*/
+
+/* Throughput of the DES engines and per-call time of the permutations with
+ * each backend. Usage: des_bench [N], where N is the number of blocks to
+ * encipher with each engine (default: 1048576). */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "utils.h"
+#include "des.h"
+#include "des_bs.h"
+
+/* Returns the current value of the monotonic clock, in seconds. */
+double now (void);
+
+/* Prints the throughput of an engine that processed n blocks in s seconds. */
+void report (char *name, int n, double s, double ref);
+
+/* Measures and prints the per-call time of the 12 permutations with each
+ * available backend. */
+void latencies (void);
+
+/* Measures and prints the time of the ciphertexts pre-computation of the DPA
+ * attack (IP, halves and E) on n blocks, one value at a time and with the
+ * array variants. */
+void batch (uint64_t *ct, int n);
+
+/* Measures and prints the time of the Hamming weights of n words, one value at
+ * a time and with the array variant. */
+void weights (uint64_t *ct, int n);
+
+/* The benchmarked permutations and the width of their inputs. */
+struct {
+  char *name;
+  uint64_t (*f) (uint64_t);
+  int width;
+} perms[12] = {
+  {"des_ip", des_ip, 64},
+  {"des_n_ip", des_n_ip, 64},
+  {"des_fp", des_fp, 64},
+  {"des_n_fp", des_n_fp, 64},
+  {"des_e", des_e, 32},
+  {"des_n_e", des_n_e, 48},
+  {"des_p", des_p, 32},
+  {"des_n_p", des_n_p, 32},
+  {"des_pc1", des_pc1, 64},
+  {"des_n_pc1", des_n_pc1, 56},
+  {"des_pc2", des_pc2, 56},
+  {"des_n_pc2", des_n_pc2, 48}
+};
+
+int main (int argc, char **argv) {
+  int n, i;
+  uint64_t ks[16], *pt, *ct, *keys, acc;
+  double t, ref;
+
+  if (!des_check ()) {
+    ERROR (0, -1, "DES functional test failed");
+  }
+  if (!des_bs_check ()) {
+    ERROR (0, -1, "bitsliced DES functional test failed");
+  }
+  n = (argc > 1) ? atoi (argv[1]) : 1 << 20;
+  if (n < 256) {
+    ERROR (0, -1, "Invalid number of blocks: %d (shall be at least 256)", n);
+  }
+  n -= n % 256;
+  pt = XCALLOC (n, sizeof (uint64_t));
+  ct = XCALLOC (n, sizeof (uint64_t));
+  keys = XCALLOC (n, sizeof (uint64_t));
+  for (i = 0; i < n; i++) {
+    pt[i] = UINT64_C (0x9e3779b97f4a7c15) * (i + 1);
+    keys[i] = pt[i] ^ UINT64_C (0x0123456789abcdef);
+  }
+  des_ks (ks, UINT64_C (0x133457799bbcdff1));
+  fprintf (stderr, "%d blocks, bitsliced width: %d\n", n, des_bs_width ());
+
+  t = now ();
+  for (i = 0; i < n; i++) {
+    ct[i] = des_enc (ks, pt[i]);
+  }
+  ref = now () - t;
+  acc = ct[n - 1];
+  report ("des_enc", n, ref, ref);
+
+  t = now ();
+  for (i = 0; i < n; i += DES_BS_BLOCKS) {
+    des_enc_bs (ks, pt + i, ct + i);
+  }
+  report ("des_enc_bs", n, now () - t, ref);
+  acc ^= ct[n - 1];
+
+  t = now ();
+  des_enc_bs_n (ks, pt, ct, n);
+  report ("des_enc_bs_n", n, now () - t, ref);
+  acc ^= ct[n - 1];
+
+  t = now ();
+  for (i = 0; i < n; i += DES_BS_BLOCKS) {
+    des_enc_bs_keys (keys + i, pt + i, ct + i);
+  }
+  report ("des_enc_bs_keys", n, now () - t, ref);
+  acc ^= ct[n - 1];
+
+  t = now ();
+  des_enc_bs_keys_n (keys, pt, ct, n);
+  report ("des_enc_bs_keys_n", n, now () - t, ref);
+  acc ^= ct[n - 1];
+
+  /* Prevents the compiler from discarding the computations. */
+  printf ("0x%016" PRIx64 "\n", acc);
+  latencies ();
+  batch (ct, n);
+  weights (ct, n);
+  free (pt);
+  free (ct);
+  free (keys);
+  return 0;
+}
+
+double now (void) {
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (double) (ts.tv_sec) + (double) (ts.tv_nsec) * 1e-9;
+}
+
+void report (char *name, int n, double s, double ref) {
+  fprintf (stderr, "%-20s %10.3f Mblocks/s %8.1f ns/block  x%.1f\n", name, n / s * 1e-6, s / n * 1e9, ref / s);
+}
+
+void latencies (void) {
+  int backends[2] = { DES_BACKEND_TABLES, DES_BACKEND_BMI2 };
+  char *names[2] = { "tables", "bmi2" };
+  double t[2];
+  uint64_t in[1024], acc;
+  int b, i, j, k, n, prev;
+
+  prev = des_backend ();
+  n = 1 << 20;
+  fprintf (stderr, "\n%-12s %12s %12s  (ns/call)\n", "permutation", names[0], names[1]);
+  acc = UINT64_C (0x0);
+  for (i = 0; i < 12; i++) {
+    for (j = 0; j < 1024; j++) {
+      in[j] = UINT64_C (0x9e3779b97f4a7c15) * (j + 1);
+      if (perms[i].width < 64) {
+        in[j] &= (UINT64_C (0x1) << perms[i].width) - 1;
+      }
+      if (perms[i].f == des_n_e) { // Duplicated bits must be equal
+        in[j] = des_e (in[j] >> 16);
+      }
+    }
+    for (b = 0; b < 2; b++) {
+      t[b] = 0.0;
+      if (des_set_backend (backends[b]) != backends[b]) {
+        continue;
+      }
+      t[b] = now ();
+      for (k = 0; k < n; k += 1024) {
+        for (j = 0; j < 1024; j++) {
+          acc += perms[i].f (in[j]);
+        }
+      }
+      t[b] = (now () - t[b]) / n * 1e9;
+    }
+    fprintf (stderr, "%-12s %12.2f %12.2f\n", perms[i].name, t[0], t[1]);
+  }
+  des_set_backend (prev);
+  printf ("0x%016" PRIx64 "\n", acc);
+}
+
+void batch (uint64_t *ct, int n) {
+  uint64_t *r16, *er15, *tmp;
+  double t0, t1;
+  int i;
+
+  r16 = XCALLOC (n, sizeof (uint64_t));
+  er15 = XCALLOC (n, sizeof (uint64_t));
+  tmp = XCALLOC (n, sizeof (uint64_t));
+  t0 = now ();
+  for (i = 0; i < n; i++) {
+    tmp[i] = des_ip (ct[i]);
+    r16[i] = des_left_half (tmp[i]);
+    er15[i] = des_e (des_right_half (tmp[i]));
+  }
+  t0 = now () - t0;
+  t1 = now ();
+  des_ip_n (ct, tmp, n);
+  des_left_half_n (tmp, r16, n);
+  des_right_half_n (tmp, tmp, n);
+  des_e_n (tmp, er15, n);
+  t1 = now () - t1;
+  for (i = 0; i < n; i++) {
+    if (r16[i] != des_left_half (des_ip (ct[i])) || er15[i] != des_e (des_right_half (des_ip (ct[i])))) {
+      ERROR (, -1, "array variants mismatch on block %d", i);
+    }
+  }
+  fprintf (stderr, "\nPre-computation of R16 and E(L16), %d blocks\n", n);
+  report ("scalar", n, t0, t0);
+  report ("array", n, t1, t0);
+  free (r16);
+  free (er15);
+  free (tmp);
+}
+
+void weights (uint64_t *ct, int n) {
+  int *hw, i;
+  double t0, t1;
+
+  hw = XCALLOC (n, sizeof (int));
+  t0 = now ();
+  for (i = 0; i < n; i++) {
+    hw[i] = hamming_weight (ct[i]);
+  }
+  t0 = now () - t0;
+  t1 = now ();
+  hamming_weight_n (ct, hw, n);
+  t1 = now () - t1;
+  for (i = 0; i < n; i++) {
+    if (hw[i] != hamming_weight (ct[i])) {
+      ERROR (, -1, "Hamming weights mismatch on word %d", i);
+    }
+  }
+  fprintf (stderr, "\nHamming weights, %d words\n", n);
+  report ("hamming_weight", n, t0, t0);
+  report ("hamming_weight_n", n, t1, t0);
+  free (hw);
+}
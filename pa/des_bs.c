@@ -0,0 +1,236 @@
+/*
+ * Copyright (C) Telecom Paris
+ *
+ * This file must be used under the terms of the CeCILL. This source
+ * file is licensed as described in the file COPYING, which you should
+ * have received as part of this distribution. The terms are also
+ * available at:
+ * http://www.cecill.info/licences/Licence_CeCILL_V1.1-US.txt
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include "utils.h"
+#include "des.h"
+#include "des_bs.h"
+
+extern int des_check_f (uint64_t (*f_enc) (uint64_t *, uint64_t), uint64_t (*f_dec) (uint64_t *, uint64_t));
+
+/* Source bit of each destination bit of the IP, FP, E and P permutations and
+ * source key bit of each bit of the sixteen round keys. Bits are numbered from
+ * right (0) to left (63). Computed at startup from the des library. */
+static int ip_src[64];
+static int fp_src[64];
+static int e_src[48];
+static int p_src[32];
+static int ks_src[16][48];
+
+/* Transposes the 64x64 bits matrix a in place: on return bit j of a[i] is bit i
+ * of the original a[j]. */
+static void
+des_bs_transpose (uint64_t * a) {
+  uint64_t m, t;
+  int j, k;
+
+  m = UINT64_C (0x00000000ffffffff);
+  for (j = 32; j != 0; j >>= 1, m ^= m << j) {
+    for (k = 0; k < 64; k = ((k | j) + 1) & ~j) {
+      t = ((a[k] >> j) ^ a[k | j]) & m;
+      a[k] ^= t << j;
+      a[k | j] ^= t;
+    }
+  }
+}
+
+#define BS_WORD uint64_t
+#define BS_LANES 1
+#define BS_LANE(w, g) (w)
+#define BS_ONES (~UINT64_C (0x0))
+#define BS_NAME(f) des_bs64_ ## f
+#include "des_bs_core.h"
+#undef BS_WORD
+#undef BS_LANES
+#undef BS_LANE
+#undef BS_ONES
+#undef BS_NAME
+
+#if defined (__x86_64__) && defined (__GNUC__)
+#define DES_BS_AVX2
+
+typedef uint64_t des_bs_v4 __attribute__ ((vector_size (32)));
+
+#pragma GCC push_options
+#pragma GCC target ("avx2")
+#define BS_WORD des_bs_v4
+#define BS_LANES 4
+#define BS_LANE(w, g) ((w)[g])
+#define BS_ONES ((des_bs_v4) {0, 0, 0, 0} - 1)
+#define BS_NAME(f) des_bs256_ ## f
+#include "des_bs_core.h"
+#undef BS_WORD
+#undef BS_LANES
+#undef BS_LANE
+#undef BS_ONES
+#undef BS_NAME
+#pragma GCC pop_options
+#endif /* x86-64 */
+
+/* The engine used by the *_n functions and its width in blocks. */
+static void (*des_bs_run) (uint64_t *, uint64_t *, uint64_t *, uint64_t *, int, int) = des_bs64_run;
+static int des_bs_blocks = 64;
+
+/* For each bit of the outputs of f applied to the single bit inputs 1 << i, 0
+ * <= i < width, records i as the source of the output bit. */
+static void
+des_bs_sources (uint64_t (*f) (uint64_t), int width, int *src) {
+  uint64_t v;
+  int i, j;
+
+  for (i = 0; i < width; i++) {
+    v = f (UINT64_C (0x1) << i);
+    for (j = 0; j < 64; j++) {
+      if ((v >> j) & UINT64_C (0x1)) {
+        src[j] = i;
+      }
+    }
+  }
+}
+
+static void __attribute__ ((constructor))
+des_bs_init (void) {
+  uint64_t ks[16];
+  int i, j, k;
+
+  des_bs_sources (des_ip, 64, ip_src);
+  des_bs_sources (des_fp, 64, fp_src);
+  des_bs_sources (des_e, 32, e_src);
+  des_bs_sources (des_p, 32, p_src);
+  for (i = 0; i < 64; i++) {
+    des_ks (ks, UINT64_C (0x1) << i);
+    for (j = 0; j < 16; j++) {
+      for (k = 0; k < 48; k++) {
+        if ((ks[j] >> k) & UINT64_C (0x1)) {
+          ks_src[j][k] = i;
+        }
+      }
+    }
+  }
+#ifdef DES_BS_AVX2
+  __builtin_cpu_init ();
+  if (__builtin_cpu_supports ("avx2")) {
+    des_bs_run = des_bs256_run;
+    des_bs_blocks = 256;
+  }
+#endif
+}
+
+void
+des_enc_bs (uint64_t * ks, uint64_t * pt, uint64_t * ct) {
+  des_bs64_run (ks, NULL, pt, ct, DES_BS_BLOCKS, 0);
+}
+
+void
+des_dec_bs (uint64_t * ks, uint64_t * ct, uint64_t * pt) {
+  des_bs64_run (ks, NULL, ct, pt, DES_BS_BLOCKS, 1);
+}
+
+void
+des_enc_bs_keys (uint64_t * keys, uint64_t * pt, uint64_t * ct) {
+  des_bs64_run (NULL, keys, pt, ct, DES_BS_BLOCKS, 0);
+}
+
+void
+des_enc_bs_n (uint64_t * ks, uint64_t * pt, uint64_t * ct, int n) {
+  if (n < 0)
+    ERROR (, -1, "Invalid number of blocks: %d", n);
+  des_bs_run (ks, NULL, pt, ct, n, 0);
+}
+
+void
+des_dec_bs_n (uint64_t * ks, uint64_t * ct, uint64_t * pt, int n) {
+  if (n < 0)
+    ERROR (, -1, "Invalid number of blocks: %d", n);
+  des_bs_run (ks, NULL, ct, pt, n, 1);
+}
+
+void
+des_enc_bs_keys_n (uint64_t * keys, uint64_t * pt, uint64_t * ct, int n) {
+  if (n < 0)
+    ERROR (, -1, "Invalid number of keys: %d", n);
+  des_bs_run (NULL, keys, pt, ct, n, 0);
+}
+
+int
+des_bs_width (void) {
+  return des_bs_blocks;
+}
+
+/* Single block wrappers, for des_check_f(). */
+static uint64_t
+des_enc_bs_1 (uint64_t * ks, uint64_t val) {
+  des_bs_run (ks, NULL, &val, &val, 1, 0);
+  return val;
+}
+
+static uint64_t
+des_dec_bs_1 (uint64_t * ks, uint64_t val) {
+  des_bs_run (ks, NULL, &val, &val, 1, 1);
+  return val;
+}
+
+int
+des_bs_check (void) {
+  uint64_t ks[16], keys[300], pt[300], ct[300], ref;
+  int i, ok;
+
+  ok = des_check_f (des_enc_bs_1, des_dec_bs_1);
+  /* Full and partial passes of all engines, one key per block. */
+  for (i = 0; i < 300; i++) {
+    keys[i] = UINT64_C (0x9e3779b97f4a7c15) * (i + 1);
+    pt[i] = keys[i] ^ (keys[i] >> 29) ^ UINT64_C (0x0123456789abcdef);
+  }
+  des_enc_bs_keys (keys, pt, ct);
+  for (i = 0; i < DES_BS_BLOCKS; i++) {
+    des_ks (ks, keys[i]);
+    if (ct[i] != des_enc (ks, pt[i])) {
+#ifdef DEBUG
+      WARNING ("64 keys encryption %d\nk=0x%016" PRIx64 " p=0x%016" PRIx64 " act=0x%016" PRIx64 "\n", i, keys[i], pt[i], ct[i]);
+#endif
+      ok = 0;
+    }
+  }
+  des_enc_bs_keys_n (keys, pt, ct, 300);
+  for (i = 0; i < 300; i++) {
+    des_ks (ks, keys[i]);
+    if (ct[i] != des_enc (ks, pt[i])) {
+#ifdef DEBUG
+      WARNING ("%d keys encryption %d\nk=0x%016" PRIx64 " p=0x%016" PRIx64 " act=0x%016" PRIx64 "\n", 300, i, keys[i], pt[i], ct[i]);
+#endif
+      ok = 0;
+    }
+  }
+  /* One key for all blocks. */
+  des_ks (ks, keys[0]);
+  des_enc_bs (ks, pt, ct);
+  des_dec_bs (ks, ct, ct);
+  for (i = 0; i < DES_BS_BLOCKS; i++) {
+    ok = ok && (ct[i] == pt[i]);
+  }
+  des_enc_bs_n (ks, pt, ct, 300);
+  for (i = 0; i < 300; i++) {
+    ref = des_enc (ks, pt[i]);
+    if (ct[i] != ref) {
+#ifdef DEBUG
+      WARNING ("encryption %d\np=0x%016" PRIx64 " o=0x%016" PRIx64 " act=0x%016" PRIx64 "\n", i, pt[i], ref, ct[i]);
+#endif
+      ok = 0;
+    }
+  }
+  des_dec_bs_n (ks, ct, ct, 300);
+  for (i = 0; i < 300; i++) {
+    ok = ok && (ct[i] == pt[i]);
+  }
+  return ok;
+}
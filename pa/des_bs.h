@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) Telecom Paris
+ *
+ * This file must be used under the terms of the CeCILL. This source
+ * file is licensed as described in the file COPYING, which you should
+ * have received as part of this distribution. The terms are also
+ * available at:
+ * http://www.cecill.info/licences/Licence_CeCILL_V1.1-US.txt
+*/
+
+/** \file des_bs.h
+The **des_bs** library, a bitsliced implementation of the Data Encryption Standard (DES) that processes many blocks, or many keys, per call.
+\attention
+- The engine transposes 64 blocks into 64 words such that bit `i` of word `j` is bit `j` of block `i`. The DES permutations then reduce to word moves and the SBoxes are evaluated with boolean circuits, 64 blocks at a time. The circuits are the algebraic normal forms of the 8 SBoxes of the standard, with shared monomials.
+- On x86-64 processors supporting AVX2 the `*_n` functions use 256 bits words (4 groups of 64 blocks per pass). The selection is done once, at program startup. The other functions always use the portable 64 bits words.
+- Blocks, keys and key schedules use the same conventions as the **des** library (see des.h). Unlike most functions of the **des** library, the functions of this library do not check their inputs.
+*/
+
+#ifndef DES_BS_H
+#define DES_BS_H
+
+#include <stdint.h>
+#include <inttypes.h>
+
+/** Number of blocks processed per call by des_enc_bs(), des_dec_bs() and des_enc_bs_keys(). */
+#define DES_BS_BLOCKS 64
+
+/** Enciphers 64 plaintexts with the same pre-computed key schedule. `pt` and `ct` may be the same array. */
+void des_enc_bs (uint64_t * ks /**< The pre-computed key schedule (see `des_ks()`). */ ,
+		 uint64_t * pt /**< The 64 plaintexts. */ ,
+		 uint64_t * ct
+		 /**< The 64 resulting ciphertexts. Must be allocated prior the call. */
+  );
+
+/** Deciphers 64 ciphertexts with the same pre-computed key schedule. `ct` and `pt` may be the same array. */
+void des_dec_bs (uint64_t * ks /**< The pre-computed key schedule (see `des_ks()`). */ ,
+		 uint64_t * ct /**< The 64 ciphertexts. */ ,
+		 uint64_t * pt
+		 /**< The 64 resulting plaintexts. Must be allocated prior the call. */
+  );
+
+/** Enciphers 64 plaintexts, each with its own 64 bits secret key: `ct[i]` is the encipherment of `pt[i]` with `keys[i]`. To test 64 candidate keys against a known plaintext, fill `pt` with 64 copies of it. */
+void des_enc_bs_keys (uint64_t * keys /**< The 64 secret keys (64 bits, parity bits ignored). */ ,
+		      uint64_t * pt /**< The 64 plaintexts. */ ,
+		      uint64_t * ct
+		      /**< The 64 resulting ciphertexts. Must be allocated prior the call. */
+  );
+
+/** Same as `des_enc_bs()` for any number of blocks, using the widest bitsliced engine available on the running processor. */
+void des_enc_bs_n (uint64_t * ks /**< The pre-computed key schedule. */ ,
+		   uint64_t * pt /**< The `n` plaintexts. */ ,
+		   uint64_t * ct /**< The `n` resulting ciphertexts. */ ,
+		   int n
+		   /**< Number of blocks. */
+  );
+
+/** Same as `des_dec_bs()` for any number of blocks, using the widest bitsliced engine available on the running processor. */
+void des_dec_bs_n (uint64_t * ks /**< The pre-computed key schedule. */ ,
+		   uint64_t * ct /**< The `n` ciphertexts. */ ,
+		   uint64_t * pt /**< The `n` resulting plaintexts. */ ,
+		   int n
+		   /**< Number of blocks. */
+  );
+
+/** Same as `des_enc_bs_keys()` for any number of keys, using the widest bitsliced engine available on the running processor. */
+void des_enc_bs_keys_n (uint64_t * keys /**< The `n` secret keys. */ ,
+			uint64_t * pt /**< The `n` plaintexts. */ ,
+			uint64_t * ct /**< The `n` resulting ciphertexts. */ ,
+			int n
+			/**< Number of keys. */
+  );
+
+/** Returns the number of blocks processed per pass by the `*_n` functions on the running processor.
+ * \return 256 if the AVX2 engine has been selected, else 64. */
+int des_bs_width (void);
+
+/** A functional verification of the bitsliced engines against the test vectors of `des_check()` and against `des_enc()`. If compiled in `DEBUG` mode, prints warnings on mismatches.
+ * \returns One on success, zero on errors. */
+int des_bs_check (void);
+
+#endif /** not DES_BS_H */
@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) Telecom Paris
+ *
+ * This file must be used under the terms of the CeCILL. This source
+ * file is licensed as described in the file COPYING, which you should
+ * have received as part of this distribution. The terms are also
+ * available at:
+ * http://www.cecill.info/licences/Licence_CeCILL_V1.1-US.txt
+*/
+
+/** \file des_fast.h
+Unchecked, inline versions of the most frequently used primitives of the **des** library, for the inner loops of attacks.
+\attention
+- These functions **do not check their inputs**. Unused bits of inputs that are less than 64 bits wide must be zeroes, exactly as required by the checked functions of des.h; else the results are undefined. Library users should stick to the functions of des.h unless profiling shows that the checks matter.
+- Each function is specialized for its permutation: the byte loop of the generic permutation is fully unrolled and the table is known at compile time.
+- `des_n_e_fast()` does not verify that duplicated bits are equal and `des_n_pc1_fast()` does not compute the parity bits.
+*/
+
+#ifndef DES_FAST_H
+#define DES_FAST_H
+
+#include <stdint.h>
+#include <inttypes.h>
+
+#include "des.h"
+
+/* Permutation and SBox tables, defined in des.c. FP is the inverse of IP. */
+extern uint64_t IP_K[2048];
+extern uint64_t N_IP_K[2048];
+extern uint64_t E_K[1024];
+extern uint64_t N_E_K[1536];
+extern uint64_t P_K[1024];
+extern uint64_t N_P_K[1024];
+extern uint64_t PC1_K[2048];
+extern uint64_t N_PC1_K[1792];
+extern uint64_t PC2_K[1792];
+extern uint64_t N_PC2_K[1536];
+extern uint64_t SBOX_K[8][64];
+extern uint64_t SP_K[8][64];
+
+/* Contribution of byte #i of val to the permutation defined by table t. */
+#define DES_FAST_BYTE(t, val, i) ((t)[(i) * 256 + (((val) >> (8 * (i))) & UINT64_C (0xff))])
+
+/* Permutations of 4, 6, 7 and 8 bytes inputs. */
+#define DES_FAST_PERM4(t, val) (DES_FAST_BYTE (t, val, 0) | DES_FAST_BYTE (t, val, 1) | \
+    DES_FAST_BYTE (t, val, 2) | DES_FAST_BYTE (t, val, 3))
+#define DES_FAST_PERM6(t, val) (DES_FAST_PERM4 (t, val) | DES_FAST_BYTE (t, val, 4) | \
+    DES_FAST_BYTE (t, val, 5))
+#define DES_FAST_PERM7(t, val) (DES_FAST_PERM6 (t, val) | DES_FAST_BYTE (t, val, 6))
+#define DES_FAST_PERM8(t, val) (DES_FAST_PERM7 (t, val) | DES_FAST_BYTE (t, val, 7))
+
+/** Unchecked `des_ip()`. \return The permutated input as a 64 bits `uint64_t`. */
+static inline uint64_t
+des_ip_fast (uint64_t val /**< 64 bits input. */ ) {
+  return DES_FAST_PERM8 (IP_K, val);
+}
+
+/** Unchecked `des_n_ip()`. \return The permutated input as a 64 bits `uint64_t`. */
+static inline uint64_t
+des_n_ip_fast (uint64_t val /**< 64 bits input. */ ) {
+  return DES_FAST_PERM8 (N_IP_K, val);
+}
+
+/** Unchecked `des_fp()`. \return The permutated input as a 64 bits `uint64_t`. */
+static inline uint64_t
+des_fp_fast (uint64_t val /**< 64 bits input. */ ) {
+  return DES_FAST_PERM8 (N_IP_K, val);
+}
+
+/** Unchecked `des_n_fp()`. \return The permutated input as a 64 bits `uint64_t`. */
+static inline uint64_t
+des_n_fp_fast (uint64_t val /**< 64 bits input. */ ) {
+  return DES_FAST_PERM8 (IP_K, val);
+}
+
+/** Unchecked `des_e()`. \return The expanded and permutated input as a 48 bits `uint64_t`. */
+static inline uint64_t
+des_e_fast (uint64_t val /**< 32 bits input. */ ) {
+  return DES_FAST_PERM4 (E_K, val);
+}
+
+/** Unchecked `des_n_e()`. Duplicated bits are not checked. \return The permutated and selected input as a 32 bits `uint64_t`. */
+static inline uint64_t
+des_n_e_fast (uint64_t val /**< 48 bits input. */ ) {
+  return DES_FAST_PERM6 (N_E_K, val);
+}
+
+/** Unchecked `des_p()`. \return The permutated input as a 32 bits `uint64_t`. */
+static inline uint64_t
+des_p_fast (uint64_t val /**< 32 bits input. */ ) {
+  return DES_FAST_PERM4 (P_K, val);
+}
+
+/** Unchecked `des_n_p()`. \return The permutated input as a 32 bits `uint64_t`. */
+static inline uint64_t
+des_n_p_fast (uint64_t val /**< 32 bits input. */ ) {
+  return DES_FAST_PERM4 (N_P_K, val);
+}
+
+/** Unchecked `des_pc1()`. \return The permutated and selected input as a 56 bits `uint64_t`. */
+static inline uint64_t
+des_pc1_fast (uint64_t val /**< 64 bits input. */ ) {
+  return DES_FAST_PERM8 (PC1_K, val);
+}
+
+/** Unchecked `des_n_pc1()`, without parity bits computation (parity bits are zeroes). \return The permutated and expanded input as a 64 bits `uint64_t`. */
+static inline uint64_t
+des_n_pc1_fast (uint64_t val /**< 56 bits input. */ ) {
+  return DES_FAST_PERM7 (N_PC1_K, val);
+}
+
+/** Unchecked `des_pc2()`. \return The permutated and selected input as a 48 bits `uint64_t`. */
+static inline uint64_t
+des_pc2_fast (uint64_t val /**< 56 bits input. */ ) {
+  return DES_FAST_PERM7 (PC2_K, val);
+}
+
+/** Unchecked `des_n_pc2()`. \return The permutated and expanded input as a 56 bits `uint64_t`. */
+static inline uint64_t
+des_n_pc2_fast (uint64_t val /**< 48 bits input. */ ) {
+  return DES_FAST_PERM6 (N_PC2_K, val);
+}
+
+/** Unchecked `des_sbox()`. \return The 4 bits output of SBox number `sbox` as a 4 bits `uint64_t`. */
+static inline uint64_t
+des_sbox_fast (int sbox /**< SBox number, from 1 to 8. */ ,
+	       uint64_t val
+	       /**< 6 bits input. */
+  ) {
+  return SBOX_K[sbox - 1][val];
+}
+
+/** Unchecked `des_sboxes()`. \return The 32 bits output of all SBoxes as a 32 bits `uint64_t`. */
+static inline uint64_t
+des_sboxes_fast (uint64_t val /**< 48 bits input. */ ) {
+  return (SBOX_K[0][(val >> 42) & UINT64_C (0x3f)] << 28) |
+    (SBOX_K[1][(val >> 36) & UINT64_C (0x3f)] << 24) |
+    (SBOX_K[2][(val >> 30) & UINT64_C (0x3f)] << 20) |
+    (SBOX_K[3][(val >> 24) & UINT64_C (0x3f)] << 16) |
+    (SBOX_K[4][(val >> 18) & UINT64_C (0x3f)] << 12) |
+    (SBOX_K[5][(val >> 12) & UINT64_C (0x3f)] << 8) |
+    (SBOX_K[6][(val >> 6) & UINT64_C (0x3f)] << 4) |
+    SBOX_K[7][val & UINT64_C (0x3f)];
+}
+
+/** Unchecked `des_sp()`: SBoxes and P permutation with the combined SP tables. \return The P-permutated 32 bits output of all SBoxes as a 32 bits `uint64_t`. */
+static inline uint64_t
+des_sp_fast (uint64_t val /**< 48 bits input. */ ) {
+  return SP_K[0][(val >> 42) & UINT64_C (0x3f)] ^ SP_K[1][(val >> 36) & UINT64_C (0x3f)] ^
+    SP_K[2][(val >> 30) & UINT64_C (0x3f)] ^ SP_K[3][(val >> 24) & UINT64_C (0x3f)] ^
+    SP_K[4][(val >> 18) & UINT64_C (0x3f)] ^ SP_K[5][(val >> 12) & UINT64_C (0x3f)] ^
+    SP_K[6][(val >> 6) & UINT64_C (0x3f)] ^ SP_K[7][val & UINT64_C (0x3f)];
+}
+
+/** Same as `hamming_weight()`. Uses the popcnt instruction if the compiler targets it (e.g. `-mpopcnt`), else the compiler's portable population count. \return The Hamming weight of the input. */
+static inline int
+hamming_weight_fast (uint64_t val /**< 64 bits input. */ ) {
+  return __builtin_popcountll (val);
+}
+
+/** Same as `hamming_distance()`. \return The Hamming distance between the two inputs. */
+static inline int
+hamming_distance_fast (uint64_t val1 /**< The first 64 bits input. */ ,
+		       uint64_t val2
+		       /**< The second 64 bits input. */
+  ) {
+  return __builtin_popcountll (val1 ^ val2);
+}
+
+/** Unchecked `hamming_weight4()`: the 16 nibbles of a constant are the Hamming weights of 0 to 15. \return The Hamming weight of the input. */
+static inline int
+hamming_weight4_fast (uint64_t val /**< 4 bits input. */ ) {
+  return (int) ((UINT64_C (0x4332322132212110) >> (4 * val)) & UINT64_C (0xf));
+}
+
+/** Unchecked `hamming_weight6()`. \return The Hamming weight of the input. */
+static inline int
+hamming_weight6_fast (uint64_t val /**< 6 bits input. */ ) {
+  return hamming_weight4_fast (val & UINT64_C (0xf)) + hamming_weight4_fast (val >> 4);
+}
+
+/** Same as `des_right_half()`. \return The 32 bits right half of a 64 bits word. */
+static inline uint64_t
+des_right_half_fast (uint64_t val /**< 64 bits input. */ ) {
+  return val & UINT64_C (0xffffffff);
+}
+
+/** Same as `des_left_half()`. \return The 32 bits left half of a 64 bits word. */
+static inline uint64_t
+des_left_half_fast (uint64_t val /**< 64 bits input. */ ) {
+  return val >> 32;
+}
+
+/** Unchecked `des_f()`. \return The transformed input, as a 32 bits `uint64_t`. */
+static inline uint64_t
+des_f_fast (uint64_t rk /**< 48 bits round key. */ ,
+	    uint64_t val
+	    /**< 32 bits data input. */
+  ) {
+  return des_p_fast (des_sboxes_fast (des_e_fast (val) ^ rk));
+}
+
+/** Unchecked `des_f_sp()`. \return The transformed input, as a 32 bits `uint64_t`. */
+static inline uint64_t
+des_f_sp_fast (uint64_t rk /**< 48 bits round key. */ ,
+	       uint64_t val
+	       /**< 32 bits data input. */
+  ) {
+  return des_sp_fast (des_e_fast (val) ^ rk);
+}
+
+#endif /** not DES_FAST_H */
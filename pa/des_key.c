@@ -0,0 +1,186 @@
+/*
+ * Copyright (C) Telecom Paris
+ *
+ * This file must be used under the terms of the CeCILL. This source
+ * file is licensed as described in the file COPYING, which you should
+ * have received as part of this distribution. The terms are also
+ * available at:
+ * http://www.cecill.info/licences/Licence_CeCILL_V1.1-US.txt
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "utils.h"
+#include "des.h"
+#include "des_bs.h"
+#include "des_key.h"
+
+/* State of a search, shared by all threads. Candidates are handed out in
+ * array order; the search stops processing candidates past the first match
+ * found so far, such that the result does not depend on the scheduling. */
+typedef struct {
+  uint64_t *k16;		/* Last round keys. */
+  int m;			/* Number of last round keys. */
+  uint64_t *pt;			/* Known plaintexts. */
+  uint64_t *ct;			/* Known ciphertexts. */
+  int n;			/* Number of known pairs. */
+  int next;			/* Next last round key to process. */
+  int found;			/* Index of first match, m if none yet. */
+  uint64_t key;			/* Secret key of first match. */
+  pthread_mutex_t lock;		/* Protects next, found and key. */
+} des_key_search;
+
+void
+des_key_candidates (uint64_t k16, uint64_t * keys) {
+  uint64_t cd, missing, bit, m;
+  int i, j;
+
+  if (k16 >> 48)
+    ERROR (, -1, "Invalid last round key: 0x%016" PRIx64, k16);
+  cd = des_n_pc2 (k16);
+  /* The 8 bits of C16D16 that PC2 drops. */
+  missing = UINT64_C (0xffffffffffffff) ^ des_n_pc2 (UINT64_C (0xffffffffffff));
+  for (i = 0; i < DES_KEY_CANDIDATES; i++) {
+    m = cd;
+    for (j = 0, bit = missing; bit != UINT64_C (0x0); j++, bit &= bit - 1) {
+      if ((i >> j) & 1) {
+	m |= bit & (~bit + 1);
+      }
+    }
+    keys[i] = des_n_pc1 (m);
+  }
+}
+
+/* Verifies the 256 candidates of last round key k16 against the n known pairs
+ * (pt, ct). Returns one and stores the secret key in *key on success. */
+static int
+des_key_verify (uint64_t * kpt, uint64_t * kct, int n, uint64_t k16, uint64_t * key) {
+  uint64_t keys[DES_KEY_CANDIDATES], pt[DES_KEY_CANDIDATES], ct[DES_KEY_CANDIDATES], ks[16];
+  int i, j;
+
+  des_key_candidates (k16, keys);
+  for (i = 0; i < DES_KEY_CANDIDATES; i++) {
+    pt[i] = kpt[0];
+  }
+  des_enc_bs_keys_n (keys, pt, ct, DES_KEY_CANDIDATES);
+  for (i = 0; i < DES_KEY_CANDIDATES; i++) {
+    if (ct[i] != kct[0]) {
+      continue;
+    }
+    des_ks (ks, keys[i]);
+    for (j = 1; j < n; j++) {
+      if (des_enc (ks, kpt[j]) != kct[j]) {
+	break;
+      }
+    }
+    if (j == n) {
+      *key = keys[i];
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void *
+des_key_worker (void *arg) {
+  des_key_search *s;
+  uint64_t key;
+  int i;
+
+  s = arg;
+  while (1) {
+    pthread_mutex_lock (&s->lock);
+    i = s->next;
+    s->next += 1;
+    if (i >= s->found) {
+      pthread_mutex_unlock (&s->lock);
+      break;
+    }
+    pthread_mutex_unlock (&s->lock);
+    if (des_key_verify (s->pt, s->ct, s->n, s->k16[i], &key)) {
+      pthread_mutex_lock (&s->lock);
+      if (i < s->found) {
+	s->found = i;
+	s->key = key;
+      }
+      pthread_mutex_unlock (&s->lock);
+    }
+  }
+  return NULL;
+}
+
+int
+des_key_check (uint64_t k16, void *pairs) {
+  des_key_pairs *p;
+  uint64_t key;
+
+  p = pairs;
+  if (k16 >> 48)
+    ERROR (0, -1, "Invalid last round key: 0x%016" PRIx64, k16);
+  if (!des_key_verify (p->pt, p->ct, p->n, k16, &key)) {
+    return 0;
+  }
+  p->key = key;
+  return 1;
+}
+
+int
+des_recover_key (uint64_t k16, uint64_t * pt, uint64_t * ct, int n, uint64_t * key) {
+  return des_recover_key_list (&k16, 1, pt, ct, n, 1, key) == 0;
+}
+
+int
+des_recover_key_list (uint64_t * k16, int m, uint64_t * pt, uint64_t * ct, int n, int threads, uint64_t * key) {
+  des_key_search s;
+  pthread_t *tid;
+  int i;
+
+  if (m < 0)
+    ERROR (, -1, "Invalid number of last round keys: %d", m);
+  if (n < 1)
+    ERROR (, -1, "Invalid number of known pairs: %d (shall be at least 1)", n);
+  for (i = 0; i < m; i++) {
+    if (k16[i] >> 48)
+      ERROR (, -1, "Invalid last round key #%d: 0x%016" PRIx64, i, k16[i]);
+  }
+  if (threads < 1) {
+    threads = (int) sysconf (_SC_NPROCESSORS_ONLN);
+  }
+  if (threads > m) {
+    threads = m;
+  }
+  s.k16 = k16;
+  s.m = m;
+  s.pt = pt;
+  s.ct = ct;
+  s.n = n;
+  s.next = 0;
+  s.found = m;
+  s.key = UINT64_C (0x0);
+  pthread_mutex_init (&s.lock, NULL);
+  if (threads <= 1) {
+    des_key_worker (&s);
+  }
+  else {
+    tid = XCALLOC (threads, sizeof (pthread_t));
+    for (i = 0; i < threads; i++) {
+      if (pthread_create (tid + i, NULL, des_key_worker, &s) != 0)
+	ERROR (, -1, "cannot create thread #%d", i);
+    }
+    for (i = 0; i < threads; i++) {
+      pthread_join (tid[i], NULL);
+    }
+    free (tid);
+  }
+  pthread_mutex_destroy (&s.lock);
+  if (s.found == m) {
+    return -1;
+  }
+  *key = s.key;
+  return s.found;
+}
@@ -0,0 +1,401 @@
+/*
+ * Copyright (C) Telecom Paris
+ *
+ * This file must be used under the terms of the CeCILL. This source
+ * file is licensed as described in the file COPYING, which you should
+ * have received as part of this distribution. The terms are also
+ * available at:
+ * http://www.cecill.info/licences/Licence_CeCILL_V1.1-US.txt
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "utils.h"
+#include "key_enum.h"
+
+/* Number of keys enumerated before each parallel verification pass, and
+ * number of keys handed out at a time to a verification thread. */
+#define KE_BATCH 16384
+#define KE_CHUNK 64
+
+/* A candidate of the frontier of a node: the i-th candidate of the left child
+ * combined with the j-th candidate of the right child. */
+typedef struct {
+  double score;
+  int64_t i, j;
+} ke_item;
+
+/* A node of the merge tree. Leaves hold the 64 sorted guesses of a SBox. */
+typedef struct ke_node_s {
+  struct ke_node_s *a, *b;	/* Left and right children, NULL for leaves. */
+  int bits;			/* Width of the values of the right child. */
+  int keep;			/* Store produced candidates (for the parent). */
+  int64_t len, cap;		/* Number of stored candidates, capacity. */
+  double *score;		/* Scores of stored candidates. */
+  uint64_t *val;		/* Values of stored candidates. */
+  ke_item *heap;		/* Frontier, a binary max-heap on scores. */
+  int64_t hlen, hcap;		/* Frontier size, capacity. */
+} ke_node;
+
+struct ke_context_s {
+  ke_node leaf[8];		/* SBoxes 1 to 8. */
+  ke_node pair[4];		/* 12, 34, 56, 78. */
+  ke_node quad[2];		/* 1234, 5678. */
+  ke_node root;			/* Not stored. */
+  int64_t count;		/* Number of keys produced by ke_next(). */
+};
+
+/* Shared state of a parallel verification pass. */
+typedef struct {
+  uint64_t *k16;		/* Candidates, in rank order. */
+  int n;			/* Number of candidates. */
+  int next;			/* Next candidate to hand out. */
+  int found;			/* Index of best accepted candidate, n if none. */
+  ke_verify verify;
+  void *arg;
+  pthread_mutex_t lock;		/* Protects next and found. */
+} ke_pass;
+
+static void
+ke_push (ke_node * n, double score, int64_t i, int64_t j) {
+  ke_item t;
+  int64_t k;
+
+  if (n->hlen == n->hcap) {
+    n->hcap = 2 * n->hcap + 16;
+    n->heap = XREALLOC (n->heap, n->hcap * sizeof (ke_item));
+  }
+  t.score = score;
+  t.i = i;
+  t.j = j;
+  for (k = n->hlen++; k > 0 && n->heap[(k - 1) / 2].score < score; k = (k - 1) / 2) {
+    n->heap[k] = n->heap[(k - 1) / 2];
+  }
+  n->heap[k] = t;
+}
+
+static ke_item
+ke_pop (ke_node * n) {
+  ke_item res, t;
+  int64_t k, c;
+
+  res = n->heap[0];
+  t = n->heap[--n->hlen];
+  for (k = 0; (c = 2 * k + 1) < n->hlen; k = c) {
+    if (c + 1 < n->hlen && n->heap[c + 1].score > n->heap[c].score) {
+      c += 1;
+    }
+    if (n->heap[c].score <= t.score) {
+      break;
+    }
+    n->heap[k] = n->heap[c];
+  }
+  n->heap[k] = t;
+  return res;
+}
+
+static int ke_get (ke_node * n, int64_t k);
+
+/* Produces the next candidate of inner node n, stores it if n->keep.
+ * Returns zero if n is exhausted. */
+static int
+ke_produce (ke_node * n, double *score, uint64_t * val) {
+  ke_item t;
+
+  if (n->hlen == 0) {
+    return 0;
+  }
+  t = ke_pop (n);
+  *score = t.score;
+  *val = (n->a->val[t.i] << n->bits) | n->b->val[t.j];
+  if (ke_get (n->b, t.j + 1)) {
+    ke_push (n, n->a->score[t.i] + n->b->score[t.j + 1], t.i, t.j + 1);
+  }
+  if (t.j == 0 && ke_get (n->a, t.i + 1)) {
+    ke_push (n, n->a->score[t.i + 1] + n->b->score[0], t.i + 1, 0);
+  }
+  if (n->keep) {
+    if (n->len == n->cap) {
+      n->cap = 2 * n->cap + 64;
+      n->score = XREALLOC (n->score, n->cap * sizeof (double));
+      n->val = XREALLOC (n->val, n->cap * sizeof (uint64_t));
+    }
+    n->score[n->len] = *score;
+    n->val[n->len] = *val;
+    n->len += 1;
+  }
+  return 1;
+}
+
+/* Makes sure that candidate #k of node n has been produced. Returns zero if n
+ * has less than k + 1 candidates. */
+static int
+ke_get (ke_node * n, int64_t k) {
+  double score;
+  uint64_t val;
+
+  while (n->len <= k) {
+    if (n->a == NULL || !ke_produce (n, &score, &val)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static void
+ke_node_init (ke_node * n, ke_node * a, ke_node * b, int bits, int keep) {
+  n->a = a;
+  n->b = b;
+  n->bits = bits;
+  n->keep = keep;
+  n->len = n->cap = n->hlen = n->hcap = 0;
+  n->score = NULL;
+  n->val = NULL;
+  n->heap = NULL;
+  ke_get (a, 0);
+  ke_get (b, 0);
+  ke_push (n, a->score[0] + b->score[0], 0, 0);
+}
+
+ke_context
+ke_init (double scores[8][64]) {
+  ke_context ctx;
+  ke_node *l;
+  double s;
+  uint64_t v;
+  int i, j, k;
+
+  ctx = XCALLOC (1, sizeof (struct ke_context_s));
+  for (i = 0; i < 8; i++) {
+    l = ctx->leaf + i;
+    l->score = XCALLOC (64, sizeof (double));
+    l->val = XCALLOC (64, sizeof (uint64_t));
+    l->len = l->cap = 64;
+    /* Insertion sort by decreasing score; ties keep increasing guesses. */
+    for (j = 0; j < 64; j++) {
+      s = scores[i][j];
+      if (isnan (s)) {
+	ERROR (NULL, -1, "Invalid score of guess %d on SBox %d: NaN", j, i + 1);
+      }
+      v = (uint64_t) (j);
+      for (k = j; k > 0 && l->score[k - 1] < s; k--) {
+	l->score[k] = l->score[k - 1];
+	l->val[k] = l->val[k - 1];
+      }
+      l->score[k] = s;
+      l->val[k] = v;
+    }
+  }
+  for (i = 0; i < 4; i++) {
+    ke_node_init (ctx->pair + i, ctx->leaf + 2 * i, ctx->leaf + 2 * i + 1, 6, 1);
+  }
+  for (i = 0; i < 2; i++) {
+    ke_node_init (ctx->quad + i, ctx->pair + 2 * i, ctx->pair + 2 * i + 1, 12, 1);
+  }
+  ke_node_init (&ctx->root, ctx->quad, ctx->quad + 1, 24, 0);
+  ctx->count = 0;
+  return ctx;
+}
+
+void
+ke_free (ke_context ctx) {
+  ke_node *n[15];
+  int i;
+
+  for (i = 0; i < 8; i++) {
+    n[i] = ctx->leaf + i;
+  }
+  for (i = 0; i < 4; i++) {
+    n[8 + i] = ctx->pair + i;
+  }
+  n[12] = ctx->quad;
+  n[13] = ctx->quad + 1;
+  n[14] = &ctx->root;
+  for (i = 0; i < 15; i++) {
+    free (n[i]->score);
+    free (n[i]->val);
+    free (n[i]->heap);
+  }
+  free (ctx);
+}
+
+int
+ke_next (ke_context ctx, uint64_t * k16, double *score) {
+  double s;
+
+  if (!ke_produce (&ctx->root, &s, k16)) {
+    return 0;
+  }
+  if (score != NULL) {
+    *score = s;
+  }
+  ctx->count += 1;
+  return 1;
+}
+
+int64_t
+ke_count (ke_context ctx) {
+  return ctx->count;
+}
+
+static void *
+ke_worker (void *arg) {
+  ke_pass *p;
+  int i, k, end;
+
+  p = arg;
+  while (1) {
+    pthread_mutex_lock (&p->lock);
+    i = p->next;
+    p->next += KE_CHUNK;
+    pthread_mutex_unlock (&p->lock);
+    end = (i + KE_CHUNK < p->n) ? i + KE_CHUNK : p->n;
+    for (k = i; k < end; k++) {
+      /* Unlocked read: found only decreases, a stale value only costs a
+       * useless verification. */
+      if (k >= __atomic_load_n (&p->found, __ATOMIC_RELAXED)) {
+	return NULL;
+      }
+      if (p->verify (p->k16[k], p->arg)) {
+	pthread_mutex_lock (&p->lock);
+	if (k < p->found) {
+	  __atomic_store_n (&p->found, k, __ATOMIC_RELAXED);
+	}
+	pthread_mutex_unlock (&p->lock);
+	return NULL;
+      }
+    }
+    if (end == p->n) {
+      return NULL;
+    }
+  }
+}
+
+int64_t
+ke_search (double scores[8][64], int64_t budget, int threads, ke_verify verify, void *arg, uint64_t * k16) {
+  ke_context ctx;
+  ke_pass p;
+  pthread_t *tid;
+  int64_t rank;
+  int i;
+
+  if (budget < 0)
+    ERROR (-1, -1, "Invalid budget: %" PRId64, budget);
+  if (threads < 1) {
+    threads = (int) sysconf (_SC_NPROCESSORS_ONLN);
+  }
+  ctx = ke_init (scores);
+  p.k16 = XCALLOC (KE_BATCH, sizeof (uint64_t));
+  p.verify = verify;
+  p.arg = arg;
+  pthread_mutex_init (&p.lock, NULL);
+  tid = XCALLOC (threads, sizeof (pthread_t));
+  rank = -1;
+  while (rank == -1 && ke_count (ctx) < budget) {
+    p.n = 0;
+    while (p.n < KE_BATCH && ke_count (ctx) < budget && ke_next (ctx, p.k16 + p.n, NULL)) {
+      p.n += 1;
+    }
+    if (p.n == 0) {
+      break;
+    }
+    p.next = 0;
+    p.found = p.n;
+    if (threads == 1) {
+      ke_worker (&p);
+    }
+    else {
+      for (i = 0; i < threads; i++) {
+	if (pthread_create (tid + i, NULL, ke_worker, &p) != 0)
+	  ERROR (-1, -1, "cannot create thread #%d", i);
+      }
+      for (i = 0; i < threads; i++) {
+	pthread_join (tid[i], NULL);
+      }
+    }
+    if (p.found < p.n) {
+      *k16 = p.k16[p.found];
+      rank = ke_count (ctx) - p.n + p.found;
+    }
+  }
+  pthread_mutex_destroy (&p.lock);
+  free (tid);
+  free (p.k16);
+  ke_free (ctx);
+  return rank;
+}
+
+void
+ke_rank (double scores[8][64], uint64_t k16, int bins, double *lo, double *hi) {
+  double min[8], range, w, *acc, *tmp;
+  int bin[8][64], len, i, j, s, g, b;
+
+  if (k16 >> 48)
+    ERROR (, -1, "Invalid last round key: 0x%016" PRIx64, k16);
+  if (bins < 1) {
+    bins = KE_RANK_BINS;
+  }
+  if (bins < 2)
+    ERROR (, -1, "Invalid number of bins: %d (shall be at least 2)", bins);
+  range = 0.0;
+  for (s = 0; s < 8; s++) {
+    min[s] = scores[s][0];
+    for (g = 1; g < 64; g++) {
+      if (isnan (scores[s][g]))
+	ERROR (, -1, "Invalid score of guess %d on SBox %d: NaN", g, s + 1);
+      min[s] = (scores[s][g] < min[s]) ? scores[s][g] : min[s];
+    }
+    for (g = 0; g < 64; g++) {
+      range = (scores[s][g] - min[s] > range) ? scores[s][g] - min[s] : range;
+    }
+  }
+  w = (range > 0.0) ? range / (bins - 1) : 1.0;
+  for (s = 0; s < 8; s++) {
+    for (g = 0; g < 64; g++) {
+      b = (int) (floor ((scores[s][g] - min[s]) / w));
+      bin[s][g] = (b < bins) ? b : bins - 1;
+    }
+  }
+  /* Convolution of the histograms: each has at most 64 non-empty bins, so
+   * the histogram of the first s SBoxes is shifted and added 64 times. */
+  acc = XCALLOC (8 * bins, sizeof (double));
+  tmp = XCALLOC (8 * bins, sizeof (double));
+  for (g = 0; g < 64; g++) {
+    acc[bin[0][g]] += 1.0;
+  }
+  len = bins;
+  for (s = 1; s < 8; s++) {
+    for (i = 0; i < len + bins - 1; i++) {
+      tmp[i] = 0.0;
+    }
+    for (g = 0; g < 64; g++) {
+      for (i = 0, j = bin[s][g]; i < len; i++, j++) {
+	tmp[j] += acc[i];
+      }
+    }
+    len += bins - 1;
+    for (i = 0; i < len; i++) {
+      acc[i] = tmp[i];
+    }
+  }
+  b = 0;
+  for (s = 0; s < 8; s++) {
+    b += bin[s][(k16 >> (42 - 6 * s)) & UINT64_C (0x3f)];
+  }
+  /* Keys 8 bins or more above b certainly have a greater joint score, keys
+   * 8 bins or more below certainly have a lower one. */
+  *lo = 1.0;
+  *hi = 0.0;
+  for (i = len - 1; i > b - 8 && i >= 0; i--) {
+    *lo += (i >= b + 8) ? acc[i] : 0.0;
+    *hi += acc[i];
+  }
+  free (acc);
+  free (tmp);
+}
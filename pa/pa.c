@@ -16,10 +16,16 @@
 #include <stdint.h>
 #include <inttypes.h>
 #include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include "utils.h"
 #include "traces.h"
 #include "des.h"
+#include "des_fast.h"
+#include "des_key.h"
+#include "key_enum.h"
 
 /* The P permutation table, as in the standard. The first entry (16) is the
  * position of the first (leftmost) bit of the result in the input 32 bits word.
@@ -36,7 +42,9 @@ int p_table[32] = {
   22, 11, 4, 25
 };
 
-tr_context ctx;  // Trace context (see traces.h)
+tr_context ctx;  // First traces of the datafile: secret key, length and known pairs (see traces.h)
+char *datafile;  // Name of the datafile, read by batches (see tr_stream_open)
+int ntraces;     // Number of acquisitions to use
 int target_bit;  // Index of target bit.
 int target_sbox; // Index of target SBox.
 int best_guess;  // Best guess
@@ -44,31 +52,229 @@ int best_idx;    // Best argmax
 float best_max;  // Best max sample value
 float *dpa[64];  // 64 DPA traces
 uint64_t rk;     // Last round key
+double scores[8][64]; // Scores of the guesses on the 8 6-bits subkeys (zero if not attacked)
+int partitioned; // Partitioned DPA (default), else generic DPA
+int all_sboxes;  // All-SBoxes DPA: all 32 bits of L15 in a single pass
+int64_t budget;  // Maximum number of last round keys to enumerate (all-SBoxes DPA)
+float *sbox_dpa[8]; // Combined DPA traces of the best guesses on the 8 SBoxes (all-SBoxes DPA)
+int threads;     // Number of threads
+float *avg_trace; // Average power trace (see average)
+int win_first;   // Index of first point of the attack window
+int win_length;  // Number of points of the attack window, 0 for whole traces
 
-/* A function to allocate cipher texts and power traces, read the
- * datafile and store its content in allocated context. */
+/* Multi-threaded passes over the traces: the points of the traces are split in
+ * one slice of consecutive points per thread, made of blocks of PA_COLUMNS
+ * points (one cache line of the accumulators). Each thread owns the points of
+ * its slice in all the shared accumulators and adds every trace, in the order
+ * of the datafile: each point is computed as by a single thread and the
+ * results do not depend on the number of threads. The threads are those of a
+ * persistent pool, created once for the whole run (see pool_start). */
+#define PA_COLUMNS (TR_ALIGN / 4)
+
+/* Work of a thread on a batch of traces. */
+typedef struct {
+  int id;         // Index of thread, from 0 to threads - 1
+  tr_context v;   // View of ctx restricted to the slice of the thread, NULL if empty slice
+  int lo;         // Index of the first point of the slice
+  tr_context b;   // Batch of traces
+  uint64_t *r16;  // R16 of the ciphertexts of the batch
+  uint64_t *er15; // E(R15) = E(L16) of the ciphertexts of the batch
+  uint64_t *pr16; // P^-1(R16) of the ciphertexts of the batch (all-SBoxes DPA)
+  void *acc;      // Accumulators, shared by all threads
+} pa_work;
+
+/* Persistent pool of threads - 1 worker threads. The calling thread runs the
+ * work of thread 0 of each job (see run_threads). */
+typedef struct {
+  pthread_t *tid;         // Worker threads 1 to threads - 1
+  pthread_mutex_t lock;   // Lock of the pool
+  pthread_cond_t go;      // Signaled when a job is posted
+  pthread_cond_t done;    // Signaled when the last worker completes its work
+  void *(*job) (void *);  // Current job, NULL to stop the workers
+  pa_work *w;             // Work of the threads for the current job
+  int gen;                // Number of posted jobs
+  int busy;               // Number of workers still running the current job
+} pa_pool;
+
+/* State of dpa_attack, shared by its threads: zero- and one-sets of the 64
+ * guesses (generic DPA) or class sums (partitioned DPA). The numbers of traces
+ * are counted by thread 0 only. */
+typedef struct {
+  float *t0[64];  // Power traces for the zero-sets (one per guess)
+  float *t1[64];  // Power traces for the one-sets (one per guess)
+  int n0[64];     // Number of power traces in the zero-sets (one per guess)
+  int n1[64];     // Number of power traces in the one-sets (one per guess)
+  float *sc[128]; // Sums of the power traces of the classes (see partition)
+  int nc[128];    // Number of power traces in the classes
+  int (*d)[64];   // Decisions of the traces of a batch (generic DPA)
+} dpa_state;
+
+/* State of the all-SBoxes DPA, shared by its threads. The numbers of traces are
+ * counted by thread 0 only. */
+typedef struct {
+  float *sc[8][1024];  // Sums of the power traces of the classes of the 8 SBoxes
+  int nc[8][1024];     // Number of power traces in the classes
+  int dc[32][128][64]; // Decisions of the classes of the 32 bits of L15 (see class_decision)
+  float *cd[8][64];    // Combined DPA traces of the 8 SBoxes (one per guess)
+} dpa_all_state;
+
+pa_pool pool;    // Pool of threads
+
+/* A function to check that the datafile contains at least n acquisitions and
+ * to read its first ones in context ctx. The power traces are processed by
+ * batches of TR_STREAM_BATCH traces, in bounded memory, whatever the number of
+ * acquisitions. */
 void read_datafile (char *name, int n);
 
-/* Compute the average power trace of the traces context ctx, print it in file
+/* Compute the average power trace of the datafile, print it in file
  * <prefix>.dat and print the corresponding gnuplot command in <prefix>.cmd. In
  * order to plot the average power trace, type: $ gnuplot -persist <prefix>.cmd
- * */
+ * The average power trace is kept in avg_trace. */
 void average (char *prefix);
 
+/* Locates the last round of the DES in the average power trace avg_trace and
+ * sets the attack window (win_first, win_length) around it. The clock period is
+ * estimated by autocorrelation and the trace is segmented in clock cycles, one
+ * per clock peak. The 16 consecutive cycles with the highest peaks are the 16
+ * rounds. As the register update of a round shows in the peak of the next
+ * cycle, the detected run may be late by one cycle: the window spans the last
+ * cycle of the run, the previous one and the next one. Returns 1 on success,
+ * 0 if no clear clock or no 16 rounds are found. */
+int locate_last_round (void);
+
+/* Creates the threads - 1 worker threads of the pool. */
+void pool_start (void);
+
+/* Stops and joins the worker threads of the pool. */
+void pool_stop (void);
+
+/* Body of the worker thread #(intptr_t) arg of the pool: waits for jobs and
+ * runs them on its work. */
+void *pool_worker (void *arg);
+
+/* Runs worker on w[0..threads-1], one thread of the pool each, and waits for
+ * their completion. */
+void run_threads (void *(*worker) (void *), pa_work *w);
+
+/* Sets the slices of the threads w[0..threads-1] (see PA_COLUMNS), for the
+ * current length of the traces of ctx: w[i].lo and w[i].v. The blocks are dealt
+ * as evenly as possible, the first threads getting one more if needed: the
+ * slice of thread 0 is never empty. */
+void slices (pa_work *w);
+
+/* Frees the views of the slices of the threads w[0..threads-1]. */
+void free_slices (pa_work *w);
+
+/* Thread of average: accumulates the slices of the traces in its tr_stats
+ * accumulator w->acc. */
+void *average_worker (void *arg);
+
+/* Pre-computes the R16 and E(L16) arrays from the ciphertexts of the batch of
+ * traces b, in a few tight passes over the whole batch. */
+void precompute (tr_context b, uint64_t *r16, uint64_t *er15);
+
 /* Decision function: computes bit <target_bit> of L15 for all possible values
- * of the corresponding 6-bits subkey. Takes a ciphertext and returns an array
- * of 64 values (0 or 1). */
-void decision (uint64_t ct, int d[64]);
+ * of the corresponding 6-bits subkey. Takes R16 and E(R15) = E(L16) of a
+ * ciphertext (see precompute) and returns an array of 64 values (0 or 1). */
+void decision (uint64_t r16, uint64_t er15, int d[64]);
+
+/* Partition function of the partitioned DPA: computes the class (0 to 127) of a
+ * ciphertext from its R16 and E(R15) = E(L16) (see precompute). The class is
+ * made of bit <target_bit> of R16 and of the 6 bits of E(L16) entering SBox
+ * <target_sbox>, the only bits of the ciphertext the decision function depends
+ * on. */
+int partition (uint64_t r16, uint64_t er15);
+
+/* Computes the 64 decisions of the ciphertexts of class c (see partition), by
+ * calling the decision function on a representative of the class. */
+void class_decision (int c, int d[64]);
+
+/* Checks that the decision function only depends on the class of the
+ * ciphertexts (see partition), on the m ciphertexts of a batch, given their R16
+ * and E(L16). Returns 1 if it does, else 0. */
+int partition_check (int m, uint64_t *r16, uint64_t *er15);
+
+/* Accumulates the 128 class sums sc[0..127] of nc[0..127] power traces (see
+ * partition) in the zero-sets t0[0..63] and one-sets t1[0..63] of the 64
+ * guesses, and their numbers of traces in n0[0..63] and n1[0..63], given the
+ * decisions dc of the classes (see class_decisions). The traces have the length
+ * of the traces of context v. */
+void class_sets (tr_context v, int dc[128][64], float *sc[128], int nc[128], float *t0[64], int n0[64], float *t1[64],
+                 int n1[64]);
+
+/* Computes the decisions dc[0..127][0..63] of the 128 classes (see
+ * class_decision), for use by class_sets. */
+void class_decisions (int dc[128][64]);
+
+/* Estimates the rank of the true last round key (computed from the secret key
+ * of the traces file) given the scores of the attack and prints the bounds on
+ * the standard error. */
+void key_rank (void);
+
+/* Computes the rank (1 to 64) of the true 6-bits subkey of the target SBox
+ * (computed from the secret key of the traces file) among the guesses of the
+ * single-bit attack and prints it on the standard error. */
+void subkey_rank (void);
+
+/* Searches the 64 bits secret key corresponding to last round key k16, checks
+ * the candidates against the first (at most 4) plaintext / ciphertext pairs of
+ * the traces context ctx and prints the result on the standard error. */
+void recover_key (uint64_t k16);
 
 /* Apply P. Kocher's DPA algorithm based on decision function. Computes 64 DPA
  * traces dpa[0..63], best_guess (6-bits subkey corresponding to highest DPA
  * peak), best_max (height of highest DPA peak) and best_idx (index of highest
- * DPA peak). */
+ * DPA peak). In partitioned mode each power trace is accumulated once, in the
+ * sum of its class (see partition), instead of once per guess; the zero- and
+ * one-sets of the 64 guesses are then built from the 128 class sums. If the
+ * decision function does not pass the partition check on the first batch of
+ * traces, falls back to generic DPA with a warning. */
 void dpa_attack (void);
 
+/* Thread of dpa_attack, on a batch of traces, before dpa_worker: computes the
+ * decisions of its share of the traces (generic DPA, see dpa_state). */
+void *dpa_decide (void *arg);
+
+/* Thread of dpa_attack, on a batch of traces: accumulates the slices of the
+ * traces in the zero- and one-sets or in the class sums (see dpa_state). */
+void *dpa_worker (void *arg);
+
+/* Partitioned DPA on all 32 bits of L15 in a single pass over the traces. The
+ * class of a ciphertext for SBox s is made of the 6 bits of E(L16) entering
+ * SBox s and of the 4 bits of R16 XORed with its outputs: each power trace is
+ * accumulated once per SBox, in one of 8 x 1024 class sums. Then, for each
+ * SBox, computes the DPA traces of the 4 bits it outputs, adds them in one
+ * combined DPA trace per guess and scores the guess with its maximum. Fills the
+ * 8 x 64 scores matrix, the combined DPA traces of the best guesses
+ * sbox_dpa[0..7] and the last round key rk made of the 8 best guesses. Uses
+ * 8192 traces of memory for the class sums and 512 for the combined DPA
+ * traces, whatever the number of threads. */
+void dpa_attack_all (void);
+
+/* Thread of dpa_attack_all, on a batch of traces: accumulates the slices of the
+ * traces in the class sums of the 8 SBoxes (see dpa_all_state). */
+void *dpa_all_worker (void *arg);
+
+/* Thread of dpa_attack_all, after the pass: computes the slices of the
+ * combined DPA traces of the 8 SBoxes (see dpa_all_state). */
+void *dpa_all_combine (void *arg);
+
+/* Prints the 8 x 64 scores matrix in file <prefix>.dat, one line per SBox. */
+void print_scores (char *prefix);
+
+/* Enumerates the last round keys in decreasing order of the scores, at most
+ * budget of them, and checks each against the first (at most 4) plaintext /
+ * ciphertext pairs of the traces context ctx. Prints the result on the standard
+ * error and, if a key is found, stores the last round key in rk. */
+void search_key (void);
+
 int main (int argc, char **argv) {
   int n; // Number of acquisitions to use
   int g; // Guess on a 6-bits subkey
+  int c; // Option character
+  int s; // SBox index
+  int locate; // Locate the last round in the average power trace
+  char *end; // End of parsed window
 
   /************************************************************************/
   /* Before doing anything else, check the correctness of the DES library */
@@ -82,24 +288,83 @@ int main (int argc, char **argv) {
   /*************************************/
   /* If invalid number of arguments (including program name), exit with error
    * message. */
-  if (argc != 3 && argc != 4) {
+  partitioned = 1;
+  all_sboxes = 0;
+  budget = 65536;
+  threads = 0;
+  locate = 0;
+  win_first = 0;
+  win_length = 0;
+  while (optind <= argc && (c = getopt (argc, argv, "gae:j:w:")) != -1) { // Stop at the first invalid option
+    switch (c) {
+      case 'g': // Generic DPA
+        partitioned = 0;
+        break;
+      case 'a': // All-SBoxes DPA
+        all_sboxes = 1;
+        break;
+      case 'e': // Enumeration budget
+        budget = atoll (optarg);
+        if (budget < 1) {
+          ERROR (0, -1, "Invalid enumeration budget: %s (shall be at least 1)", optarg);
+        }
+        break;
+      case 'j': // Number of threads
+        threads = atoi (optarg);
+        break;
+      case 'w': // Attack window
+        if (strcmp (optarg, "auto") == 0) {
+          locate = 1;
+          win_first = 0;
+          win_length = 0;
+          break;
+        }
+        win_first = (int) strtol (optarg, &end, 10);
+        if (end == optarg || *end != ':') {
+          ERROR (0, -1, "Invalid window: %s (shall be auto or FIRST:LENGTH)", optarg);
+        }
+        win_length = (int) strtol (end + 1, &end, 10);
+        if (*end != '\0' || win_first < 0 || win_length < 1) {
+          ERROR (0, -1, "Invalid window: %s (shall be auto or FIRST:LENGTH)", optarg);
+        }
+        locate = 0;
+        break;
+      default: // Invalid option: print usage
+        optind = argc + 1;
+    }
+  }
+  if ((argc - optind != 2 && argc - optind != 3) || (all_sboxes && (argc - optind == 3 || !partitioned))) {
     ERROR (0, -1, "\
-usage: pa FILE N [B]\n\
+usage: pa [-j THREADS] [-w WINDOW] [-g] FILE N [B]\n\
+       pa [-j THREADS] [-w WINDOW] -a [-e BUDGET] FILE N\n\
   FILE: name of the traces file in HWSec format\n\
   N: number of acquisitions to use\n\
-  B: index of target bit in L15 (1 to 32, as in DES standard, default: 1)\n");
+  B: index of target bit in L15 (1 to 32, as in DES standard, default: 1)\n\
+  -g: generic DPA, one accumulation per trace and guess (default: partitioned\n\
+     DPA, one accumulation per trace, if the decision function allows it)\n\
+  -a: all-SBoxes DPA, all 32 bits of L15 in a single pass, followed by a\n\
+     search of the secret key\n\
+  -e BUDGET: maximum number of last round keys to try (default: 65536)\n\
+  -j THREADS: number of threads (default: one per online processor); the\n\
+     results do not depend on it\n\
+  -w WINDOW: attack window, auto (located from the average power trace) or\n\
+     FIRST:LENGTH (points FIRST to FIRST+LENGTH-1); default: whole traces\n");
   }
-  /* Number of acquisitions to use is argument #2, convert it to integer and
+  if (threads < 1) { // If no or invalid number of threads, one per online processor
+    threads = (int) sysconf (_SC_NPROCESSORS_ONLN);
+  }
+  pool_start ();
+  /* Number of acquisitions to use is positional argument #2, convert it to integer and
    * store the result in variable n. */
-  n = atoi (argv[2]);
+  n = atoi (argv[optind + 1]);
   if (n < 1) { // If invalid number of acquisitions.
     ERROR (0, -1, "Invalid number of acquisitions: %d (shall be greater than 1)", n);
   }
   target_bit = 1;
-  /* If 3 arguments, target bit is argument #3, convert it to integer and store
+  /* If 3 positional arguments, target bit is argument #3, convert it to integer and store
    * the result in variable target_bit. */
-  if (argc == 4) {
-    target_bit = atoi (argv[3]);
+  if (argc - optind == 3) {
+    target_bit = atoi (argv[optind + 2]);
   }
   if (target_bit < 1 || target_bit > 32) { // If invalid target bit index
     ERROR (0, -1, "Invalid target bit index: %d (shall be between 1 and 32 included)", target_bit);
@@ -108,7 +373,10 @@ usage: pa FILE N [B]\n\
   target_sbox = (p_table[target_bit - 1] - 1) / 4 + 1;
   /* Read power traces and ciphertexts. Name of data file is argument #1. n is
    * the number of acquisitions to use. */
-  read_datafile (argv[1], n);
+  read_datafile (argv[optind], n);
+  if (win_first + win_length > tr_length (ctx)) { // If window out of the traces
+    ERROR (0, -1, "Invalid window: %d:%d (traces are %d points long)", win_first, win_length, tr_length (ctx));
+  }
 
   /*****************************************************************************
    * Compute and print average power trace. Store average trace in file
@@ -117,6 +385,44 @@ usage: pa FILE N [B]\n\
    *****************************************************************************/
   average ("average");
 
+  /*****************************************************************
+   * Locate the last round in the average power trace if requested *
+   * and restrict the attack to the window                         *
+   *****************************************************************/
+  if (locate && !locate_last_round ()) { // If last round not found
+    WARNING ("could not locate the last round, attacking whole traces");
+  }
+  tr_free_trace (ctx, avg_trace);
+  if (win_length > 0) { // If attack window
+    tr_trim (ctx, win_first, win_length);
+    fprintf (stderr, "Attack window: points %d to %d (reuse with -w %d:%d)\n", win_first, win_first + win_length - 1,
+             win_first, win_length);
+  }
+
+  if (all_sboxes) { // If all-SBoxes DPA
+    /**************************************************************
+     * Attack all 32 bits of L15=R14 in a single pass, print the  *
+     * scores matrix and the combined DPA traces of best guesses, *
+     * search the secret key                                      *
+     **************************************************************/
+    dpa_attack_all ();
+    tr_plot (ctx, "dpa", 8, -1, sbox_dpa);
+    print_scores ("scores");
+    fprintf (stderr, "Combined DPA traces of best guesses stored in file 'dpa.dat'.\n");
+    fprintf (stderr, "Scores stored in file 'scores.dat'.\n");
+    fprintf (stderr, "Best last round key (hex): 0x%012" PRIx64 "\n", rk);
+    key_rank ();
+    search_key ();
+    for (s = 0; s < 8; s++) { // For all SBoxes
+      tr_free_trace (ctx, sbox_dpa[s]);
+    }
+    tr_free (ctx);
+    pool_stop ();
+    fprintf (stderr, "Last round key (hex):\n");
+    printf ("0x%012" PRIx64 "\n", rk);
+    return 0;
+  }
+
   /***************************************************************
    * Attack target bit in L15=R14 with P. Kocher's DPA technique *
    ***************************************************************/
@@ -140,7 +446,14 @@ usage: pa FILE N [B]\n\
   fprintf (stderr, "Target SBox: %d\n", target_sbox);
   fprintf (stderr, "Best guess: %d (0x%02x)\n", best_guess, best_guess);
   fprintf (stderr, "Maximum of DPA trace: %e\n", best_max);
-  fprintf (stderr, "Index of maximum in DPA trace: %d\n", best_idx);
+  fprintf (stderr, "Index of maximum in DPA trace: %d\n", win_first + best_idx);
+  subkey_rank ();
+
+  /**************************************************
+   * Recover the secret key from the last round key *
+   **************************************************/
+  rk = UINT64_C(0x0123456789ab); /* 0x0123456789ab last round key. */
+  recover_key (rk);
 
   /*************************
    * Free allocated traces *
@@ -149,11 +462,11 @@ usage: pa FILE N [B]\n\
     tr_free_trace (ctx, dpa[g]);
   }
   tr_free (ctx); // Free traces context
+  pool_stop (); // Stop the threads
 
   /********************************************
    * Print last round key to standard output. *
    ********************************************/
-  rk = UINT64_C(0x0123456789ab); /* 0x0123456789ab last round key. */
   fprintf(stderr, "Last round key (hex):\n");
   printf("0x%012" PRIx64 "\n", rk);
 
@@ -162,107 +475,490 @@ usage: pa FILE N [B]\n\
 
 void read_datafile (char *name, int n) {
   int tn;
+  tr_stream s;
 
-  ctx = tr_init (name, n);
-  tn = tr_number (ctx);
-  if (tn != n) {
-    tr_free (ctx);
+  s = tr_stream_open (name, 0, 1);
+  tn = tr_stream_number (s);
+  tr_stream_close (s);
+  if (tn < n) {
     ERROR (, -1, "Could not read %d acquisitions from traces file. Traces file contains %d acquisitions.", n, tn);
   }
+  datafile = name;
+  ntraces = n;
+  ctx = tr_init (name, n < 4 ? n : 4);
 }
 
 void average (char *prefix) {
-  int i;      // Loop index
-  int n;      // Number of traces.
-  float *sum; // Power trace for the sum
-  float *avg; // Power trace for the average
+  int i;         // Loop index
+  float *avg;    // Power trace for the average
+  pa_work *w;    // Work of the threads
+  tr_stream s;   // Stream of the datafile
+  tr_context b;  // Batch of traces
 
-  n = tr_number (ctx);                    // Number of traces in context
-  sum = tr_new_trace (ctx);               // Allocate a new power trace for the sum.
+  w = XCALLOC (threads, sizeof (pa_work));
+  slices (w);
+  for (i = 0; i < threads; i++) { // For all threads, accumulator of the per-point mean of slice
+    w[i].acc = w[i].v == NULL ? NULL : tr_stats_init (w[i].v);
+  }
+  s = tr_stream_open (datafile, ntraces, TR_STREAM_BATCH);
+  while (tr_stream_next (s, &b)) {        // For all batches
+    for (i = 0; i < threads; i++) {
+      w[i].b = b;
+    }
+    run_threads (average_worker, w);      // Accumulate the power traces of batch
+  }                                       // End for all batches
+  tr_stream_close (s);
   avg = tr_new_trace (ctx);               // Allocate a new power trace for the average.
-  tr_init_trace (ctx, sum, 0.0);          // Initialize sum trace to all zeros.
-  for (i = 0; i < n; i++) {               // For all power traces
-    tr_acc (ctx, sum, tr_trace (ctx, i)); // Accumulate trace #i to sum
-  }                                       // End for all power traces
-  // Divide trace sum by number of traces and put result in trace avg
-  tr_scalar_div (ctx, avg, sum, (float) (n));
+  for (i = 0; i < threads; i++) {         // For all slices, put the average in trace avg
+    if (w[i].v != NULL) {
+      tr_stats_mean (w[i].acc, avg + w[i].lo);
+      tr_stats_free (w[i].acc);           // Free accumulator
+    }
+  }
   tr_plot (ctx, prefix, 1, -1, &avg);
   fprintf (stderr, "Average power trace stored in file '%s.dat'.\n", prefix);
-  tr_free_trace (ctx, sum); // Free sum trace
-  tr_free_trace (ctx, avg); // Free avg trace
+  avg_trace = avg;          // Keep avg trace
+  free_slices (w);
+  free (w);
+}
+
+int locate_last_round (void) {
+  int i, k;         // Loop indices
+  int l;            // Number of points per trace
+  int lag;          // Maximum lag of the autocorrelation: at least 17 clock cycles
+  int p;            // Clock period, in points
+  int phase;        // Index of first clock peak
+  int n;            // Number of clock cycles
+  int last;         // Last cycle of the 16 rounds
+  int lo, hi;       // Search interval of a clock peak
+  int *peak;        // Indices of the clock peaks
+  float *a;         // Average power trace
+  double m;         // Mean of the average power trace
+  double *ac;       // Autocorrelation of the average power trace, by lag
+  double rmax;      // Maximum autocorrelation, beyond the central lobe
+  double sum, best; // Sums of clock peaks
+
+  a = avg_trace;
+  l = tr_length (ctx);
+  lag = l / 17;
+  if (lag < 2) { // If traces too short
+    return 0;
+  }
+  for (i = 0, m = 0.0; i < l; i++) {
+    m += a[i];
+  }
+  m /= l;
+  ac = XCALLOC (lag + 1, sizeof (double));
+  for (k = 0; k <= lag; k++) { // For all lags
+    for (i = 0, sum = 0.0; i + k < l; i++) {
+      sum += (a[i] - m) * (a[i + k] - m);
+    }
+    ac[k] = sum / (l - k);
+  }
+  /* Clock period: beyond the central lobe (first negative autocorrelation),
+   * the first local maximum within 10% of the highest autocorrelation. */
+  for (k = 1; k <= lag && ac[k] >= 0.0; k++);
+  for (i = k, rmax = 0.0; i <= lag; i++) {
+    rmax = ac[i] > rmax ? ac[i] : rmax;
+  }
+  if (k > lag || ac[0] <= 0.0 || rmax < 0.2 * ac[0]) { // If no clear clock
+    free (ac);
+    return 0;
+  }
+  for (p = k; ac[p] < 0.9 * rmax; p++);
+  for (; p < lag && ac[p + 1] > ac[p]; p++);
+  free (ac);
+  // Phase of the clock peaks: the one with the highest sum of peaks
+  phase = 0;
+  for (i = 0, best = 0.0; i < p; i++) {
+    for (k = i, sum = 0.0; k < l; k += p) {
+      sum += a[k];
+    }
+    if (sum > best || i == 0) {
+      best = sum;
+      phase = i;
+    }
+  }
+  // Clock peaks: one per period, at the maximum around its expected position
+  peak = XCALLOC (l / p + 1, sizeof (int));
+  for (k = phase, n = 0; k < l; k += p, n++) {
+    lo = k - p / 4 > 0 ? k - p / 4 : 0;
+    hi = k + p / 4 < l - 1 ? k + p / 4 : l - 1;
+    for (i = lo, peak[n] = lo; i <= hi; i++) {
+      peak[n] = a[i] > a[peak[n]] ? i : peak[n];
+    }
+  }
+  if (n < 16) { // If less than 16 cycles
+    free (peak);
+    return 0;
+  }
+  // The 16 rounds: the 16 consecutive cycles with the highest peaks
+  last = 15;
+  for (k = 0, best = 0.0; k + 16 <= n; k++) {
+    for (i = k, sum = 0.0; i < k + 16; i++) {
+      sum += a[peak[i]];
+    }
+    if (sum > best || k == 0) {
+      best = sum;
+      last = k + 15;
+    }
+  }
+  win_first = peak[last] - p > 0 ? peak[last] - p : 0;
+  win_length = (peak[last] + 2 * p < l ? peak[last] + 2 * p : l) - win_first;
+  fprintf (stderr, "Clock period: %d points, %d clock cycles, last round: cycle %d (peak at point %d)\n", p, n, last, peak[last]);
+  free (peak);
+  return 1;
+}
+
+void pool_start (void) {
+  int i; // Thread index
+
+  pthread_mutex_init (&pool.lock, NULL);
+  pthread_cond_init (&pool.go, NULL);
+  pthread_cond_init (&pool.done, NULL);
+  pool.gen = 0;
+  pool.busy = 0;
+  pool.tid = XCALLOC (threads, sizeof (pthread_t));
+  for (i = 1; i < threads; i++) {
+    if (pthread_create (pool.tid + i, NULL, pool_worker, (void *) (intptr_t) i) != 0) {
+      ERROR (, -1, "cannot create thread #%d", i);
+    }
+  }
+}
+
+void pool_stop (void) {
+  int i; // Thread index
+
+  pthread_mutex_lock (&pool.lock);
+  pool.job = NULL;
+  pool.gen += 1;
+  pthread_cond_broadcast (&pool.go);
+  pthread_mutex_unlock (&pool.lock);
+  for (i = 1; i < threads; i++) {
+    pthread_join (pool.tid[i], NULL);
+  }
+  free (pool.tid);
+  pthread_cond_destroy (&pool.done);
+  pthread_cond_destroy (&pool.go);
+  pthread_mutex_destroy (&pool.lock);
+}
+
+void *pool_worker (void *arg) {
+  int id;                // Index of thread
+  int gen;               // Number of jobs seen
+  void *(*job) (void *); // Current job
+  pa_work *w;            // Work of the threads for the current job
+
+  id = (int) (intptr_t) arg;
+  gen = 0;
+  while (1) { // For all jobs
+    pthread_mutex_lock (&pool.lock);
+    while (pool.gen == gen) { // Wait for the next job
+      pthread_cond_wait (&pool.go, &pool.lock);
+    }
+    gen = pool.gen;
+    job = pool.job;
+    w = pool.w;
+    pthread_mutex_unlock (&pool.lock);
+    if (job == NULL) { // If pool stopped
+      return NULL;
+    }
+    job (w + id);
+    pthread_mutex_lock (&pool.lock);
+    pool.busy -= 1;
+    if (pool.busy == 0) { // If last worker to complete the job
+      pthread_cond_signal (&pool.done);
+    }
+    pthread_mutex_unlock (&pool.lock);
+  }
 }
 
-void decision (uint64_t ct, int d[64]) {
+void run_threads (void *(*worker) (void *), pa_work *w) {
+  pthread_mutex_lock (&pool.lock);
+  pool.job = worker;
+  pool.w = w;
+  pool.busy = threads - 1;
+  pool.gen += 1;
+  pthread_cond_broadcast (&pool.go);
+  pthread_mutex_unlock (&pool.lock);
+  worker (w); // Thread 0 is the calling thread
+  pthread_mutex_lock (&pool.lock);
+  while (pool.busy > 0) { // Wait for the workers
+    pthread_cond_wait (&pool.done, &pool.lock);
+  }
+  pthread_mutex_unlock (&pool.lock);
+}
+
+void slices (pa_work *w) {
+  int i;      // Thread index
+  int l;      // Number of points per trace
+  int u;      // Number of blocks of PA_COLUMNS points
+  int lo, hi; // Slice of thread: points lo to hi - 1
+
+  l = tr_length (ctx);
+  u = (l + PA_COLUMNS - 1) / PA_COLUMNS;
+  for (i = 0, hi = 0; i < threads; i++) { // For all threads
+    lo = hi;
+    hi = lo + (u / threads + (i < u % threads)) * PA_COLUMNS;
+    hi = hi < l ? hi : l;
+    w[i].id = i;
+    w[i].lo = lo;
+    w[i].v = hi > lo ? tr_view (ctx, 0, tr_number (ctx), lo, hi - lo) : NULL;
+  }
+}
+
+void free_slices (pa_work *w) {
+  int i; // Thread index
+
+  for (i = 0; i < threads; i++) {
+    if (w[i].v != NULL) {
+      tr_free (w[i].v);
+    }
+  }
+}
+
+void *average_worker (void *arg) {
+  int i;       // Loop index
+  pa_work *w;  // Work of thread
+
+  w = arg;
+  if (w->v == NULL) { // If empty slice
+    return NULL;
+  }
+  for (i = 0; i < tr_number (w->b); i++) { // For all traces of batch
+    tr_stats_add (w->acc, tr_trace (w->b, i) + w->lo);
+  }
+  return NULL;
+}
+
+void precompute (tr_context b, uint64_t *r16, uint64_t *er15) {
+  int i;        // Loop index
+  int n;        // Number of traces.
+  uint64_t *ct; // Ciphertexts, then R16|L16, then L16
+
+  n = tr_number (b);
+  ct = XCALLOC (n, sizeof (uint64_t));
+  for (i = 0; i < n; i++) {
+    ct[i] = tr_ciphertext (b, i);
+  }
+  des_ip_n (ct, ct, n);          // Compute R16|L16
+  des_left_half_n (ct, r16, n);  // Extract left half
+  des_right_half_n (ct, ct, n);  // Extract right half
+  des_e_n (ct, er15, n);         // Compute E(R15) = E(L16)
+  free (ct);
+}
+
+void decision (uint64_t r16, uint64_t er15, int d[64]) {
   int g;           // Guess
-  uint64_t r16l16; // R16|L16 (64 bits state register before final permutation)
-  uint64_t l16;    // L16 (as in DES standard)
-  uint64_t r16;    // R16 (as in DES standard)
-  uint64_t er15;   // E(R15) = E(L16)
   uint64_t l15;    // L15 (as in DES standard)
   uint64_t rk;     // Value of last round key
 
-  r16l16 = des_ip (ct);          // Compute R16|L16
-  l16 = des_right_half (r16l16); // Extract right half
-  r16 = des_left_half (r16l16);  // Extract left half
-  er15 = des_e (l16);            // Compute E(R15) = E(L16)
   /* For all guesses (64). rk is a 48 bits last round key with all 6-bits
    * subkeys equal to current guess g (nice trick, isn't it?). */
   for (g = 0, rk = UINT64_C (0); g < 64; g++, rk += UINT64_C (0x041041041041)) {
-    l15 = r16 ^ des_p (des_sboxes (er15 ^ rk));       // Compute L15
+    l15 = r16 ^ des_sp_fast (er15 ^ rk);               // Compute L15
     d[g] = (l15 >> (32 - target_bit)) & UINT64_C (1); // Extract value of target bit
   } // End for guesses
 }
 
-void dpa_attack (void) {
-  int i;         // Loop index
-  int n;         // Number of traces.
-  int g;         // Guess on a 6-bits subkey
-  int idx;       // Argmax (index of sample with maximum value in a trace)
-  int d[64];     // Decisions on the target bit
+int partition (uint64_t r16, uint64_t er15) {
+  return (int) (((r16 >> (32 - target_bit)) & UINT64_C (1)) << 6 | ((er15 >> (48 - 6 * target_sbox)) & UINT64_C (0x3f)));
+}
 
-  float *t;      // Power trace
-  float max;     // Max sample value in a trace
-  float *t0[64]; // Power traces for the zero-sets (one per guess)
-  float *t1[64]; // Power traces for the one-sets (one per guess)
+void class_decision (int c, int d[64]) {
+  /* A representative of class c: all bits of R16 and E(L16) are zero, but the
+   * ones that define the class. */
+  decision ((uint64_t) (c >> 6) << (32 - target_bit), (uint64_t) (c & 0x3f) << (48 - 6 * target_sbox), d);
+}
+
+int partition_check (int m, uint64_t *r16, uint64_t *er15) {
+  int i;     // Loop index
+  int d[64]; // Decisions on the target bit
+  int e[64]; // Decisions on the target bit, for the class of the ciphertext
 
-  int n0[64];    // Number of power traces in the zero-sets (one per guess)
-  int n1[64];    // Number of power traces in the one-sets (one per guess)
+  for (i = 0; i < m; i++) { // For all ciphertexts
+    decision (r16[i], er15[i], d);
+    class_decision (partition (r16[i], er15[i]), e);
+    if (memcmp (d, e, sizeof (d)) != 0) { // If the decision function depends on other bits
+      return 0;
+    }
+  }
+  return 1;
+}
 
-  uint64_t ct;   // Ciphertext
+void class_sets (tr_context v, int dc[128][64], float *sc[128], int nc[128], float *t0[64], int n0[64], float *t1[64],
+                 int n1[64]) {
+  int c;     // Class
+  int g;     // Guess on a 6-bits subkey
 
-  for (g = 0; g < 64; g++) { // For all guesses for 6-bits subkey
-    dpa[g] = tr_new_trace (ctx);     // Allocate a DPA trace
-    t0[g] = tr_new_trace (ctx);      // Allocate a trace for zero-set
-    tr_init_trace (ctx, t0[g], 0.0); // Initialize trace to all zeros
-    n0[g] = 0;                       // Initialize trace count in zero-set to zero
-    t1[g] = tr_new_trace (ctx);      // Allocate a trace for one-set
-    tr_init_trace (ctx, t1[g], 0.0); // Initialize trace to all zeros
-    n1[g] = 0;                       // Initialize trace count in one-set to zero
-  } // End for all guesses
-  n = tr_number (ctx);          // Number of traces in context
-  for (i = 0; i < n; i++) { // For all acquisitions
-    t = tr_trace (ctx, i);       // Get power trace
-    ct = tr_ciphertext (ctx, i); // Get ciphertext
-    decision (ct, d);            // Compute the 64 decisions
+  for (c = 0; c < 128; c++) { // For all classes
+    if (nc[c] == 0) { // If empty class
+      continue;
+    }
     for (g = 0; g < 64; g++) { // For all guesses (64)
-      if (d[g] == 0) { // If decision on target bit is zero
-        tr_acc (ctx, t0[g], t); // Accumulate power trace in zero-set
-        n0[g] += 1;             // Increment traces count for zero-set
+      if (dc[c][g] == 0) { // If decision on target bit is zero
+        tr_acc (v, t0[g], sc[c]); // Accumulate class sum in zero-set
+        n0[g] += nc[c];
       }
       else { // If decision on target bit is one
-        tr_acc (ctx, t1[g], t);   // Accumulate power trace in one-set
-        n1[g] += 1;       // Increment traces count for one-set
+        tr_acc (v, t1[g], sc[c]); // Accumulate class sum in one-set
+        n1[g] += nc[c];
       }
     } // End for guesses
-  } // End for acquisitions
+  } // End for all classes
+}
+
+void class_decisions (int dc[128][64]) {
+  int c; // Class
+
+  for (c = 0; c < 128; c++) { // For all classes
+    class_decision (c, dc[c]);
+  }
+}
+
+void key_rank (void) {
+  uint64_t ks[16]; // Key schedule of the true secret key
+  double lo, hi;   // Bounds of the rank
+
+  des_ks (ks, tr_key (ctx));
+  ke_rank (scores, ks[15], 0, &lo, &hi);
+  fprintf (stderr, "Rank of true last round key: %.0f to %.0f (log2: %.1f to %.1f)\n", lo, hi, log2 (lo), log2 (hi));
+}
+
+void subkey_rank (void) {
+  uint64_t ks[16]; // Key schedule of the true secret key
+  int sk;          // True 6-bits subkey of the target SBox
+  int g;           // Guess
+  int r;           // Rank
+
+  des_ks (ks, tr_key (ctx));
+  sk = (int) ((ks[15] >> (48 - 6 * target_sbox)) & UINT64_C (0x3f));
+  r = 1;
+  for (g = 0; g < 64; g++) { // For all guesses, count the better ones
+    if (scores[target_sbox - 1][g] > scores[target_sbox - 1][sk]) {
+      r += 1;
+    }
+  }
+  fprintf (stderr, "Rank of true subkey 0x%02x of SBox %d: %d of 64\n", sk, target_sbox, r);
+}
+
+void recover_key (uint64_t k16) {
+  int i;          // Loop index
+  int n;          // Number of known pairs
+  uint64_t pt[4]; // Known plaintexts
+  uint64_t ct[4]; // Known ciphertexts
+  uint64_t key;   // Secret key
+
+  n = tr_number (ctx) < 4 ? tr_number (ctx) : 4;
+  for (i = 0; i < n; i++) {
+    pt[i] = tr_plaintext (ctx, i);
+    ct[i] = tr_ciphertext (ctx, i);
+  }
+  if (des_recover_key (k16, pt, ct, n, &key)) {
+    fprintf (stderr, "Secret key (hex): 0x%016" PRIx64 "\n", key);
+  }
+  else {
+    fprintf (stderr, "Secret key not found: wrong last round key?\n");
+  }
+}
+
+void dpa_attack (void) {
+  int i;          // Loop index
+  int m;          // Number of traces in batch.
+  int g;          // Guess on a 6-bits subkey
+  int first;      // Index of first trace of batch
+  int idx;        // Argmax (index of sample with maximum value in a trace)
+  int dc[128][64]; // Decisions of the classes (partitioned DPA)
+  float max;      // Max sample value in a trace
+  float *t0[64];  // Power traces for the zero-sets (one per guess)
+  float *t1[64];  // Power traces for the one-sets (one per guess)
+  int n0[64];     // Number of power traces in the zero-sets (one per guess)
+  int n1[64];     // Number of power traces in the one-sets (one per guess)
+
+  dpa_state *st;   // State of the attack, shared by the threads
+  pa_work *w;      // Work of the threads
+  uint64_t *r16;   // R16 of the ciphertexts of a batch
+  uint64_t *er15;  // E(R15) = E(L16) of the ciphertexts of a batch
+  tr_stream s;     // Stream of the datafile
+  tr_context b;    // Batch of traces
+
+  st = XCALLOC (1, sizeof (dpa_state));
+  r16 = XCALLOC (TR_STREAM_BATCH, sizeof (uint64_t));
+  er15 = XCALLOC (TR_STREAM_BATCH, sizeof (uint64_t));
+  w = XCALLOC (threads, sizeof (pa_work));
+  slices (w);
+  for (i = 0; i < threads; i++) { // For all threads
+    w[i].r16 = r16;
+    w[i].er15 = er15;
+    w[i].acc = st;
+  }
+  s = tr_stream_open (datafile, ntraces, TR_STREAM_BATCH);
+  if (win_length > 0) { // If attack window, read its points only
+    tr_stream_window (s, win_first, win_length);
+  }
+  first = 0;
+  while ((m = tr_stream_next (s, &b))) { // For all batches
+    precompute (b, r16, er15);
+    if (partitioned && first == 0 && !partition_check (m, r16, er15)) { // If the decision function depends on other bits
+      WARNING ("decision function does not depend on class only, switching to generic DPA");
+      partitioned = 0;
+    }
+    if (first == 0) { // If first batch, allocate the accumulators
+      for (g = 0; partitioned && g < 128; g++) {
+        st->sc[g] = tr_new_trace (ctx);
+        tr_init_trace (ctx, st->sc[g], 0.0);
+      }
+      for (g = 0; !partitioned && g < 64; g++) {
+        st->t0[g] = tr_new_trace (ctx);
+        tr_init_trace (ctx, st->t0[g], 0.0);
+        st->t1[g] = tr_new_trace (ctx);
+        tr_init_trace (ctx, st->t1[g], 0.0);
+      }
+      if (!partitioned) {
+        st->d = XCALLOC (TR_STREAM_BATCH, sizeof (int[64]));
+      }
+    }
+    for (i = 0; i < threads; i++) {
+      w[i].b = b;
+    }
+    if (!partitioned) { // If generic DPA, compute the decisions of the traces of batch
+      run_threads (dpa_decide, w);
+    }
+    run_threads (dpa_worker, w); // Accumulate the power traces of batch
+    first += m;
+  } // End for batches
+  tr_stream_close (s);
+  if (partitioned) { // If partitioned DPA, build the zero- and one-sets from the class sums
+    for (g = 0; g < 64; g++) { // For all guesses for 6-bits subkey
+      t0[g] = tr_new_trace (ctx);      // Allocate a trace for zero-set
+      tr_init_trace (ctx, t0[g], 0.0); // Initialize trace to all zeros
+      n0[g] = 0;                       // Initialize trace count in zero-set to zero
+      t1[g] = tr_new_trace (ctx);      // Allocate a trace for one-set
+      tr_init_trace (ctx, t1[g], 0.0); // Initialize trace to all zeros
+      n1[g] = 0;                       // Initialize trace count in one-set to zero
+    } // End for all guesses
+    class_decisions (dc);
+    class_sets (ctx, dc, st->sc, st->nc, t0, n0, t1, n1);
+    for (i = 0; i < 128; i++) { // For all classes
+      tr_free_trace (ctx, st->sc[i]);
+    }
+  }
+  else { // Generic DPA: zero- and one-sets of the pass
+    for (g = 0; g < 64; g++) {
+      t0[g] = st->t0[g];
+      n0[g] = st->n0[g];
+      t1[g] = st->t1[g];
+      n1[g] = st->n1[g];
+    }
+  }
   best_guess = 0; // Initialize best guess
   best_max = 0.0; // Initialize best maximum sample
   best_idx = 0;   // Initialize best argmax (index of maximum sample)
   for (g = 0; g < 64; g++) { // For all guesses for 6-bits subkey
-    tr_scalar_div (ctx, t0[g], t0[g], (float) (n0[g])); // Normalize zero-set
-    tr_scalar_div (ctx, t1[g], t1[g], (float) (n1[g])); // Normalize one-set
-    tr_sub (ctx, dpa[g], t1[g], t0[g]);                 // Compute one-set minus zero-set
-    max = tr_max (ctx, dpa[g], &idx);                   // Get max and argmax of DPA trace
+    dpa[g] = tr_new_trace (ctx); // Allocate a DPA trace
+    // One-set average minus zero-set average, and its max and argmax, in one pass
+    max = tr_diff_of_means (ctx, dpa[g], t1[g], n1[g], t0[g], n0[g], &idx);
+    scores[target_sbox - 1][g] = max;                   // Score of guess
     if (max > best_max || g == 0) { // If better than current best max (or if first guess)
       best_max = max; // Overwrite best max with new one
       best_idx = idx; // Overwrite best argmax with new one
@@ -274,4 +970,319 @@ void dpa_attack (void) {
     tr_free_trace (ctx, t0[g]);
     tr_free_trace (ctx, t1[g]);
   }
+  free_slices (w);
+  free (st->d);
+  free (st);
+  free (w);
+  free (r16);
+  free (er15);
+}
+
+void *dpa_decide (void *arg) {
+  int k;         // Index of trace in batch
+  int m;         // Number of traces in batch
+  pa_work *w;    // Work of thread
+  dpa_state *st; // State of the attack
+
+  w = arg;
+  st = w->acc;
+  m = tr_number (w->b);
+  for (k = m * w->id / threads; k < m * (w->id + 1) / threads; k++) { // For all traces of the share of thread
+    decision (w->r16[k], w->er15[k], st->d[k]); // Compute the 64 decisions
+  }
+  return NULL;
+}
+
+void *dpa_worker (void *arg) {
+  int k;         // Index of trace in batch
+  int g;         // Guess on a 6-bits subkey
+  int c;         // Class of a ciphertext (partitioned DPA)
+  float *t;      // Slice of power trace
+  pa_work *w;    // Work of thread
+  dpa_state *st; // State of the attack
+
+  w = arg;
+  st = w->acc;
+  if (w->v == NULL) { // If empty slice
+    return NULL;
+  }
+  for (k = 0; k < tr_number (w->b); k++) { // For all acquisitions of batch
+    t = tr_trace (w->b, k) + w->lo; // Get slice of power trace
+    if (partitioned) { // If partitioned DPA
+      c = partition (w->r16[k], w->er15[k]);  // Compute class of ciphertext
+      tr_acc (w->v, st->sc[c] + w->lo, t);    // Accumulate power trace in class sum
+      if (w->id == 0) { // Increment traces count of class
+        st->nc[c] += 1;
+      }
+      continue;
+    }
+    for (g = 0; g < 64; g++) { // For all guesses (64)
+      if (st->d[k][g] == 0) { // If decision on target bit is zero
+        tr_acc (w->v, st->t0[g] + w->lo, t); // Accumulate power trace in zero-set
+        if (w->id == 0) { // Increment traces count for zero-set
+          st->n0[g] += 1;
+        }
+      }
+      else { // If decision on target bit is one
+        tr_acc (w->v, st->t1[g] + w->lo, t); // Accumulate power trace in one-set
+        if (w->id == 0) { // Increment traces count for one-set
+          st->n1[g] += 1;
+        }
+      }
+    } // End for guesses
+  } // End for acquisitions of batch
+  return NULL;
+}
+
+void dpa_attack_all (void) {
+  int i;          // Loop index
+  int m;          // Number of traces in batch.
+  int j;          // Index of bit in L15 (1 to 32)
+  int sb;         // SBox index (0 to 7)
+  int c;          // Class of a ciphertext for an SBox (0 to 1023)
+  int g;          // Guess on a 6-bits subkey
+  int first;      // Index of first trace of batch
+  int idx;        // Argmax (index of sample with maximum value in a trace)
+  int best;       // Best guess on current SBox
+  int best_i;     // Argmax of the combined DPA trace of best guess
+  float max;      // Max sample value in a trace
+  float best_m;   // Max sample value of the combined DPA trace of best guess
+
+  dpa_all_state *st; // State of the attack, shared by the threads
+  pa_work *w;     // Work of the threads
+  uint64_t *r16;  // R16 of the ciphertexts of a batch
+  uint64_t *pr16; // P^-1(R16) of the ciphertexts of a batch: SBox-aligned R16
+  uint64_t *er15; // E(R15) = E(L16) of the ciphertexts of a batch
+  tr_stream s;    // Stream of the datafile
+  tr_context b;   // Batch of traces
+
+  st = XCALLOC (1, sizeof (dpa_all_state));
+  for (sb = 0; sb < 8; sb++) { // For all SBoxes
+    for (c = 0; c < 1024; c++) { // For all classes
+      st->sc[sb][c] = tr_new_trace (ctx);      // Allocate a trace for the class
+      tr_init_trace (ctx, st->sc[sb][c], 0.0); // Initialize trace to all zeros
+    }
+  }
+  r16 = XCALLOC (TR_STREAM_BATCH, sizeof (uint64_t));
+  pr16 = XCALLOC (TR_STREAM_BATCH, sizeof (uint64_t));
+  er15 = XCALLOC (TR_STREAM_BATCH, sizeof (uint64_t));
+  w = XCALLOC (threads, sizeof (pa_work));
+  slices (w);
+  for (i = 0; i < threads; i++) { // For all threads
+    w[i].pr16 = pr16;
+    w[i].er15 = er15;
+    w[i].acc = st;
+  }
+  s = tr_stream_open (datafile, ntraces, TR_STREAM_BATCH);
+  if (win_length > 0) { // If attack window, read its points only
+    tr_stream_window (s, win_first, win_length);
+  }
+  first = 0;
+  while ((m = tr_stream_next (s, &b))) { // For all batches
+    precompute (b, r16, er15);
+    for (j = 1; first == 0 && j <= 32; j++) { // For all bits of L15, on first batch
+      target_bit = j;
+      target_sbox = (p_table[j - 1] - 1) / 4 + 1;
+      if (!partition_check (m, r16, er15)) { // If the decision function depends on other bits
+        ERROR (, -1, "decision function does not depend on class only: all-SBoxes DPA needs partitioned DPA");
+      }
+      class_decisions (st->dc[j - 1]);
+    }
+    des_n_p_n (r16, pr16, m); // Align the bits of R16 with the outputs of the SBoxes
+    for (i = 0; i < threads; i++) {
+      w[i].b = b;
+    }
+    run_threads (dpa_all_worker, w); // Accumulate the power traces of batch
+    first += m;
+  } // End for batches
+  tr_stream_close (s);
+  for (sb = 0; sb < 8; sb++) { // For all SBoxes
+    for (g = 0; g < 64; g++) { // For all guesses
+      st->cd[sb][g] = tr_new_trace (ctx);
+      tr_init_trace (ctx, st->cd[sb][g], 0.0);
+    }
+  }
+  run_threads (dpa_all_combine, w); // Compute the combined DPA traces of all SBoxes
+  rk = UINT64_C (0);
+  for (sb = 0; sb < 8; sb++) { // For all SBoxes
+    best = 0;
+    best_m = 0.0;
+    best_i = 0;
+    for (g = 0; g < 64; g++) { // For all guesses
+      max = tr_max (ctx, st->cd[sb][g], &idx);
+      scores[sb][g] = max;
+      if (max > best_m || g == 0) { // If better than current best max (or if first guess)
+        best_m = max;
+        best_i = idx;
+        best = g;
+      }
+    }
+    sbox_dpa[sb] = tr_new_trace (ctx);
+    tr_copy (ctx, sbox_dpa[sb], st->cd[sb][best]);
+    rk |= (uint64_t) (best) << (42 - 6 * sb);
+    fprintf (stderr, "SBox %d: best guess %d (0x%02x), maximum of combined DPA trace %e at index %d\n", sb + 1,
+             best, best, best_m, win_first + best_i);
+    for (g = 0; g < 64; g++) { // Free combined DPA traces of SBox
+      tr_free_trace (ctx, st->cd[sb][g]);
+    }
+    for (c = 0; c < 1024; c++) { // Free class sums of SBox
+      tr_free_trace (ctx, st->sc[sb][c]);
+    }
+  }
+  free_slices (w);
+  free (st);
+  free (w);
+  free (r16);
+  free (pr16);
+  free (er15);
+}
+
+void *dpa_all_worker (void *arg) {
+  int i;             // Loop index
+  int sb;            // SBox index (0 to 7)
+  int c;             // Class of a ciphertext for an SBox (0 to 1023)
+  float *t;          // Slice of power trace
+  pa_work *w;        // Work of thread
+  dpa_all_state *st; // State of the attack
+
+  w = arg;
+  st = w->acc;
+  if (w->v == NULL) { // If empty slice
+    return NULL;
+  }
+  for (sb = 0; sb < 8; sb++) { // For all SBoxes: the class sums of one SBox at a time stay in cache
+    for (i = 0; i < tr_number (w->b); i++) { // For all acquisitions of batch
+      t = tr_trace (w->b, i) + w->lo; // Get slice of power trace
+      c = (int) (((w->pr16[i] >> (28 - 4 * sb)) & UINT64_C (0xf)) << 6 | ((w->er15[i] >> (42 - 6 * sb)) & UINT64_C (0x3f)));
+      tr_acc (w->v, st->sc[sb][c] + w->lo, t); // Accumulate power trace in class sum
+      if (w->id == 0) { // Increment traces count of class
+        st->nc[sb][c] += 1;
+      }
+    }
+  }
+  return NULL;
+}
+
+void *dpa_all_combine (void *arg) {
+  int i;          // Loop index
+  int sb;         // SBox index (0 to 7)
+  int j;          // Index of bit in L15 (1 to 32)
+  int k;          // Index of corresponding output bit of SBox (0 to 3, leftmost first)
+  int c;          // Class of a ciphertext for an SBox (0 to 1023)
+  int g;          // Guess on a 6-bits subkey
+  int idx;        // Argmax (index of sample with maximum value in a trace)
+  float *sc[1024]; // Slices of the class sums of current SBox
+  float *bc[128]; // Sums of the power traces of the classes of current bit (see partition)
+  float *t0[64];  // Power traces for the zero-sets (one per guess)
+  float *t1[64];  // Power traces for the one-sets (one per guess)
+  float *d;       // DPA trace of current bit and guess
+  int nb[128];    // Number of power traces in the classes of current bit
+  int n0[64];     // Number of power traces in the zero-sets (one per guess)
+  int n1[64];     // Number of power traces in the one-sets (one per guess)
+
+  pa_work *w;        // Work of thread
+  dpa_all_state *st; // State of the attack
+
+  w = arg;
+  st = w->acc;
+  if (w->v == NULL) { // If empty slice
+    return NULL;
+  }
+  // The traces of the thread are slices of traces
+  for (c = 0; c < 128; c++) { // For all classes of a bit
+    bc[c] = tr_new_trace (w->v);
+  }
+  for (g = 0; g < 64; g++) { // For all guesses for 6-bits subkey
+    t0[g] = tr_new_trace (w->v);
+    t1[g] = tr_new_trace (w->v);
+  }
+  d = tr_new_trace (w->v);
+  for (sb = 0; sb < 8; sb++) { // For all SBoxes
+    for (c = 0; c < 1024; c++) {
+      sc[c] = st->sc[sb][c] + w->lo;
+    }
+    for (j = 1; j <= 32; j++) { // For all bits of L15
+      if ((p_table[j - 1] - 1) / 4 != sb) { // If bit is not an output of SBox
+        continue;
+      }
+      k = (p_table[j - 1] - 1) % 4;
+      // Merge the classes of SBox into the classes of bit (see partition)
+      for (c = 0; c < 128; c++) {
+        tr_init_trace (w->v, bc[c], 0.0);
+        nb[c] = 0;
+      }
+      for (c = 0; c < 1024; c++) {
+        i = (int) ((c >> (9 - k)) & 1) << 6 | (c & 0x3f);
+        tr_acc (w->v, bc[i], sc[c]);
+        nb[i] += st->nc[sb][c];
+      }
+      // DPA traces of bit, added to the combined DPA traces of SBox
+      for (g = 0; g < 64; g++) {
+        tr_init_trace (w->v, t0[g], 0.0);
+        tr_init_trace (w->v, t1[g], 0.0);
+        n0[g] = 0;
+        n1[g] = 0;
+      }
+      class_sets (w->v, st->dc[j - 1], bc, nb, t0, n0, t1, n1);
+      for (g = 0; g < 64; g++) {
+        tr_diff_of_means (w->v, d, t1[g], n1[g], t0[g], n0[g], &idx);
+        tr_acc (w->v, st->cd[sb][g] + w->lo, d);
+      }
+    } // End for all bits of L15
+  } // End for all SBoxes
+
+  // Free allocated traces
+  for (c = 0; c < 128; c++) {
+    tr_free_trace (w->v, bc[c]);
+  }
+  for (g = 0; g < 64; g++) {
+    tr_free_trace (w->v, t0[g]);
+    tr_free_trace (w->v, t1[g]);
+  }
+  tr_free_trace (w->v, d);
+  return NULL;
+}
+
+void print_scores (char *prefix) {
+  int s;      // SBox index
+  int g;      // Guess on a 6-bits subkey
+  char *name; // Name of file
+  FILE *fp;   // File
+
+  name = XCALLOC (strlen (prefix) + 5, 1);
+  sprintf (name, "%s.dat", prefix);
+  fp = XFOPEN (name, "w");
+  for (s = 0; s < 8; s++) { // For all SBoxes
+    for (g = 0; g < 64; g++) { // For all guesses
+      fprintf (fp, "%e%c", scores[s][g], g == 63 ? '\n' : ' ');
+    }
+  }
+  fclose (fp);
+  free (name);
+}
+
+void search_key (void) {
+  int i;            // Loop index
+  uint64_t pt[4];   // Known plaintexts
+  uint64_t ct[4];   // Known ciphertexts
+  uint64_t k16;     // Accepted last round key
+  int64_t r;        // Rank of accepted last round key
+  des_key_pairs p;  // Known pairs and recovered secret key
+
+  p.n = tr_number (ctx) < 4 ? tr_number (ctx) : 4;
+  for (i = 0; i < p.n; i++) {
+    pt[i] = tr_plaintext (ctx, i);
+    ct[i] = tr_ciphertext (ctx, i);
+  }
+  p.pt = pt;
+  p.ct = ct;
+  r = ke_search (scores, budget, threads, des_key_check, &p, &k16);
+  if (r >= 0) {
+    rk = k16;
+    fprintf (stderr, "Last round key found at rank %" PRId64 " of the enumeration\n", r + 1);
+    fprintf (stderr, "Secret key (hex): 0x%016" PRIx64 "\n", p.key);
+  }
+  else {
+    fprintf (stderr, "Secret key not found in the %" PRId64 " best last round keys\n", budget);
+  }
 }
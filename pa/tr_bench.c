@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) Telecom Paris
+ *
+ * This file must be used under the terms of the CeCILL. This source
+ * file is licensed as described in the file COPYING, which you should
+ * have received as part of this distribution. The terms are also
+ * available at:
+ * http://www.cecill.info/licences/Licence_CeCILL_V1.1-US.txt
+*/
+
+/* Per-call time of the arithmetic functions of the traces library with each
+ * backend, and check that all backends compute the same results, bit for bit.
+ * Usage: tr_bench [L...], where L is a number of points per trace (default:
+ * 800 and 20000). */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+
+#include "utils.h"
+#include "traces.h"
+
+/* Returns the current value of the monotonic clock, in seconds. */
+double now (void);
+
+/* Measures, checks and prints all kernels on traces of l points. */
+void bench (int l);
+
+/* The benchmarked functions, called on traces d, a and b. The functions that
+ * return a value store it in d[0] (add it, for the fused ones) and the index in
+ * d[1]. tr_acc_with_sqr() accumulates the squares in the scratch trace sq. */
+float *sq;
+void run_acc (tr_context ctx, float *d, float *a, float *b) { tr_acc (ctx, d, a); }
+void run_add (tr_context ctx, float *d, float *a, float *b) { tr_add (ctx, d, a, b); }
+void run_sub (tr_context ctx, float *d, float *a, float *b) { tr_sub (ctx, d, a, b); }
+void run_mul (tr_context ctx, float *d, float *a, float *b) { tr_mul (ctx, d, a, b); }
+void run_div (tr_context ctx, float *d, float *a, float *b) { tr_div (ctx, d, a, b); }
+void run_scalar_mul (tr_context ctx, float *d, float *a, float *b) { tr_scalar_mul (ctx, d, a, 3.0); }
+void run_scalar_div (tr_context ctx, float *d, float *a, float *b) { tr_scalar_div (ctx, d, a, 3.0); }
+void run_sqr (tr_context ctx, float *d, float *a, float *b) { tr_sqr (ctx, d, a); }
+void run_sqrt (tr_context ctx, float *d, float *a, float *b) { tr_sqrt (ctx, d, a); }
+void run_abs (tr_context ctx, float *d, float *a, float *b) { tr_abs (ctx, d, b); }
+void run_min (tr_context ctx, float *d, float *a, float *b) { int i; d[0] = tr_min (ctx, b, &i); d[1] = i; }
+void run_max (tr_context ctx, float *d, float *a, float *b) { int i; d[0] = tr_max (ctx, b, &i); d[1] = i; }
+void run_diff_of_means (tr_context ctx, float *d, float *a, float *b) { int i; float m; m = tr_diff_of_means (ctx, d, a, 3, b, 7, &i); d[0] += m; d[1] += i; }
+void run_sub_absmax (tr_context ctx, float *d, float *a, float *b) { int i; float m; m = tr_sub_absmax (ctx, d, a, b, &i); d[0] += m; d[1] += i; }
+void run_axpy (tr_context ctx, float *d, float *a, float *b) { tr_axpy (ctx, d, 0.5, b); }
+void run_acc_with_sqr (tr_context ctx, float *d, float *a, float *b) { tr_acc_with_sqr (ctx, d, sq, b); }
+
+struct {
+  char *name;
+  void (*f) (tr_context, float *, float *, float *);
+} kernels[16] = {
+  {"tr_acc", run_acc},
+  {"tr_add", run_add},
+  {"tr_sub", run_sub},
+  {"tr_mul", run_mul},
+  {"tr_div", run_div},
+  {"tr_scalar_mul", run_scalar_mul},
+  {"tr_scalar_div", run_scalar_div},
+  {"tr_sqr", run_sqr},
+  {"tr_sqrt", run_sqrt},
+  {"tr_abs", run_abs},
+  {"tr_min", run_min},
+  {"tr_max", run_max},
+  {"tr_diff_of_means", run_diff_of_means},
+  {"tr_sub_absmax", run_sub_absmax},
+  {"tr_axpy", run_axpy},
+  {"tr_acc_with_sqr", run_acc_with_sqr}
+};
+
+int backends[4] = { TR_BACKEND_SCALAR, TR_BACKEND_SSE, TR_BACKEND_AVX2, TR_BACKEND_AVX512 };
+char *names[4] = { "scalar", "sse", "avx2", "avx512" };
+int best; // Default backend
+
+int main (int argc, char **argv) {
+  int i, l;
+
+  best = tr_backend ();
+  fprintf (stderr, "Default backend: %s\n", names[best]);
+  if (argc == 1) {
+    bench (800);
+    bench (20000);
+  }
+  for (i = 1; i < argc; i++) {
+    l = atoi (argv[i]);
+    if (l < 1) {
+      ERROR (0, -1, "Invalid number of points: %d (shall be at least 1)", l);
+    }
+    bench (l);
+  }
+  tr_set_backend (best);
+  return 0;
+}
+
+double now (void) {
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (double) (ts.tv_sec) + (double) (ts.tv_nsec) * 1e-9;
+}
+
+void bench (int l) {
+  struct tr_context_s ctx;
+  float *a, *b, *d, *ref;
+  double t[4];
+  uint64_t x;
+  int i, j, k, r, reps;
+
+  memset (&ctx, 0, sizeof (ctx));
+  ctx.l = l;
+  a = tr_new_trace (&ctx);
+  b = tr_new_trace (&ctx);
+  d = tr_new_trace (&ctx);
+  ref = tr_new_trace (&ctx);
+  sq = tr_new_trace (&ctx);
+  /* Positive a (tr_sqrt), non-zero b of both signs (tr_div, tr_abs). */
+  for (i = 0, x = UINT64_C (0x9e3779b97f4a7c15); i < l; i++) {
+    x = x * UINT64_C (6364136223846793005) + UINT64_C (1442695040888963407);
+    a[i] = 1.0 + (float) (x >> 40) / (float) (UINT64_C (1) << 24);
+    b[i] = (x >> 39) & 1 ? a[i] - 0.5 : 0.5 - a[i];
+  }
+  reps = 200000000 / l + 1;
+  fprintf (stderr, "\n%-16s %10s %10s %10s %10s  speedup of %s (ns/call, L=%d)\n", "function", names[0], names[1], names[2], names[3], names[best], l);
+  for (k = 0; k < 16; k++) {
+    for (j = 0; j < 4; j++) {
+      t[j] = 0.0;
+      if (tr_set_backend (backends[j]) != backends[j]) {
+        continue;
+      }
+      tr_copy (&ctx, d, a);
+      kernels[k].f (&ctx, d, a, b);
+      if (j == 0) {
+        tr_copy (&ctx, ref, d);
+      }
+      else if (memcmp (ref, d, l * sizeof (float)) != 0) {
+        ERROR (, -1, "%s: %s and %s results differ", kernels[k].name, names[0], names[j]);
+      }
+      t[j] = now ();
+      for (r = 0; r < reps; r++) {
+        kernels[k].f (&ctx, d, a, b);
+      }
+      t[j] = (now () - t[j]) / reps * 1e9;
+    }
+    fprintf (stderr, "%-16s %10.1f %10.1f %10.1f %10.1f  x%.1f\n", kernels[k].name, t[0], t[1], t[2], t[3], t[0] / t[best]);
+  }
+  tr_free_trace (&ctx, a);
+  tr_free_trace (&ctx, b);
+  tr_free_trace (&ctx, d);
+  tr_free_trace (&ctx, ref);
+  tr_free_trace (&ctx, sq);
+}
@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) Telecom Paris
+ *
+ * This file must be used under the terms of the CeCILL. This source
+ * file is licensed as described in the file COPYING, which you should
+ * have received as part of this distribution. The terms are also
+ * available at:
+ * http://www.cecill.info/licences/Licence_CeCILL_V1.1-US.txt
+*/
+
+/* Converts a trace file in HWSec format (version 1 or 2) to version 2, with
+ * quantized and / or compressed samples, or back to version 1, out of core (see
+ * tr_convert() in traces.h). Prints the sizes of the two files and the largest
+ * difference between their points. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <sys/stat.h>
+
+#include "utils.h"
+#include "traces.h"
+
+/* Names of the sample types, in the order of the TR_SAMPLE_* values. */
+char *types[4] = { "int8", "int16", "fp16", "float32" };
+
+/* Returns the size of file name, in bytes. */
+long long file_size (char *name);
+
+int main (int argc, char **argv) {
+  int c, i, j, m, type, block, n;
+  float scale, offset, err, d;
+  char *end;
+  tr_stream in, out;
+  tr_context a, b;
+  float *x, *y;
+
+  type = TR_SAMPLE_FLOAT32;
+  scale = 0.0;
+  offset = 0.0;
+  block = TR_LZ_BLOCK;
+  n = 0;
+  while (optind <= argc && (c = getopt (argc, argv, "t:s:o:z:n:")) != -1) {
+    switch (c) {
+      case 't':
+        for (type = 0; type < 4 && strcmp (optarg, types[type]) != 0; type++);
+        if (type == 4 && strcmp (optarg, "v1") != 0) {
+          ERROR (0, -1, "Invalid sample type: %s", optarg);
+        }
+        break;
+      case 's':
+        scale = strtof (optarg, &end);
+        if (*optarg == '\0' || *end != '\0') {
+          ERROR (0, -1, "Invalid scale: %s", optarg);
+        }
+        break;
+      case 'o':
+        offset = strtof (optarg, &end);
+        if (*optarg == '\0' || *end != '\0') {
+          ERROR (0, -1, "Invalid offset: %s", optarg);
+        }
+        break;
+      case 'z':
+        block = atoi (optarg);
+        if (block < 0) {
+          ERROR (0, -1, "Invalid number of traces per block: %d", block);
+        }
+        break;
+      case 'n':
+        n = atoi (optarg);
+        if (n < 1) {
+          ERROR (0, -1, "Invalid number of traces: %d (shall be at least 1)", n);
+        }
+        break;
+      default:
+        optind = argc + 1;
+    }
+  }
+  if (optind != argc - 2) {
+    ERROR (0, -1, "\
+usage: tr_convert [-t TYPE] [-s SCALE] [-o OFFSET] [-z BLOCK] [-n N] IN OUT\n\
+  IN: name of the input traces file in HWSec format (version 1 or 2)\n\
+  OUT: name of the output traces file in HWSec format\n\
+  -t TYPE: sample type of OUT, int8, int16, fp16, float32 (default) or v1\n\
+     (version 1 format)\n\
+  -s SCALE: scale of the samples (default: automatic, from the extreme points)\n\
+  -o OFFSET: offset of the samples (default: 0, ignored if no SCALE)\n\
+  -z BLOCK: number of traces per compressed block, 0 for no compression\n\
+     (default: %d)\n\
+  -n N: number of traces to convert (default: all)\n", TR_LZ_BLOCK);
+  }
+  tr_convert (argv[optind], argv[optind + 1], n, type, scale, offset, block);
+  /* The two files are streamed side by side, by batches of the same size. */
+  in = tr_stream_open (argv[optind], n, 0);
+  out = tr_stream_open (argv[optind + 1], 0, 0);
+  err = 0.0;
+  while ((m = tr_stream_next (in, &a))) {
+    tr_stream_next (out, &b);
+    for (i = 0; i < m; i++) {
+      x = tr_trace (a, i);
+      y = tr_trace (b, i);
+      for (j = 0; j < tr_length (a); j++) {
+        d = fabsf (x[j] - y[j]);
+        err = d > err ? d : err;
+      }
+    }
+  }
+  fprintf (stderr, "%s: %lld bytes\n%s: %lld bytes (%s, x%.2f)\nLargest difference: %g\n",
+           argv[optind], file_size (argv[optind]), argv[optind + 1], file_size (argv[optind + 1]),
+           type == TR_VERSION1 ? "version 1" : types[type],
+           (double) file_size (argv[optind]) / file_size (argv[optind + 1]), err);
+  tr_stream_close (in);
+  tr_stream_close (out);
+  return 0;
+}
+
+long long file_size (char *name) {
+  struct stat st;
+
+  if (stat (name, &st) != 0) {
+    ERROR (0, -1, "cannot stat file %s", name);
+  }
+  return (long long) st.st_size;
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) Telecom Paris
+ *
+ * This file must be used under the terms of the CeCILL. This source
+ * file is licensed as described in the file COPYING, which you should
+ * have received as part of this distribution. The terms are also
+ * available at:
+ * http://www.cecill.info/licences/Licence_CeCILL_V1.1-US.txt
+*/
+
+/* Converts a trace file in HWSec format to the sample-major layout (see
+ * tr_transpose() in traces.h), out of core. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "utils.h"
+#include "traces.h"
+
+/* Names of the sample types, in the order of the TR_SAMPLE_* values. */
+char *types[4] = { "int8", "int16", "fp16", "float32" };
+
+int main (int argc, char **argv) {
+  int c, type;
+  float scale, offset;
+  char *end;
+
+  type = TR_SAMPLE_FLOAT32;
+  scale = 0.0;
+  offset = 0.0;
+  while (optind <= argc && (c = getopt (argc, argv, "t:s:o:")) != -1) {
+    switch (c) {
+      case 't':
+        for (type = 0; type < 4 && strcmp (optarg, types[type]) != 0; type++);
+        if (type == 4) {
+          ERROR (0, -1, "Invalid sample type: %s", optarg);
+        }
+        break;
+      case 's':
+        scale = strtof (optarg, &end);
+        if (*optarg == '\0' || *end != '\0') {
+          ERROR (0, -1, "Invalid scale: %s", optarg);
+        }
+        break;
+      case 'o':
+        offset = strtof (optarg, &end);
+        if (*optarg == '\0' || *end != '\0') {
+          ERROR (0, -1, "Invalid offset: %s", optarg);
+        }
+        break;
+      default:
+        optind = argc + 1;
+    }
+  }
+  if (optind != argc - 2) {
+    ERROR (0, -1, "\
+usage: tr_transpose [-t TYPE] [-s SCALE] [-o OFFSET] IN OUT\n\
+  IN: name of the input traces file in HWSec format (any version and layout)\n\
+  OUT: name of the output, sample-major, traces file in HWSec format\n\
+  -t TYPE: sample type of OUT, int8, int16, fp16 or float32 (default)\n\
+  -s SCALE: scale of the samples (default: automatic, from the extreme points)\n\
+  -o OFFSET: offset of the samples (default: 0, ignored if no SCALE)\n");
+  }
+  tr_transpose (argv[optind], argv[optind + 1], type, scale, offset);
+  fprintf (stderr, "Sample-major (%s) traces file stored in '%s'.\n", types[type], argv[optind + 1]);
+  return 0;
+}
@@ -16,42 +16,735 @@
 #include <stdint.h>
 #include <inttypes.h>
 #include <math.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "utils.h"
 #include "traces.h"
 
+/* Returns the row stride, in floats, of traces of l points: l rounded up to a
+ * multiple of TR_ALIGN bytes. */
+static int
+tr_ld (int l)
+{
+  int a;
+
+  a = TR_ALIGN / sizeof (float);
+  return (l + a - 1) / a * a;
+}
+
+/* Allocates n floats, initialized to zero, aligned on TR_ALIGN bytes. */
+static float *
+tr_alloc (size_t n)
+{
+  void *m;
+
+  if (posix_memalign (&m, TR_ALIGN, (n > 0 ? n : 1) * sizeof (float)) != 0)
+    {
+      ERROR (NULL, -1, "cannot allocate %zu floats", n);
+    }
+  memset (m, 0, (n > 0 ? n : 1) * sizeof (float));
+  return m;
+}
+
+/* Number of bytes of a sample of each type of the HWSec format, version 2. */
+static const int tr_sample_size[4] = { 1, 2, 2, 4 };
+
+/* Worst case size of the LZ4 block compressed form of n bytes. */
+static size_t
+tr_lz_bound (size_t n)
+{
+  return n + n / 255 + 16;
+}
+
+/* Compresses the n bytes of src in dst, in the LZ4 block format, with a greedy
+ * parse and a single entry per hash value. Returns the compressed size. */
+static size_t
+tr_lz_compress (const uint8_t * src, size_t n, uint8_t * dst)
+{
+  uint32_t table[1 << 12], seq, ref;
+  size_t ip, anchor, op, lit, len, k;
+  uint8_t *token;
+
+  memset (table, 0xff, sizeof (table));
+  ip = anchor = op = 0;
+  /* The last match starts at least 12 bytes before the end and the last 5
+   * bytes are literals, as required by the format. */
+  while (n >= 13 && ip < n - 12)
+    {
+      memcpy (&seq, src + ip, 4);
+      k = (seq * UINT32_C (2654435761)) >> 20;
+      ref = table[k];
+      table[k] = ip;
+      if (ref == UINT32_MAX || ip - ref > 65535
+	  || memcmp (src + ref, &seq, 4) != 0)
+	{
+	  ip += 1;
+	  continue;
+	}
+      for (len = 4; ip + len < n - 5 && src[ref + len] == src[ip + len];
+	   len++);
+      lit = ip - anchor;
+      token = dst + op++;
+      *token = (lit < 15 ? lit : 15) << 4;
+      if (lit >= 15)
+	{
+	  for (k = lit - 15; k >= 255; k -= 255)
+	    {
+	      dst[op++] = 255;
+	    }
+	  dst[op++] = k;
+	}
+      memcpy (dst + op, src + anchor, lit);
+      op += lit;
+      dst[op++] = (ip - ref) & 0xff;
+      dst[op++] = (ip - ref) >> 8;
+      *token |= len - 4 < 15 ? len - 4 : 15;
+      if (len - 4 >= 15)
+	{
+	  for (k = len - 4 - 15; k >= 255; k -= 255)
+	    {
+	      dst[op++] = 255;
+	    }
+	  dst[op++] = k;
+	}
+      ip += len;
+      anchor = ip;
+    }
+  lit = n - anchor;
+  dst[op++] = (lit < 15 ? lit : 15) << 4;
+  if (lit >= 15)
+    {
+      for (k = lit - 15; k >= 255; k -= 255)
+	{
+	  dst[op++] = 255;
+	}
+      dst[op++] = k;
+    }
+  memcpy (dst + op, src + anchor, lit);
+  return op + lit;
+}
+
+/* Decompresses the n bytes of src, in the LZ4 block format, in the m bytes of
+ * dst. Returns zero if src is not the compressed form of exactly m bytes. */
+static int
+tr_lz_decompress (const uint8_t * src, size_t n, uint8_t * dst, size_t m)
+{
+  size_t ip, op, lit, len, off;
+  uint8_t b;
+
+  ip = op = 0;
+  while (ip < n)
+    {
+      b = src[ip++];
+      lit = b >> 4;
+      if (lit == 15)
+	{
+	  do
+	    {
+	      if (ip >= n)
+		{
+		  return 0;
+		}
+	      lit += src[ip];
+	    }
+	  while (src[ip++] == 255);
+	}
+      if (lit > n - ip || lit > m - op)
+	{
+	  return 0;
+	}
+      memcpy (dst + op, src + ip, lit);
+      ip += lit;
+      op += lit;
+      if (ip == n)
+	{
+	  break;
+	}
+      if (n - ip < 2)
+	{
+	  return 0;
+	}
+      off = src[ip] | (src[ip + 1] << 8);
+      ip += 2;
+      len = (b & 15) + 4;
+      if ((b & 15) == 15)
+	{
+	  do
+	    {
+	      if (ip >= n)
+		{
+		  return 0;
+		}
+	      len += src[ip];
+	    }
+	  while (src[ip++] == 255);
+	}
+      if (off == 0 || off > op || len > m - op)
+	{
+	  return 0;
+	}
+      /* Byte by byte: the match may overlap the output. */
+      for (; len > 0; len--, op++)
+	{
+	  dst[op] = dst[op - off];
+	}
+    }
+  return op == m;
+}
+
+/* IEEE 754 half precision to single precision. */
+static float
+tr_half_to_float (uint16_t h)
+{
+  uint32_t e, m, x;
+  float f;
+
+  e = (h >> 10) & 0x1f;
+  m = h & 0x3ff;
+  if (e == 0)
+    {
+      /* Zero or subnormal: m * 2^-24. */
+      f = ldexpf ((float) m, -24);
+      return h & 0x8000 ? -f : f;
+    }
+  x = (uint32_t) (h & 0x8000) << 16;
+  if (e == 31)
+    {
+      x |= 0x7f800000 | (m << 13);
+    }
+  else
+    {
+      x |= ((e + 112) << 23) | (m << 13);
+    }
+  memcpy (&f, &x, sizeof (float));
+  return f;
+}
+
+/* Single precision to IEEE 754 half precision, rounded to nearest even. */
+static uint16_t
+tr_float_to_half (float f)
+{
+  uint32_t x, m, r, s, h;
+  int e;
+
+  memcpy (&x, &f, sizeof (float));
+  s = (x >> 16) & 0x8000;
+  e = (x >> 23) & 0xff;
+  m = x & 0x7fffff;
+  if (e == 255)
+    {
+      return s | 0x7c00 | (m != 0 ? 0x200 | (m >> 13) : 0);
+    }
+  e = e - 127 + 15;
+  if (e >= 31)
+    {
+      return s | 0x7c00;
+    }
+  if (e <= 0)
+    {
+      if (e < -10)
+	{
+	  return s;
+	}
+      m |= 0x800000;
+      h = m >> (14 - e);
+      r = m & ((UINT32_C (1) << (14 - e)) - 1);
+      m = UINT32_C (1) << (13 - e);
+      if (r > m || (r == m && (h & 1)))
+	{
+	  h += 1;
+	}
+      return s | h;
+    }
+  /* A carry out of the mantissa correctly increments the exponent. */
+  h = s | (e << 10) | (m >> 13);
+  r = m & 0x1fff;
+  if (r > 0x1000 || (r == 0x1000 && (h & 1)))
+    {
+      h += 1;
+    }
+  return h;
+}
+
+/* Header of a trace file, version 1 or 2. */
+typedef struct
+{
+  int version;			/* 1 or 2 */
+  int n;			/* Number of traces */
+  int l;			/* Number of points per trace */
+  uint64_t k;			/* Secret key */
+  int type;			/* Sample type (TR_SAMPLE_FLOAT32 in version 1) */
+  int compress;			/* Compression (TR_COMPRESS_NONE in version 1) */
+  int layout;			/* Layout (TR_LAYOUT_TRACE in version 1) */
+  float scale, offset;		/* Scale and offset of the samples */
+  int block;			/* Number of traces per compressed block */
+  size_t size;			/* Size of the header, in bytes */
+  size_t rsize;			/* Size of an uncompressed record, in bytes */
+} tr_header;
+
+/* Number of columns of a sample-major file read at a time: the reader writes
+ * one cache line per trace and per group. */
+#define TR_COLUMNS (64 / sizeof (float))
+
+/* Reader of the traces of a trace file, in file order, from a file or from a
+ * memory mapping. Only the points of a window are decoded; in sample-major
+ * files only the columns of the window are read. */
+typedef struct
+{
+  tr_header h;
+  FILE *fp;			/* The file, NULL if reading a mapping */
+  const char *mem;		/* The mapping, NULL if reading a file */
+  size_t len, pos;		/* Size of the mapping, current position */
+  int first, length;		/* The window */
+  int read;			/* Number of traces read so far */
+  uint8_t *raw;			/* A record, a decompressed block or columns */
+  uint8_t *cbuf;		/* A compressed block */
+  size_t cap;			/* Size of raw for columns, in bytes */
+  float *col;			/* Decoded columns */
+  int avail, next;		/* Number of records in raw, next one */
+} tr_reader;
+
+/* Reads n bytes of the file or mapping of r in dst. Returns zero on error. */
+static int
+tr_reader_bytes (tr_reader * r, void *dst, size_t n)
+{
+  if (r->fp != NULL)
+    {
+      return fread (dst, 1, n, r->fp) == n;
+    }
+  if (n > r->len - r->pos)
+    {
+      return 0;
+    }
+  memcpy (dst, r->mem + r->pos, n);
+  r->pos += n;
+  return 1;
+}
+
+/* Moves to byte off of the file or mapping of r. Returns zero on error. */
+static int
+tr_reader_seek (tr_reader * r, size_t off)
+{
+  if (r->fp != NULL)
+    {
+      return fseeko (r->fp, (off_t) (off), SEEK_SET) == 0;
+    }
+  if (off > r->len)
+    {
+      return 0;
+    }
+  r->pos = off;
+  return 1;
+}
+
+/* Opens a reader on file fp or, if fp is NULL, on the len bytes of mapping
+ * mem, and reads the header. The window is the whole traces. */
+static void
+tr_reader_open (tr_reader * r, FILE * fp, const char *mem, size_t len)
+{
+  char buf[HWSECV2HEADERSIZE];
+  int MagicNumberLength;
+  uint8_t b[3];
+
+  memset (r, 0, sizeof (tr_reader));
+  r->fp = fp;
+  r->mem = mem;
+  r->len = len;
+  MagicNumberLength = strlen (HWSECMAGICNUMBER);
+  if (!tr_reader_bytes (r, buf, MagicNumberLength))
+    {
+      ERROR ((void) 0, -1, "wrong magic number; is this a real HWSec trace file?");
+    }
+  r->h.type = TR_SAMPLE_FLOAT32;
+  r->h.compress = TR_COMPRESS_NONE;
+  r->h.layout = TR_LAYOUT_TRACE;
+  r->h.scale = 1.0;
+  r->h.offset = 0.0;
+  if (strncmp (buf, HWSECMAGICNUMBER, MagicNumberLength) == 0)
+    {
+      r->h.version = 1;
+      r->h.size = HWSECHEADERSIZE;
+    }
+  else if (strncmp (buf, HWSECV2MAGICNUMBER, MagicNumberLength) == 0)
+    {
+      r->h.version = 2;
+      r->h.size = HWSECV2HEADERSIZE;
+      if (!tr_reader_bytes (r, b, 3))
+	{
+	  ERROR ((void) 0, -1, "cannot read header; is this a real HWSec trace file?");
+	}
+      r->h.type = b[0];
+      r->h.compress = b[1];
+      r->h.layout = b[2];
+    }
+  else
+    {
+      ERROR ((void) 0, -1, "wrong magic number; is this a real HWSec trace file?");
+    }
+  if (!tr_reader_bytes (r, &(r->h.n), sizeof (uint32_t)) ||
+      !tr_reader_bytes (r, &(r->h.l), sizeof (uint32_t)) ||
+      !tr_reader_bytes (r, &(r->h.k), sizeof (uint64_t)) ||
+      (r->h.version == 2 &&
+       (!tr_reader_bytes (r, &(r->h.scale), sizeof (float)) ||
+	!tr_reader_bytes (r, &(r->h.offset), sizeof (float)) ||
+	!tr_reader_bytes (r, &(r->h.block), sizeof (uint32_t)) ||
+	!tr_reader_bytes (r, buf, 12))))
+    {
+      ERROR ((void) 0, -1, "cannot read header; is this a real HWSec trace file?");
+    }
+  if (r->h.n < 0 || r->h.l < 1 || r->h.type < TR_SAMPLE_INT8
+      || r->h.type > TR_SAMPLE_FLOAT32 || r->h.compress < TR_COMPRESS_NONE
+      || r->h.compress > TR_COMPRESS_LZ
+      || (r->h.compress == TR_COMPRESS_LZ && r->h.block < 1)
+      || r->h.layout < TR_LAYOUT_TRACE || r->h.layout > TR_LAYOUT_SAMPLE
+      || (r->h.layout == TR_LAYOUT_SAMPLE
+	  && r->h.compress != TR_COMPRESS_NONE))
+    {
+      ERROR ((void) 0, -1, "invalid header; is this a real HWSec trace file?");
+    }
+  r->h.rsize = 2 * sizeof (uint64_t) + (size_t) (r->h.l) * tr_sample_size[r->h.type];
+  r->first = 0;
+  r->length = r->h.l;
+  if (r->h.compress == TR_COMPRESS_LZ)
+    {
+      r->raw = XMALLOC (r->h.rsize * r->h.block);
+      r->cbuf = XMALLOC (tr_lz_bound (r->h.rsize * r->h.block));
+    }
+  else if (r->h.layout == TR_LAYOUT_TRACE)
+    {
+      r->raw = XMALLOC (r->h.rsize);
+    }
+}
+
+/* Restricts the traces read by r to length points, from point first. */
+static void
+tr_reader_window (tr_reader * r, int first, int length)
+{
+  if (first < 0 || first >= r->h.l || length < 1 || first + length > r->h.l)
+    {
+      ERROR ((void) 0, -1,
+	     "Invalid parameters value: first_index=%d, length=%d (traces length=%d)",
+	     first, length, r->h.l);
+    }
+  r->first = first;
+  r->length = length;
+}
+
+/* Converts n samples of r from src to points in dst. */
+static void
+tr_reader_decode (tr_reader * r, const uint8_t * src, float *dst, int n)
+{
+  int i;
+  int8_t x8;
+  int16_t x16;
+  uint16_t h;
+
+  switch (r->h.type)
+    {
+    case TR_SAMPLE_INT8:
+      for (i = 0; i < n; i++)
+	{
+	  x8 = src[i];
+	  dst[i] = (float) (x8) * r->h.scale + r->h.offset;
+	}
+      break;
+    case TR_SAMPLE_INT16:
+      for (i = 0; i < n; i++)
+	{
+	  memcpy (&x16, src + 2 * i, sizeof (int16_t));
+	  dst[i] = (float) (x16) * r->h.scale + r->h.offset;
+	}
+      break;
+    case TR_SAMPLE_FP16:
+      for (i = 0; i < n; i++)
+	{
+	  memcpy (&h, src + 2 * i, sizeof (uint16_t));
+	  dst[i] = tr_half_to_float (h) * r->h.scale + r->h.offset;
+	}
+      break;
+    default:
+      memcpy (dst, src, n * sizeof (float));
+    }
+}
+
+/* Reads the next record of a trace-major file: plaintext in *p, ciphertext
+ * in *c and the points of the window in t. Returns zero on error. */
+static int
+tr_reader_next (tr_reader * r, uint64_t * p, uint64_t * c, float *t)
+{
+  uint32_t rsize, csize;
+  uint8_t *rec;
+
+  if (r->h.compress == TR_COMPRESS_NONE)
+    {
+      if (r->h.type == TR_SAMPLE_FLOAT32 && r->length == r->h.l)
+	{
+	  return tr_reader_bytes (r, p, sizeof (uint64_t)) &&
+	    tr_reader_bytes (r, c, sizeof (uint64_t)) &&
+	    tr_reader_bytes (r, t, r->h.l * sizeof (float));
+	}
+      if (!tr_reader_bytes (r, r->raw, r->h.rsize))
+	{
+	  return 0;
+	}
+      rec = r->raw;
+    }
+  else
+    {
+      if (r->next == r->avail)
+	{
+	  if (!tr_reader_bytes (r, &rsize, sizeof (uint32_t)) ||
+	      !tr_reader_bytes (r, &csize, sizeof (uint32_t)) ||
+	      rsize == 0 || rsize % r->h.rsize != 0 ||
+	      rsize > r->h.rsize * r->h.block ||
+	      csize > tr_lz_bound (rsize) ||
+	      !tr_reader_bytes (r, r->cbuf, csize))
+	    {
+	      return 0;
+	    }
+	  if (csize == rsize)
+	    {
+	      memcpy (r->raw, r->cbuf, rsize);
+	    }
+	  else if (!tr_lz_decompress (r->cbuf, csize, r->raw, rsize))
+	    {
+	      return 0;
+	    }
+	  r->avail = rsize / r->h.rsize;
+	  r->next = 0;
+	}
+      rec = r->raw + (size_t) (r->next) * r->h.rsize;
+      r->next += 1;
+    }
+  memcpy (p, rec, sizeof (uint64_t));
+  memcpy (c, rec + sizeof (uint64_t), sizeof (uint64_t));
+  tr_reader_decode (r, rec + 2 * sizeof (uint64_t)
+		    + (size_t) (r->first) * tr_sample_size[r->h.type], t,
+		    r->length);
+  return 1;
+}
+
+/* Reads the next m traces of r: plaintexts in p, ciphertexts in c and the
+ * points of the window in the rows of t, ld floats apart. Returns zero on
+ * error. */
+static int
+tr_reader_read (tr_reader * r, int m, uint64_t * p, uint64_t * c, float *t,
+		int ld)
+{
+  int i, j, g, w, ss;
+  size_t base;
+
+  if (r->h.layout == TR_LAYOUT_TRACE)
+    {
+      for (i = 0; i < m; i++)
+	{
+	  if (!tr_reader_next (r, p + i, c + i, t + (size_t) i * ld))
+	    {
+	      return 0;
+	    }
+	  r->read += 1;
+	}
+      return 1;
+    }
+  /* Sample-major: the plaintexts, the ciphertexts, then the columns, each
+   * read from trace r->read on. */
+  ss = tr_sample_size[r->h.type];
+  if (r->cap < TR_COLUMNS * (size_t) m * ss)
+    {
+      r->cap = TR_COLUMNS * (size_t) m * ss;
+      free (r->raw);
+      free (r->col);
+      r->raw = XMALLOC (r->cap);
+      r->col = XMALLOC (TR_COLUMNS * (size_t) m * sizeof (float));
+    }
+  base = r->h.size + 2 * sizeof (uint64_t) * r->h.n;
+  if (!tr_reader_seek (r, r->h.size + sizeof (uint64_t) * r->read) ||
+      !tr_reader_bytes (r, p, m * sizeof (uint64_t)) ||
+      !tr_reader_seek (r, r->h.size + sizeof (uint64_t) * (r->h.n + r->read)) ||
+      !tr_reader_bytes (r, c, m * sizeof (uint64_t)))
+    {
+      return 0;
+    }
+  for (j = 0; j < r->length; j += TR_COLUMNS)
+    {
+      w = r->length - j < TR_COLUMNS ? r->length - j : TR_COLUMNS;
+      for (g = 0; g < w; g++)
+	{
+	  if (!tr_reader_seek (r, base + ((size_t) (r->first + j + g) * r->h.n
+					  + r->read) * ss) ||
+	      !tr_reader_bytes (r, r->raw, (size_t) m * ss))
+	    {
+	      return 0;
+	    }
+	  tr_reader_decode (r, r->raw, r->col + (size_t) g * m, m);
+	}
+      for (i = 0; i < m; i++)
+	{
+	  for (g = 0; g < w; g++)
+	    {
+	      t[(size_t) i * ld + j + g] = r->col[(size_t) g * m + i];
+	    }
+	}
+    }
+  r->read += m;
+  return 1;
+}
+
+/* Deallocates the buffers of r; does not close its file. */
+static void
+tr_reader_close (tr_reader * r)
+{
+  free (r->raw);
+  free (r->cbuf);
+  free (r->col);
+}
+
+/* Reads the first max traces (all if 0) of reader r in a new context. */
+static tr_context
+tr_reader_load (tr_reader * r, int max)
+{
+  tr_context ctx;
+
+  ctx = XCALLOC (1, sizeof (struct tr_context_s));
+  ctx->n = r->h.n;
+  if (max == 0)
+    {
+      max = ctx->n;
+    }
+  else if (ctx->n >= max)
+    {
+      ctx->n = max;
+    }
+  else
+    {
+      ERROR (NULL, -1, "not enough traces in trace file (%d < %d)", ctx->n, max);
+    }
+  ctx->l = r->length;
+  ctx->k = r->h.k;
+  ctx->p = XCALLOC (ctx->n, sizeof (uint64_t));
+  ctx->c = XCALLOC (ctx->n, sizeof (uint64_t));
+  ctx->ld = tr_ld (ctx->l);
+  ctx->m = tr_alloc ((size_t) (ctx->n) * ctx->ld);
+  if (ctx->n > 0 && !tr_reader_read (r, ctx->n, ctx->p, ctx->c, ctx->m, ctx->ld))
+    {
+      ERROR (NULL, -1,
+	     "cannot read trace #%d; is this a real HWSec trace file?", r->read);
+    }
+  return ctx;
+}
+
 tr_context
 tr_init (char *filename, int max)
 {
-  char *dummy;
-  int MagicNumberLength, i;
   FILE *fp;
+  tr_reader r;
   tr_context ctx;
 
   if (max < 0)
     {
       ERROR (NULL, -1, "Invalid maximum number of traces: %d", max);
     }
-  ctx = XCALLOC (1, sizeof (struct tr_context_s));
   fp = fopen (filename, "rb");
   if (fp == NULL)
     {
       ERROR (NULL, -1, "cannot open file %s", filename);
     }
-  MagicNumberLength = strlen (HWSECMAGICNUMBER);
-  dummy = XCALLOC (MagicNumberLength, sizeof (char));
-  if ((fread (dummy, sizeof (char), MagicNumberLength, fp) !=
-       MagicNumberLength) ||
-      (strncmp (dummy, HWSECMAGICNUMBER, MagicNumberLength) != 0))
+  tr_reader_open (&r, fp, NULL, 0);
+  ctx = tr_reader_load (&r, max);
+  tr_reader_close (&r);
+  fclose (fp);
+  return ctx;
+}
+
+tr_context
+tr_init_window (char *filename, int max, int first_index, int length)
+{
+  FILE *fp;
+  tr_reader r;
+  tr_context ctx;
+
+  if (max < 0)
     {
-      ERROR (NULL, -1, "wrong magic number; is this a real HWSec trace file?");
+      ERROR (NULL, -1, "Invalid maximum number of traces: %d", max);
     }
-  free (dummy);
-  if (fread (&(ctx->n), sizeof (uint32_t), 1, fp) != 1)
+  fp = fopen (filename, "rb");
+  if (fp == NULL)
     {
-      ERROR (NULL, -1,
-	     "cannot read number of traces; is this a real HWSec trace file?");
+      ERROR (NULL, -1, "cannot open file %s", filename);
+    }
+  tr_reader_open (&r, fp, NULL, 0);
+  tr_reader_window (&r, first_index, length);
+  ctx = tr_reader_load (&r, max);
+  tr_reader_close (&r);
+  fclose (fp);
+  return ctx;
+}
+
+tr_context
+tr_init_mmap (char *filename, int max)
+{
+  int fd, flags, populate;
+  struct stat st;
+  char *map;
+  size_t need;
+  tr_reader r;
+  tr_context ctx;
+
+  if (max < 0)
+    {
+      ERROR (NULL, -1, "Invalid maximum number of traces: %d", max);
+    }
+  fd = open (filename, O_RDONLY);
+  if (fd == -1 || fstat (fd, &st) == -1)
+    {
+      ERROR (NULL, -1, "cannot open file %s", filename);
+    }
+  if (st.st_size < HWSECHEADERSIZE)
+    {
+      ERROR (NULL, -1, "file too short; is this a real HWSec trace file?");
+    }
+  flags = MAP_PRIVATE;
+  populate = 0;
+#ifdef MAP_POPULATE
+  if (st.st_size <= TR_MMAP_POPULATE)
+    {
+      flags |= MAP_POPULATE;
+      populate = 1;
+    }
+#endif
+  map = mmap (NULL, st.st_size, PROT_READ, flags, fd, 0);
+  close (fd);
+  if (map == MAP_FAILED)
+    {
+      WARNING ("cannot map file %s, reading it instead", filename);
+      return tr_init (filename, max);
+    }
+  if (!populate)
+    {
+      madvise (map, st.st_size, MADV_SEQUENTIAL);
+      madvise (map, st.st_size, MADV_WILLNEED);
     }
+  tr_reader_open (&r, NULL, map, st.st_size);
+  if (r.h.type != TR_SAMPLE_FLOAT32 || r.h.compress != TR_COMPRESS_NONE
+      || r.h.layout != TR_LAYOUT_TRACE || r.h.size % sizeof (float) != 0)
+    {
+      /* Not zero-copy: decode in memory, as tr_init(). The records of
+       * version 1 files start at offset HWSECHEADERSIZE (21), their samples
+       * are not aligned on 4 bytes and cannot be handed out as floats. */
+      ctx = tr_reader_load (&r, max);
+      tr_reader_close (&r);
+      munmap (map, st.st_size);
+      return ctx;
+    }
+  tr_reader_close (&r);
+  ctx = XCALLOC (1, sizeof (struct tr_context_s));
+  ctx->n = r.h.n;
+  ctx->l = r.h.l;
+  ctx->k = r.h.k;
   if (max == 0)
     {
       max = ctx->n;
@@ -64,68 +757,94 @@ tr_init (char *filename, int max)
     {
       ERROR (NULL, -1, "not enough traces in trace file (%d < %d)", ctx->n, max);
     }
-  if (fread (&(ctx->l), sizeof (uint32_t), 1, fp) != 1)
+  ctx->stride = 2 * sizeof (uint64_t) + ctx->l * sizeof (float);
+  need = r.h.size + (size_t) (ctx->n) * ctx->stride;
+  if (need > st.st_size)
     {
-      ERROR (NULL, -1,
-	     "cannot read traces length; is this a real HWSec trace file?");
+      ERROR (NULL, -1, "truncated trace file (%zu bytes, %d traces of %d points need %zu)",
+	     (size_t) (st.st_size), ctx->n, ctx->l, need);
     }
-  if (fread (&(ctx->k), sizeof (uint64_t), 1, fp) != 1)
+  ctx->map = map;
+  ctx->size = st.st_size;
+  ctx->rec = map + r.h.size;
+  ctx->off = 2 * sizeof (uint64_t);
+  return ctx;
+}
+
+tr_context
+tr_view (tr_context ctx, int first_trace, int n, int first_index, int length)
+{
+  tr_context v;
+
+  v = XMALLOC (sizeof (struct tr_context_s));
+  *v = *ctx;
+  v->map = NULL;
+  v->size = 0;
+  v->view = 1;
+  tr_select (v, first_trace, n);
+  tr_trim (v, first_index, length);
+  return v;
+}
+
+void
+tr_materialize (tr_context ctx)
+{
+  int i, ld;
+  uint64_t *p, *c;
+  float *m;
+
+  if (ctx->rec == NULL && !ctx->view)
     {
-      ERROR (NULL, -1, "cannot read secret key; is this a real HWSec trace file?");
+      return;
     }
-  ctx->p = XCALLOC (ctx->n, sizeof (uint64_t));
-  ctx->c = XCALLOC (ctx->n, sizeof (uint64_t));
-  ctx->t = XCALLOC (ctx->n, sizeof (float *));
+  ld = tr_ld (ctx->l);
+  p = XCALLOC (ctx->n, sizeof (uint64_t));
+  c = XCALLOC (ctx->n, sizeof (uint64_t));
+  m = tr_alloc ((size_t) (ctx->n) * ld);
   for (i = 0; i < ctx->n; i++)
     {
-      ctx->t[i] = NULL;
+      p[i] = tr_plaintext (ctx, i);
+      c[i] = tr_ciphertext (ctx, i);
+      memcpy (m + (size_t) i * ld, tr_trace (ctx, i), ctx->l * sizeof (float));
     }
-  for (i = 0; i < ctx->n; i++)
+  if (ctx->map != NULL)
     {
-      ctx->t[i] = XCALLOC (ctx->l, sizeof (float));
-      if (fread (&(ctx->p[i]), sizeof (uint64_t), 1, fp) != 1)
-	{
-	  ERROR (NULL, -1,
-		 "cannot read plaintext #%d; is this a real HWSec trace file?",
-		 i);
-	}
-      if (fread (&(ctx->c[i]), sizeof (uint64_t), 1, fp) != 1)
-	{
-	  ERROR (NULL, -1,
-		 "cannot read ciphertext #%d; is this a real HWSec trace file?",
-		 i);
-	}
-      if (fread (ctx->t[i], sizeof (float), ctx->l, fp) != ctx->l)
-	{
-	  ERROR (NULL, -1,
-		 "cannot read trace #%d; is this a real HWSec trace file?",
-		 i);
-	}
+      munmap (ctx->map, ctx->size);
     }
-  fclose (fp);
-  return ctx;
+  ctx->map = NULL;
+  ctx->size = 0;
+  ctx->rec = NULL;
+  ctx->view = 0;
+  ctx->p = p;
+  ctx->c = c;
+  ctx->m = m;
+  ctx->ld = ld;
 }
 
 void
 tr_free (tr_context ctx)
 {
-  int i;
-
-  free (ctx->p);
-  free (ctx->c);
-  for (i = 0; i < ctx->n; i++)
+  if (ctx->view)
     {
-      free (ctx->t[i]);
+      free (ctx);
+      return;
     }
-  free (ctx->t);
+  if (ctx->map != NULL)
+    {
+      munmap (ctx->map, ctx->size);
+      free (ctx);
+      return;
+    }
+  free (ctx->p);
+  free (ctx->c);
+  free (ctx->m);
   free (ctx);
 }
 
 void
 tr_trim (tr_context ctx, int first_index, int length)
 {
-  int i;
-  float *t;
+  int i, ld;
 
   if (first_index < 0 || first_index >= ctx->l || length < 0 ||
       first_index + length > ctx->l)
@@ -134,24 +853,34 @@ tr_trim (tr_context ctx, int first_index, int length)
 	     "Invalid parameters value: first_index=%d, length=%d (traces length=%d)",
 	     first_index, length, ctx->l);
     }
+  if (ctx->rec != NULL)
+    {
+      ctx->off += first_index * sizeof (float);
+      ctx->l = length;
+      return;
+    }
+  if (ctx->view)
+    {
+      ctx->m += first_index;
+      ctx->l = length;
+      return;
+    }
+  /* Rows are packed in place, in increasing order: the destination never
+   * overtakes the source. */
+  ld = tr_ld (length);
   for (i = 0; i < ctx->n; i++)
     {
-      t = XCALLOC (length, sizeof (float));
-      memcpy (t, &(ctx->t[i][first_index]), length * sizeof (float));
-      free (ctx->t[i]);
-      ctx->t[i] = t;
+      memmove (ctx->m + (size_t) i * ld,
+	       ctx->m + (size_t) i * ctx->ld + first_index,
+	       length * sizeof (float));
     }
   ctx->l = length;
+  ctx->ld = ld;
 }
 
 void
 tr_select (tr_context ctx, int first_trace, int n)
 {
-  int i;
-  float **t;
-  uint64_t *c;
-  uint64_t *p;
-
   if (first_trace < 0 || first_trace >= ctx->n || n < 0 ||
       first_trace + n > ctx->n)
     {
@@ -159,116 +888,738 @@ tr_select (tr_context ctx, int first_trace, int n)
 	     "Invalid parameters value: first_trace=%d, n=%d (number of traces=%d)",
 	     first_trace, n, ctx->n);
     }
-  t = XCALLOC (n, sizeof (float *));
-  c = XCALLOC (n, sizeof (uint64_t));
-  p = XCALLOC (n, sizeof (uint64_t));
-  for (i = 0; i < first_trace; i++)
+  if (ctx->rec != NULL)
+    {
+      ctx->rec += (size_t) first_trace * ctx->stride;
+    }
+  else if (ctx->view)
+    {
+      ctx->p += first_trace;
+      ctx->c += first_trace;
+      ctx->m += (size_t) first_trace * ctx->ld;
+    }
+  else
+    {
+      memmove (ctx->p, ctx->p + first_trace, n * sizeof (uint64_t));
+      memmove (ctx->c, ctx->c + first_trace, n * sizeof (uint64_t));
+      memmove (ctx->m, ctx->m + (size_t) first_trace * ctx->ld,
+	       (size_t) n * ctx->ld * sizeof (float));
+    }
+  ctx->n = n;
+}
+
+void
+tr_shrink (tr_context ctx, int chunk_size)
+{
+  int i, j, k, l, ld;
+  float s, *t, *p;
+
+  if (ctx->rec != NULL || ctx->view)
+    {
+      ERROR ((void) 0, -1,
+	     "cannot shrink a view or a mapped context in place; call tr_materialize() first");
+    }
+  if (chunk_size < 1 || chunk_size > ctx->l)
+    {
+      ERROR ((void) 0, -1,
+	     "Invalid parameters value: chunk_size=%d (traces length=%d)",
+	     chunk_size, ctx->l);
+    }
+  /* Rows are shrunk in place, in increasing order: each sum is stored after
+   * its chunk has been read and before the next chunks. */
+  l = ctx->l / chunk_size;
+  ld = tr_ld (l);
+  for (i = 0; i < ctx->n; i++)
+    {
+      t = ctx->m + (size_t) i * ld;
+      p = ctx->m + (size_t) i * ctx->ld;
+      for (j = 0; j < l; j++)
+	{
+	  s = 0.0;
+	  for (k = 0; k < chunk_size; k++)
+	    {
+	      s += *p;
+	      p += 1;
+	    }
+	  t[j] = s;
+	}
+    }
+  ctx->l = l;
+  ctx->ld = ld;
+}
+
+/* Encodes the l points of t as samples of a HWSec file, version 2, in dst.
+ * Returns the number of saturated samples. */
+static int
+tr_encode (int type, float scale, float offset, int l, float *t, uint8_t * dst)
+{
+  int i, sat;
+  float v, lo, hi;
+  int8_t x8;
+  int16_t x16;
+  uint16_t h;
+
+  sat = 0;
+  lo = type == TR_SAMPLE_INT8 ? -128.0 : -32768.0;
+  hi = type == TR_SAMPLE_INT8 ? 127.0 : 32767.0;
+  for (i = 0; i < l; i++)
+    {
+      if (type == TR_SAMPLE_FLOAT32)
+	{
+	  memcpy (dst + 4 * i, t + i, sizeof (float));
+	  continue;
+	}
+      v = (t[i] - offset) / scale;
+      if (type == TR_SAMPLE_FP16)
+	{
+	  h = tr_float_to_half (v);
+	  memcpy (dst + 2 * i, &h, sizeof (uint16_t));
+	  continue;
+	}
+      v = rintf (v);
+      if (!(v >= lo && v <= hi))
+	{
+	  sat += 1;
+	  v = v > hi ? hi : lo;
+	}
+      if (type == TR_SAMPLE_INT8)
+	{
+	  x8 = (int8_t) (v);
+	  dst[i] = (uint8_t) (x8);
+	}
+      else
+	{
+	  x16 = (int16_t) (v);
+	  memcpy (dst + 2 * i, &x16, sizeof (int16_t));
+	}
+    }
+  return sat;
+}
+
+/* A writer of HWSec trace files, record by record. The records are gathered
+ * by blocks of w->m in w->raw and written (compressed if w->block is not
+ * zero) when a block is full and by tr_writer_close(). Version 1 records are
+ * those of TR_SAMPLE_FLOAT32, never compressed. */
+typedef struct
+{
+  FILE *fp;			/* Output file */
+  int type;			/* Sample type */
+  float scale;			/* Scale of the samples */
+  float offset;			/* Offset of the samples */
+  int block;			/* Number of traces per compressed block */
+  int l;			/* Number of points per trace */
+  size_t size;			/* Size of a record, in bytes */
+  int m;			/* Number of records per block */
+  int j;			/* Number of records in raw */
+  uint8_t *raw;			/* Records of the current block */
+  uint8_t *cbuf;		/* Compressed block */
+  int sat;			/* Number of saturated samples */
+} tr_writer;
+
+/* Opens the trace file filename (stdout if NULL) for writing n traces of l
+ * points and secret key k, version 1 if v1, else version 2 with the given
+ * sample type, scale, offset and compression, and writes its header. */
+static void
+tr_writer_open (tr_writer * w, char *filename, int v1, int n, int l,
+		uint64_t k, int type, float scale, float offset, int block)
+{
+  uint8_t hdr[HWSECV2HEADERSIZE];
+
+  w->fp = filename == NULL ? stdout : fopen (filename, "wb");
+  if (w->fp == NULL)
+    {
+      ERROR ((void) 0, -1, "cannot open file %s for writing", filename);
+    }
+  w->type = v1 ? TR_SAMPLE_FLOAT32 : type;
+  w->scale = scale;
+  w->offset = offset;
+  w->block = v1 ? 0 : block;
+  w->l = l;
+  memset (hdr, 0, HWSECV2HEADERSIZE);
+  if (v1)
+    {
+      memcpy (hdr, HWSECMAGICNUMBER, strlen (HWSECMAGICNUMBER));
+      memcpy (hdr + 5, &n, sizeof (uint32_t));
+      memcpy (hdr + 9, &l, sizeof (uint32_t));
+      memcpy (hdr + 13, &k, sizeof (uint64_t));
+    }
+  else
+    {
+      memcpy (hdr, HWSECV2MAGICNUMBER, strlen (HWSECV2MAGICNUMBER));
+      hdr[5] = type;
+      hdr[6] = block > 0 ? TR_COMPRESS_LZ : TR_COMPRESS_NONE;
+      memcpy (hdr + 8, &n, sizeof (uint32_t));
+      memcpy (hdr + 12, &l, sizeof (uint32_t));
+      memcpy (hdr + 16, &k, sizeof (uint64_t));
+      memcpy (hdr + 24, &scale, sizeof (float));
+      memcpy (hdr + 28, &offset, sizeof (float));
+      memcpy (hdr + 32, &block, sizeof (uint32_t));
+    }
+  if (fwrite (hdr, 1, v1 ? HWSECHEADERSIZE : HWSECV2HEADERSIZE, w->fp) !=
+      (v1 ? HWSECHEADERSIZE : HWSECV2HEADERSIZE))
+    {
+      ERROR ((void) 0, -1, "write error");
+    }
+  w->size = 2 * sizeof (uint64_t) + (size_t) (l) * tr_sample_size[w->type];
+  w->m = w->block > 0 ? w->block : TR_LZ_BLOCK;
+  w->j = 0;
+  w->raw = XMALLOC (w->size * w->m);
+  w->cbuf = w->block > 0 ? XMALLOC (tr_lz_bound (w->size * w->m)) : NULL;
+  w->sat = 0;
+}
+
+/* Writes the w->j records of w->raw, as one compressed block if w->block is
+ * not zero. */
+static void
+tr_writer_flush (tr_writer * w)
+{
+  uint32_t rsize, csize;
+
+  rsize = w->j * w->size;
+  w->j = 0;
+  if (rsize == 0)
+    {
+      return;
+    }
+  if (w->block == 0)
+    {
+      if (fwrite (w->raw, 1, rsize, w->fp) != rsize)
+	{
+	  ERROR ((void) 0, -1, "write error");
+	}
+      return;
+    }
+  csize = tr_lz_compress (w->raw, rsize, w->cbuf);
+  if (csize >= rsize)
+    {
+      csize = rsize;
+      memcpy (w->cbuf, w->raw, rsize);
+    }
+  if (fwrite (&rsize, sizeof (uint32_t), 1, w->fp) != 1 ||
+      fwrite (&csize, sizeof (uint32_t), 1, w->fp) != 1 ||
+      fwrite (w->cbuf, 1, csize, w->fp) != csize)
+    {
+      ERROR ((void) 0, -1, "write error");
+    }
+}
+
+/* Appends the record of plaintext p, ciphertext c and power trace t. */
+static void
+tr_writer_add (tr_writer * w, uint64_t p, uint64_t c, float *t)
+{
+  uint8_t *rec;
+
+  rec = w->raw + w->j * w->size;
+  memcpy (rec, &p, sizeof (uint64_t));
+  memcpy (rec + sizeof (uint64_t), &c, sizeof (uint64_t));
+  w->sat += tr_encode (w->type, w->scale, w->offset, w->l, t,
+		       rec + 2 * sizeof (uint64_t));
+  w->j += 1;
+  if (w->j == w->m)
+    {
+      tr_writer_flush (w);
+    }
+}
+
+/* Writes the last block, warns about the saturated samples and closes the
+ * trace file. */
+static void
+tr_writer_close (tr_writer * w)
+{
+  tr_writer_flush (w);
+  if (w->sat > 0)
+    {
+      WARNING ("%d samples out of range saturated", w->sat);
+    }
+  free (w->raw);
+  free (w->cbuf);
+  if (w->fp != stdout && fclose (w->fp) != 0)
+    {
+      ERROR ((void) 0, -1, "write error");
+    }
+}
+
+/* Returns in *scale and *offset the automatic scale and offset of samples of
+ * type type (see tr_dump_v2()) for the n traces whose extreme points are min
+ * and max. */
+static void
+tr_auto_scale (int type, int n, float min, float max, float *scale,
+	       float *offset)
+{
+  int m;
+
+  m = type == TR_SAMPLE_INT8 ? 128 : 32768;
+  *scale = max > min ? (max - min) / (2 * m - 1) : 1.0;
+  *offset = n > 0 ? min + m * *scale : 0.0;
+}
+
+void
+tr_dump (tr_context ctx, char *filename)
+{
+  int i;
+  tr_writer w;
+
+  tr_writer_open (&w, filename, 1, ctx->n, ctx->l, ctx->k,
+		  TR_SAMPLE_FLOAT32, 1.0, 0.0, 0);
+  for (i = 0; i < ctx->n; i++)
+    {
+      tr_writer_add (&w, tr_plaintext (ctx, i), tr_ciphertext (ctx, i),
+		     tr_trace (ctx, i));
+    }
+  tr_writer_close (&w);
+}
+
+void
+tr_dump_v2 (tr_context ctx, char *filename, int type, float scale,
+	    float offset, int block)
+{
+  int i, idx;
+  float min, max, v;
+  tr_writer w;
+
+  if (type < TR_SAMPLE_INT8 || type > TR_SAMPLE_FLOAT32)
+    {
+      ERROR ((void) 0, -1, "Invalid sample type: %d", type);
+    }
+  if (block < 0)
+    {
+      ERROR ((void) 0, -1, "Invalid number of traces per block: %d", block);
+    }
+  if (type == TR_SAMPLE_FLOAT32 || (type == TR_SAMPLE_FP16 && scale <= 0.0))
+    {
+      scale = 1.0;
+      offset = 0.0;
+    }
+  else if (scale <= 0.0)
+    {
+      /* The extreme points are the extreme samples. */
+      min = INFINITY;
+      max = -INFINITY;
+      for (i = 0; i < ctx->n; i++)
+	{
+	  v = tr_min (ctx, tr_trace (ctx, i), &idx);
+	  min = v < min ? v : min;
+	  v = tr_max (ctx, tr_trace (ctx, i), &idx);
+	  max = v > max ? v : max;
+	}
+      tr_auto_scale (type, ctx->n, min, max, &scale, &offset);
+    }
+  tr_writer_open (&w, filename, 0, ctx->n, ctx->l, ctx->k, type, scale,
+		  offset, block);
+  for (i = 0; i < ctx->n; i++)
+    {
+      tr_writer_add (&w, tr_plaintext (ctx, i), tr_ciphertext (ctx, i),
+		     tr_trace (ctx, i));
+    }
+  tr_writer_close (&w);
+}
+
+/* A stream has two batches. The reader thread fills them in turn and the
+ * consumer processes them in the same order. A batch is full when it has been
+ * read and not yet released by the consumer. An empty batch (zero traces)
+ * marks the end of the stream. */
+struct tr_stream_s
+{
+  FILE *fp;			/* Trace file */
+  tr_reader r;			/* Reader of the trace file */
+  int n;			/* Number of traces of the stream */
+  int l;			/* Number of points per trace */
+  uint64_t k;			/* Secret key */
+  int batch;			/* Maximum number of traces per batch */
+  int read;			/* Number of traces read so far */
+  tr_context buf[2];		/* The two batches */
+  int full[2];			/* Batch filled and not yet released */
+  int next;			/* Next batch to return */
+  int busy;			/* Batch in use by the consumer, -1 if none */
+  int started;			/* Reader thread started */
+  int stop;			/* Stop request to the reader thread */
+  pthread_t tid;		/* Reader thread */
+  pthread_mutex_t lock;		/* Protects full, busy and stop */
+  pthread_cond_t cond;		/* Signals changes of full and stop */
+};
+
+tr_stream
+tr_stream_open (char *filename, int max, int batch)
+{
+  int i;
+  tr_stream s;
+
+  if (max < 0)
+    {
+      ERROR (NULL, -1, "Invalid maximum number of traces: %d", max);
+    }
+  if (batch < 0)
+    {
+      ERROR (NULL, -1, "Invalid batch size: %d", batch);
+    }
+  s = XCALLOC (1, sizeof (struct tr_stream_s));
+  s->fp = fopen (filename, "rb");
+  if (s->fp == NULL)
+    {
+      ERROR (NULL, -1, "cannot open file %s", filename);
+    }
+  setvbuf (s->fp, NULL, _IOFBF, 1 << 20);
+  tr_reader_open (&(s->r), s->fp, NULL, 0);
+  s->n = s->r.h.n;
+  s->l = s->r.h.l;
+  s->k = s->r.h.k;
+  if (max != 0 && s->n >= max)
+    {
+      s->n = max;
+    }
+  else if (max != 0)
+    {
+      ERROR (NULL, -1, "not enough traces in trace file (%d < %d)", s->n, max);
+    }
+  s->batch = batch == 0 ? TR_STREAM_BATCH : batch;
+  if (s->batch > s->n)
+    {
+      s->batch = s->n > 0 ? s->n : 1;
+    }
+  for (i = 0; i < 2; i++)
+    {
+      s->buf[i] = XCALLOC (1, sizeof (struct tr_context_s));
+      s->buf[i]->l = s->l;
+      s->buf[i]->k = s->k;
+      s->buf[i]->p = XCALLOC (s->batch, sizeof (uint64_t));
+      s->buf[i]->c = XCALLOC (s->batch, sizeof (uint64_t));
+      s->buf[i]->ld = tr_ld (s->l);
+      s->buf[i]->m = tr_alloc ((size_t) (s->batch) * s->buf[i]->ld);
+    }
+  s->busy = -1;
+  pthread_mutex_init (&(s->lock), NULL);
+  pthread_cond_init (&(s->cond), NULL);
+  return s;
+}
+
+/* Reads the next (at most) s->batch traces of the stream in batch b. Returns
+ * the number of traces read, zero at the end of the stream. */
+static int
+tr_stream_read (tr_stream s, tr_context b)
+{
+  int m;
+
+  m = s->n - s->read < s->batch ? s->n - s->read : s->batch;
+  if (m > 0 && !tr_reader_read (&(s->r), m, b->p, b->c, b->m, b->ld))
+    {
+      ERROR (0, -1,
+	     "cannot read trace #%d; is this a real HWSec trace file?",
+	     s->r.read);
+    }
+  s->read += m;
+  b->n = m;
+  return m;
+}
+
+/* The reader thread: fills the two batches in turn, as soon as the consumer
+ * releases them, until the end of the stream or a stop request. */
+static void *
+tr_stream_reader (void *arg)
+{
+  tr_stream s;
+  int i, m;
+
+  s = arg;
+  for (i = 0, m = 1; m != 0; i ^= 1)
+    {
+      pthread_mutex_lock (&(s->lock));
+      while (s->full[i] && !s->stop)
+	{
+	  pthread_cond_wait (&(s->cond), &(s->lock));
+	}
+      if (s->stop)
+	{
+	  pthread_mutex_unlock (&(s->lock));
+	  break;
+	}
+      pthread_mutex_unlock (&(s->lock));
+      m = tr_stream_read (s, s->buf[i]);
+      pthread_mutex_lock (&(s->lock));
+      s->full[i] = 1;
+      pthread_cond_broadcast (&(s->cond));
+      pthread_mutex_unlock (&(s->lock));
+    }
+  return NULL;
+}
+
+int
+tr_stream_next (tr_stream s, tr_context * batch)
+{
+  tr_context b;
+
+  if (!s->started)
+    {
+      if (pthread_create (&(s->tid), NULL, tr_stream_reader, s) != 0)
+	{
+	  ERROR (0, -1, "cannot create reader thread");
+	}
+      s->started = 1;
+    }
+  pthread_mutex_lock (&(s->lock));
+  if (s->busy != -1)
+    {
+      s->full[s->busy] = 0;
+      s->busy = -1;
+      pthread_cond_broadcast (&(s->cond));
+    }
+  while (!s->full[s->next])
+    {
+      pthread_cond_wait (&(s->cond), &(s->lock));
+    }
+  b = s->buf[s->next];
+  if (b->n != 0)
+    {
+      s->busy = s->next;
+      s->next ^= 1;
+    }
+  pthread_mutex_unlock (&(s->lock));
+  *batch = b->n == 0 ? NULL : b;
+  return b->n;
+}
+
+void
+tr_stream_window (tr_stream s, int first_index, int length)
+{
+  int i;
+
+  if (s->started)
+    {
+      ERROR ((void) 0, -1, "stream already started");
+    }
+  tr_reader_window (&(s->r), first_index, length);
+  s->l = length;
+  for (i = 0; i < 2; i++)
+    {
+      s->buf[i]->l = length;
+    }
+}
+
+int
+tr_stream_number (tr_stream s)
+{
+  return s->n;
+}
+
+int
+tr_stream_length (tr_stream s)
+{
+  return s->l;
+}
+
+void
+tr_stream_close (tr_stream s)
+{
+  int i;
+
+  if (s->started)
+    {
+      pthread_mutex_lock (&(s->lock));
+      s->stop = 1;
+      pthread_cond_broadcast (&(s->cond));
+      pthread_mutex_unlock (&(s->lock));
+      pthread_join (s->tid, NULL);
+    }
+  pthread_mutex_destroy (&(s->lock));
+  pthread_cond_destroy (&(s->cond));
+  tr_reader_close (&(s->r));
+  fclose (s->fp);
+  for (i = 0; i < 2; i++)
+    {
+      tr_free (s->buf[i]);
+    }
+  free (s);
+}
+
+/* Sets *scale and *offset as tr_dump_v2() for the first max traces (all if
+ * zero) of the trace file filename, read by a first pass on a stream if the
+ * scale is automatic. */
+static void
+tr_stream_scale (char *filename, int max, int type, float *scale,
+		 float *offset)
+{
+  int i, m, idx;
+  float lo, hi, v;
+  tr_stream s;
+  tr_context b;
+
+  if (type == TR_SAMPLE_FLOAT32 || (type == TR_SAMPLE_FP16 && *scale <= 0.0))
     {
-      free (ctx->t[i]);
+      *scale = 1.0;
+      *offset = 0.0;
+      return;
     }
-  for (i = 0; i < n; i++)
+  if (*scale > 0.0)
     {
-      t[i] = ctx->t[i + first_trace];
-      c[i] = ctx->c[i + first_trace];
-      p[i] = ctx->p[i + first_trace];
+      return;
     }
-  for (i = first_trace + n; i < ctx->n; i++)
+  lo = INFINITY;
+  hi = -INFINITY;
+  s = tr_stream_open (filename, max, 0);
+  while ((m = tr_stream_next (s, &b)))
     {
-      free (ctx->t[i]);
+      for (i = 0; i < m; i++)
+	{
+	  v = tr_min (b, tr_trace (b, i), &idx);
+	  lo = v < lo ? v : lo;
+	  v = tr_max (b, tr_trace (b, i), &idx);
+	  hi = v > hi ? v : hi;
+	}
     }
-  free (ctx->c);
-  ctx->c = c;
-  free (ctx->p);
-  ctx->p = p;
-  free (ctx->t);
-  ctx->t = t;
-  ctx->n = n;
+  tr_auto_scale (type, tr_stream_number (s), lo, hi, scale, offset);
+  tr_stream_close (s);
 }
 
-void
-tr_shrink (tr_context ctx, int chunk_size)
+/* Transposes the m x l matrix of samples of size ss src (row-major) in dst
+ * (column-major), by square tiles that fit in the L1 cache. */
+static void
+tr_transpose_block (const uint8_t * src, uint8_t * dst, int m, int l, int ss)
 {
-  int i, j, k, l;
-  float *t, *p;
+  int i, j, ii, jj, ie, je;
 
-  if (chunk_size < 1 || chunk_size > ctx->l)
-    {
-      ERROR ((void) 0, -1,
-	     "Invalid parameters value: chunk_size=%d (traces length=%d)",
-	     chunk_size, ctx->l);
-    }
-  l = ctx->l / chunk_size;
-  for (i = 0; i < ctx->n; i++)
+  for (ii = 0; ii < m; ii += 64)
     {
-      t = XCALLOC (l, sizeof (float));
-      p = ctx->t[i];
-      for (j = 0; j < l; j++)
+      ie = ii + 64 < m ? ii + 64 : m;
+      for (jj = 0; jj < l; jj += 64)
 	{
-	  t[j] = 0.0;
-	  for (k = 0; k < chunk_size; k++)
+	  je = jj + 64 < l ? jj + 64 : l;
+	  for (j = jj; j < je; j++)
 	    {
-	      t[j] += *p;
-	      p += 1;
+	      for (i = ii; i < ie; i++)
+		{
+		  memcpy (dst + ((size_t) j * m + i) * ss,
+			  src + ((size_t) i * l + j) * ss, ss);
+		}
 	    }
 	}
-      free (ctx->t[i]);
-      ctx->t[i] = t;
     }
-  ctx->l = l;
 }
 
 void
-tr_dump (tr_context ctx, char *filename)
+tr_transpose (char *filename, char *output, int type, float scale,
+	      float offset)
 {
-  int MagicNumberLength, i;
+  int i, j, m, n, l, ss, sat;
+  uint8_t hdr[HWSECV2HEADERSIZE], *enc, *col;
+  size_t base, first;
+  tr_stream s;
+  tr_context b;
   FILE *fp;
 
-  if (filename == NULL)
-  {
-    fp = stdout;
-  }
-  else
-  {
-    fp = fopen (filename, "wb");
-  }
+  if (type < TR_SAMPLE_INT8 || type > TR_SAMPLE_FLOAT32)
+    {
+      ERROR ((void) 0, -1, "Invalid sample type: %d", type);
+    }
+  /* A first pass for the extreme points if the scale is automatic. */
+  tr_stream_scale (filename, 0, type, &scale, &offset);
+  s = tr_stream_open (filename, 0, 0);
+  n = tr_stream_number (s);
+  l = tr_stream_length (s);
+  fp = fopen (output, "wb");
   if (fp == NULL)
     {
-      ERROR ((void) 0, -1, "cannot open file %s for writing", filename);
+      ERROR ((void) 0, -1, "cannot open file %s for writing", output);
     }
-  MagicNumberLength = strlen (HWSECMAGICNUMBER);
-  if (fwrite (HWSECMAGICNUMBER, sizeof (char), MagicNumberLength, fp) !=
-      MagicNumberLength)
+  memset (hdr, 0, HWSECV2HEADERSIZE);
+  memcpy (hdr, HWSECV2MAGICNUMBER, strlen (HWSECV2MAGICNUMBER));
+  hdr[5] = type;
+  hdr[6] = TR_COMPRESS_NONE;
+  hdr[7] = TR_LAYOUT_SAMPLE;
+  memcpy (hdr + 8, &n, sizeof (uint32_t));
+  memcpy (hdr + 12, &l, sizeof (uint32_t));
+  memcpy (hdr + 16, &(s->k), sizeof (uint64_t));
+  memcpy (hdr + 24, &scale, sizeof (float));
+  memcpy (hdr + 28, &offset, sizeof (float));
+  if (fwrite (hdr, 1, HWSECV2HEADERSIZE, fp) != HWSECV2HEADERSIZE)
     {
       ERROR ((void) 0, -1, "write error");
     }
-  if (fwrite (&(ctx->n), sizeof (uint32_t), 1, fp) != 1)
+  ss = tr_sample_size[type];
+  base = HWSECV2HEADERSIZE + 2 * sizeof (uint64_t) * (size_t) (n);
+  enc = XMALLOC ((size_t) (s->batch) * l * ss);
+  col = XMALLOC ((size_t) (s->batch) * l * ss);
+  sat = 0;
+  first = 0;
+  /* Each batch is encoded by rows, transposed in memory and written as one
+   * segment of each column. */
+  while ((m = tr_stream_next (s, &b)))
     {
-      ERROR ((void) 0, -1, "write error");
+      for (i = 0; i < m; i++)
+	{
+	  sat += tr_encode (type, scale, offset, l, tr_trace (b, i),
+			    enc + (size_t) i * l * ss);
+	}
+      tr_transpose_block (enc, col, m, l, ss);
+      if (fseeko (fp, HWSECV2HEADERSIZE + sizeof (uint64_t) * first,
+		  SEEK_SET) != 0
+	  || fwrite (b->p, sizeof (uint64_t), m, fp) != m
+	  || fseeko (fp, HWSECV2HEADERSIZE + sizeof (uint64_t) * (n + first),
+		     SEEK_SET) != 0
+	  || fwrite (b->c, sizeof (uint64_t), m, fp) != m)
+	{
+	  ERROR ((void) 0, -1, "write error");
+	}
+      for (j = 0; j < l; j++)
+	{
+	  if (fseeko (fp, base + ((size_t) j * n + first) * ss, SEEK_SET) != 0
+	      || fwrite (col + (size_t) j * m * ss, ss, m, fp) != m)
+	    {
+	      ERROR ((void) 0, -1, "write error");
+	    }
+	}
+      first += m;
     }
-  if (fwrite (&(ctx->l), sizeof (uint32_t), 1, fp) != 1)
+  if (sat > 0)
     {
-      ERROR ((void) 0, -1, "write error");
+      WARNING ("%d samples out of range saturated", sat);
     }
-  if (fwrite (&(ctx->k), sizeof (uint64_t), 1, fp) != 1)
+  tr_stream_close (s);
+  free (enc);
+  free (col);
+  if (fclose (fp) != 0)
     {
       ERROR ((void) 0, -1, "write error");
     }
-  for (i = 0; i < ctx->n; i++)
+}
+
+void
+tr_convert (char *filename, char *output, int max, int type, float scale,
+	    float offset, int block)
+{
+  int i, m;
+  tr_stream s;
+  tr_context b;
+  tr_writer w;
+
+  if (type < TR_SAMPLE_INT8 || type > TR_VERSION1)
     {
-      if (fwrite (&(ctx->p[i]), sizeof (uint64_t), 1, fp) != 1)
-	{
-	  ERROR ((void) 0, -1, "write error");
-	}
-      if (fwrite (&(ctx->c[i]), sizeof (uint64_t), 1, fp) != 1)
-	{
-	  ERROR ((void) 0, -1, "write error");
-	}
-      if (fwrite (ctx->t[i], sizeof (float), ctx->l, fp) != ctx->l)
+      ERROR ((void) 0, -1, "Invalid sample type: %d", type);
+    }
+  if (block < 0)
+    {
+      ERROR ((void) 0, -1, "Invalid number of traces per block: %d", block);
+    }
+  if (type == TR_VERSION1)
+    {
+      scale = 1.0;
+      offset = 0.0;
+    }
+  else
+    {
+      tr_stream_scale (filename, max, type, &scale, &offset);
+    }
+  s = tr_stream_open (filename, max, 0);
+  tr_writer_open (&w, output, type == TR_VERSION1, tr_stream_number (s),
+		  tr_stream_length (s), s->k, type, scale, offset, block);
+  while ((m = tr_stream_next (s, &b)))
+    {
+      for (i = 0; i < m; i++)
 	{
-	  ERROR ((void) 0, -1, "write error");
+	  tr_writer_add (&w, tr_plaintext (b, i), tr_ciphertext (b, i),
+			 tr_trace (b, i));
 	}
     }
-  fclose (fp);
+  tr_writer_close (&w);
+  tr_stream_close (s);
 }
 
 int
@@ -292,33 +1643,73 @@ tr_key (tr_context ctx)
 uint64_t
 tr_plaintext (tr_context ctx, int i)
 {
-  if (i < 0 || i > ctx->n)
+  uint64_t p;
+
+  if (i < 0 || i >= ctx->n)
     {
       ERROR (0, -1,
 	     "no plaintext #%d in context (number of plaintexts=%d)", i,
 	     ctx->n);
     }
+  if (ctx->rec != NULL)
+    {
+      memcpy (&p, ctx->rec + (size_t) i * ctx->stride, sizeof (uint64_t));
+      return p;
+    }
   return ctx->p[i];
 }
 
 uint64_t
 tr_ciphertext (tr_context ctx, int i)
 {
-  if (i < 0 || i > ctx->n)
+  uint64_t c;
+
+  if (i < 0 || i >= ctx->n)
     {
       ERROR (0, -1,
 	     "no ciphertext #%d in context (number of ciphertexts=%d)", i,
 	     ctx->n);
     }
+  if (ctx->rec != NULL)
+    {
+      memcpy (&c, ctx->rec + (size_t) i * ctx->stride + sizeof (uint64_t), sizeof (uint64_t));
+      return c;
+    }
   return ctx->c[i];
 }
 
 float *
 tr_trace (tr_context ctx, int i)
 {
-  if (i < 0 || i > ctx->n)
+  if (i < 0 || i >= ctx->n)
     ERROR (NULL, -1, "no trace #%d in context (number of traces=%d)", i, ctx->n);
-  return ctx->t[i];
+  if (ctx->rec != NULL)
+    {
+      return (float *) (ctx->rec + (size_t) i * ctx->stride + ctx->off);
+    }
+  return ctx->m + (size_t) i * ctx->ld;
+}
+
+float *
+tr_matrix (tr_context ctx)
+{
+  if (ctx->rec != NULL)
+    {
+      ERROR (NULL, -1,
+	     "a mapped context has no matrix; call tr_materialize() first");
+    }
+  return ctx->m;
+}
+
+int
+tr_stride (tr_context ctx)
+{
+  if (ctx->rec != NULL)
+    {
+      ERROR (0, -1,
+	     "a mapped context has no matrix; call tr_materialize() first");
+    }
+  return ctx->ld;
 }
 
 float *tr_new_trace_1 (int l);
@@ -337,6 +1728,12 @@ void tr_sqrt_1 (int l, float *dest, float *src);
 void tr_abs_1 (int l, float *dest, float *src);
 float tr_min_1 (int l, float *t, int *idx);
 float tr_max_1 (int l, float *t, int *idx);
+float tr_diff_of_means_1 (int l, float *dest, float *src1, int n1,
+			  float *src2, int n2, int *idx);
+float tr_sub_absmax_1 (int l, float *dest, float *src1, float *src2,
+		       int *idx);
+void tr_axpy_1 (int l, float *dest, float a, float *src);
+void tr_acc_with_sqr_1 (int l, float *sum, float *sumsq, float *src);
 void tr_print_1 (int l, float *t);
 void tr_fprint_1 (int l, FILE * fp, float *t);
 
@@ -436,210 +1833,591 @@ tr_max (tr_context ctx, float *t, int *idx)
   return tr_max_1 (ctx->l, t, idx);
 }
 
-void
-tr_print (tr_context ctx, float *t)
+float
+tr_diff_of_means (tr_context ctx, float *dest, float *src1, int n1,
+		  float *src2, int n2, int *idx)
+{
+  return tr_diff_of_means_1 (ctx->l, dest, src1, n1, src2, n2, idx);
+}
+
+float
+tr_sub_absmax (tr_context ctx, float *dest, float *src1, float *src2,
+	       int *idx)
+{
+  return tr_sub_absmax_1 (ctx->l, dest, src1, src2, idx);
+}
+
+void
+tr_axpy (tr_context ctx, float *dest, float a, float *src)
+{
+  tr_axpy_1 (ctx->l, dest, a, src);
+}
+
+void
+tr_acc_with_sqr (tr_context ctx, float *sum, float *sumsq, float *src)
+{
+  tr_acc_with_sqr_1 (ctx->l, sum, sumsq, src);
+}
+
+void
+tr_print (tr_context ctx, float *t)
+{
+  tr_print_1 (ctx->l, t);
+}
+
+void
+tr_fprint (tr_context ctx, FILE * fp, float *t)
+{
+  tr_fprint_1 (ctx->l, fp, t);
+}
+
+float *
+tr_new_trace_1 (int l)
+{
+  return tr_alloc (tr_ld (l));
+}
+
+void
+tr_free_trace_1 (int l, float *t)
+{
+  free (t);
+}
+
+void
+tr_init_trace_1 (int l, float *t, float val)
+{
+  int i;
+
+  for (i = 0; i < l; i++)
+    {
+      t[i] = val;
+    }
+}
+
+void
+tr_copy_1 (int l, float *dest, float *src)
+{
+  int i;
+
+  for (i = 0; i < l; i++)
+    {
+      dest[i] = src[i];
+    }
+}
+
+/* A set of kernels of the arithmetic functions, for one instruction set. The
+ * kernels do not check their inputs: tr_div_1() and tr_sqrt_1() first scan
+ * them with any_zero and any_negative. */
+typedef struct
+{
+  void (*acc) (int, float *, float *);
+  void (*add) (int, float *, float *, float *);
+  void (*sub) (int, float *, float *, float *);
+  void (*mul) (int, float *, float *, float *);
+  void (*div) (int, float *, float *, float *);
+  void (*scalar_mul) (int, float *, float *, float);
+  void (*scalar_div) (int, float *, float *, float);
+  void (*sqr) (int, float *, float *);
+  void (*sqrt) (int, float *, float *);
+  void (*abs) (int, float *, float *);
+  float (*min) (int, float *, int *);
+  float (*max) (int, float *, int *);
+  int (*any_zero) (int, float *);
+  int (*any_negative) (int, float *);
+  float (*diff_of_means) (int, float *, float *, float, float *, float, int *);
+  float (*sub_absmax) (int, float *, float *, float *, int *);
+  void (*axpy) (int, float *, float, float *);
+  void (*acc_sqr) (int, float *, float *, float *);
+} tr_kernels;
+
+static void
+tr_acc_scalar (int l, float *dest, float *src)
+{
+  int i;
+
+  for (i = 0; i < l; i++)
+    {
+      dest[i] += src[i];
+    }
+}
+
+static void
+tr_add_scalar (int l, float *dest, float *src1, float *src2)
+{
+  int i;
+
+  for (i = 0; i < l; i++)
+    {
+      dest[i] = src1[i] + src2[i];
+    }
+}
+
+static void
+tr_sub_scalar (int l, float *dest, float *src1, float *src2)
+{
+  int i;
+
+  for (i = 0; i < l; i++)
+    {
+      dest[i] = src1[i] - src2[i];
+    }
+}
+
+static void
+tr_mul_scalar (int l, float *dest, float *src1, float *src2)
+{
+  int i;
+
+  for (i = 0; i < l; i++)
+    {
+      dest[i] = src1[i] * src2[i];
+    }
+}
+
+static void
+tr_div_scalar (int l, float *dest, float *src1, float *src2)
+{
+  int i;
+
+  for (i = 0; i < l; i++)
+    {
+      dest[i] = src1[i] / src2[i];
+    }
+}
+
+static void
+tr_scalar_mul_scalar (int l, float *dest, float *src, float val)
+{
+  int i;
+
+  for (i = 0; i < l; i++)
+    {
+      dest[i] = src[i] * val;
+    }
+}
+
+static void
+tr_scalar_div_scalar (int l, float *dest, float *src, float val)
+{
+  int i;
+
+  for (i = 0; i < l; i++)
+    {
+      dest[i] = src[i] / val;
+    }
+}
+
+static void
+tr_sqr_scalar (int l, float *dest, float *src)
+{
+  int i;
+
+  for (i = 0; i < l; i++)
+    {
+      dest[i] = src[i] * src[i];
+    }
+}
+
+static void
+tr_sqrt_scalar (int l, float *dest, float *src)
+{
+  int i;
+
+  for (i = 0; i < l; i++)
+    {
+      dest[i] = sqrt (src[i]);
+    }
+}
+
+static void
+tr_abs_scalar (int l, float *dest, float *src)
+{
+  int i;
+
+  for (i = 0; i < l; i++)
+    {
+      dest[i] = fabs (src[i]);
+    }
+}
+
+static float
+tr_min_scalar (int l, float *t, int *idx)
+{
+  int i;
+  float min;
+
+  min = t[0];
+  *idx = 0;
+  for (i = 1; i < l; i++)
+    {
+      if (t[i] < min)
+	{
+	  min = t[i];
+	  *idx = i;
+	}
+    }
+  return min;
+}
+
+static float
+tr_max_scalar (int l, float *t, int *idx)
 {
-  tr_print_1 (ctx->l, t);
-}
+  int i;
+  float max;
 
-void
-tr_fprint (tr_context ctx, FILE * fp, float *t)
-{
-  tr_fprint_1 (ctx->l, fp, t);
+  max = t[0];
+  *idx = 0;
+  for (i = 1; i < l; i++)
+    {
+      if (t[i] > max)
+	{
+	  max = t[i];
+	  *idx = i;
+	}
+    }
+  return max;
 }
 
-float *
-tr_new_trace_1 (int l)
+static int
+tr_any_zero_scalar (int l, float *t)
 {
-  return XCALLOC (l, sizeof (float));
-}
+  int i;
 
-void
-tr_free_trace_1 (int l, float *t)
-{
-  free (t);
+  for (i = 0; i < l; i++)
+    {
+      if (t[i] == 0.0)
+	{
+	  return 1;
+	}
+    }
+  return 0;
 }
 
-void
-tr_init_trace_1 (int l, float *t, float val)
+static int
+tr_any_negative_scalar (int l, float *t)
 {
   int i;
 
   for (i = 0; i < l; i++)
     {
-      t[i] = val;
+      if (t[i] < 0.0)
+	{
+	  return 1;
+	}
     }
+  return 0;
 }
 
-void
-tr_copy_1 (int l, float *dest, float *src)
+static float
+tr_diff_of_means_scalar (int l, float *dest, float *src1, float n1,
+			 float *src2, float n2, int *idx)
 {
   int i;
+  float max;
 
-  for (i = 0; i < l; i++)
+  dest[0] = src1[0] / n1 - src2[0] / n2;
+  max = dest[0];
+  *idx = 0;
+  for (i = 1; i < l; i++)
     {
-      dest[i] = src[i];
+      dest[i] = src1[i] / n1 - src2[i] / n2;
+      if (dest[i] > max)
+	{
+	  max = dest[i];
+	  *idx = i;
+	}
     }
+  return max;
 }
 
-void
-tr_acc_1 (int l, float *dest, float *src)
+static float
+tr_sub_absmax_scalar (int l, float *dest, float *src1, float *src2, int *idx)
 {
   int i;
+  float max;
 
-  for (i = 0; i < l; i++)
+  dest[0] = src1[0] - src2[0];
+  max = fabs (dest[0]);
+  *idx = 0;
+  for (i = 1; i < l; i++)
     {
-      dest[i] += src[i];
+      dest[i] = src1[i] - src2[i];
+      if (fabs (dest[i]) > max)
+	{
+	  max = fabs (dest[i]);
+	  *idx = i;
+	}
     }
+  return max;
 }
 
-void
-tr_add_1 (int l, float *dest, float *src1, float *src2)
+static void
+tr_axpy_scalar (int l, float *dest, float a, float *src)
 {
   int i;
 
   for (i = 0; i < l; i++)
     {
-      dest[i] = src1[i] + src2[i];
+      dest[i] += a * src[i];
     }
 }
 
-void
-tr_sub_1 (int l, float *dest, float *src1, float *src2)
+static void
+tr_acc_sqr_scalar (int l, float *sum, float *sumsq, float *src)
 {
   int i;
 
   for (i = 0; i < l; i++)
     {
-      dest[i] = src1[i] - src2[i];
+      sum[i] += src[i];
+      sumsq[i] += src[i] * src[i];
     }
 }
 
-void
-tr_scalar_mul_1 (int l, float *dest, float *src, float val)
+static const tr_kernels tr_scalar_kernels = {
+  tr_acc_scalar, tr_add_scalar, tr_sub_scalar, tr_mul_scalar, tr_div_scalar,
+  tr_scalar_mul_scalar, tr_scalar_div_scalar, tr_sqr_scalar, tr_sqrt_scalar,
+  tr_abs_scalar, tr_min_scalar, tr_max_scalar, tr_any_zero_scalar,
+  tr_any_negative_scalar, tr_diff_of_means_scalar, tr_sub_absmax_scalar,
+  tr_axpy_scalar, tr_acc_sqr_scalar
+};
+
+#if defined (__x86_64__) && defined (__GNUC__)
+#define TR_X86_64
+#include <immintrin.h>
+
+typedef float tr_v4sf __attribute__ ((vector_size (16)));
+typedef int32_t tr_v4si __attribute__ ((vector_size (16)));
+typedef float tr_v8sf __attribute__ ((vector_size (32)));
+typedef int32_t tr_v8si __attribute__ ((vector_size (32)));
+typedef float tr_v16sf __attribute__ ((vector_size (64)));
+typedef int32_t tr_v16si __attribute__ ((vector_size (64)));
+
+#define TR_VEC tr_v4sf
+#define TR_IVEC tr_v4si
+#define TR_LANES 4
+#define TR_SQRT(v) _mm_sqrt_ps (v)
+#define TR_MIN(a, b) _mm_min_ps (a, b)
+#define TR_MAX(a, b) _mm_max_ps (a, b)
+#define TR_ANY(e) _mm_movemask_ps ((__m128) (e))
+#define TR_NAME(f) tr_sse_ ## f
+#include "traces_simd.h"
+#undef TR_VEC
+#undef TR_IVEC
+#undef TR_LANES
+#undef TR_SQRT
+#undef TR_MIN
+#undef TR_MAX
+#undef TR_ANY
+#undef TR_NAME
+
+#pragma GCC push_options
+#pragma GCC target ("avx2")
+#define TR_VEC tr_v8sf
+#define TR_IVEC tr_v8si
+#define TR_LANES 8
+#define TR_SQRT(v) _mm256_sqrt_ps (v)
+#define TR_MIN(a, b) _mm256_min_ps (a, b)
+#define TR_MAX(a, b) _mm256_max_ps (a, b)
+#define TR_ANY(e) _mm256_movemask_ps ((__m256) (e))
+#define TR_NAME(f) tr_avx2_ ## f
+#include "traces_simd.h"
+#undef TR_VEC
+#undef TR_IVEC
+#undef TR_LANES
+#undef TR_SQRT
+#undef TR_MIN
+#undef TR_MAX
+#undef TR_ANY
+#undef TR_NAME
+#pragma GCC pop_options
+
+/* AVX-512F implies FMA: the contraction of tr_axpy() and tr_acc_with_sqr()
+ * would round differently from the other backends. */
+#pragma GCC push_options
+#pragma GCC target ("avx2,avx512f")
+#pragma GCC optimize ("fp-contract=off")
+#define TR_VEC tr_v16sf
+#define TR_IVEC tr_v16si
+#define TR_LANES 16
+#define TR_SQRT(v) _mm512_sqrt_ps (v)
+#define TR_MIN(a, b) _mm512_min_ps (a, b)
+#define TR_MAX(a, b) _mm512_max_ps (a, b)
+#define TR_ANY(e) _mm512_test_epi32_mask ((__m512i) (e), (__m512i) (e))
+#define TR_NAME(f) tr_avx512_ ## f
+#include "traces_simd.h"
+#undef TR_VEC
+#undef TR_IVEC
+#undef TR_LANES
+#undef TR_SQRT
+#undef TR_MIN
+#undef TR_MAX
+#undef TR_ANY
+#undef TR_NAME
+#pragma GCC pop_options
+#endif /* x86-64 */
+
+/* Kernels of the arithmetic functions and their backend, selected at startup
+ * by tr_simd_init(). */
+static const tr_kernels *tr_kernel = &tr_scalar_kernels;
+static int tr_current_backend = TR_BACKEND_SCALAR;
+
+/* Selects the widest instruction set supported by the processor, once, at
+ * program startup. */
+static void __attribute__ ((constructor))
+tr_simd_init (void)
 {
-  int i;
+  tr_set_backend (TR_BACKEND_AVX512);
+}
 
-  for (i = 0; i < l; i++)
+int
+tr_set_backend (int backend)
+{
+  if (backend < TR_BACKEND_SCALAR || backend > TR_BACKEND_AVX512)
     {
-      dest[i] = src[i] * val;
+      ERROR (0, -1, "unknown backend: %d", backend);
+    }
+  tr_kernel = &tr_scalar_kernels;
+  tr_current_backend = TR_BACKEND_SCALAR;
+#ifdef TR_X86_64
+  __builtin_cpu_init ();
+  if (backend >= TR_BACKEND_AVX512 && __builtin_cpu_supports ("avx512f"))
+    {
+      tr_kernel = &tr_avx512_kernels;
+      tr_current_backend = TR_BACKEND_AVX512;
+    }
+  else if (backend >= TR_BACKEND_AVX2 && __builtin_cpu_supports ("avx2"))
+    {
+      tr_kernel = &tr_avx2_kernels;
+      tr_current_backend = TR_BACKEND_AVX2;
+    }
+  else if (backend >= TR_BACKEND_SSE)
+    {
+      tr_kernel = &tr_sse_kernels;
+      tr_current_backend = TR_BACKEND_SSE;
     }
+#endif
+  return tr_current_backend;
+}
+
+int
+tr_backend (void)
+{
+  return tr_current_backend;
 }
 
 void
-tr_scalar_div_1 (int l, float *dest, float *src, float val)
+tr_acc_1 (int l, float *dest, float *src)
 {
-  int i;
+  tr_kernel->acc (l, dest, src);
+}
+
+void
+tr_add_1 (int l, float *dest, float *src1, float *src2)
+{
+  tr_kernel->add (l, dest, src1, src2);
+}
 
+void
+tr_sub_1 (int l, float *dest, float *src1, float *src2)
+{
+  tr_kernel->sub (l, dest, src1, src2);
+}
+
+void
+tr_scalar_mul_1 (int l, float *dest, float *src, float val)
+{
+  tr_kernel->scalar_mul (l, dest, src, val);
+}
+
+void
+tr_scalar_div_1 (int l, float *dest, float *src, float val)
+{
   if (val == 0.0)
     {
       ERROR ((void) 0, -1, "division by zero");
     }
-  for (i = 0; i < l; i++)
-    {
-      dest[i] = src[i] / val;
-    }
+  tr_kernel->scalar_div (l, dest, src, val);
 }
 
 void
 tr_mul_1 (int l, float *dest, float *src1, float *src2)
 {
-  int i;
-
-  for (i = 0; i < l; i++)
-    {
-      dest[i] = src1[i] * src2[i];
-    }
+  tr_kernel->mul (l, dest, src1, src2);
 }
 
 void
 tr_div_1 (int l, float *dest, float *src1, float *src2)
 {
-  int i;
-
-  for (i = 0; i < l; i++)
+  if (tr_kernel->any_zero (l, src2))
     {
-      if (src2[i] == 0.0)
-	{
-	  ERROR ((void) 0, -1, "division by zero");
-	}
-      dest[i] = src1[i] / src2[i];
+      ERROR ((void) 0, -1, "division by zero");
     }
+  tr_kernel->div (l, dest, src1, src2);
 }
 
 void
 tr_sqr_1 (int l, float *dest, float *src)
 {
-  int i;
-
-  for (i = 0; i < l; i++)
-    {
-      dest[i] = src[i] * src[i];
-    }
+  tr_kernel->sqr (l, dest, src);
 }
 
 void
 tr_sqrt_1 (int l, float *dest, float *src)
 {
-  int i;
-
-  for (i = 0; i < l; i++)
+  if (tr_kernel->any_negative (l, src))
     {
-      if (src[i] < 0.0)
-	{
-	  ERROR ((void) 0, -1, "negative value");
-	}
-      dest[i] = sqrt (src[i]);
+      ERROR ((void) 0, -1, "negative value");
     }
+  tr_kernel->sqrt (l, dest, src);
 }
 
 void
 tr_abs_1 (int l, float *dest, float *src)
 {
-  int i;
-
-  for (i = 0; i < l; i++)
-    {
-      dest[i] = fabs (src[i]);
-    }
+  tr_kernel->abs (l, dest, src);
 }
 
 float
 tr_min_1 (int l, float *t, int *idx)
 {
-  int i;
-  float min;
-
-  min = t[0];
-  *idx = 0;
-  for (i = 1; i < l; i++)
-    {
-      if (t[i] < min)
-	{
-	  min = t[i];
-	  *idx = i;
-	}
-    }
-  return min;
+  return tr_kernel->min (l, t, idx);
 }
 
 float
 tr_max_1 (int l, float *t, int *idx)
 {
-  int i;
-  float max;
+  return tr_kernel->max (l, t, idx);
+}
 
-  max = t[0];
-  *idx = 0;
-  for (i = 1; i < l; i++)
+float
+tr_diff_of_means_1 (int l, float *dest, float *src1, int n1, float *src2,
+		    int n2, int *idx)
+{
+  if (n1 == 0 || n2 == 0)
     {
-      if (t[i] > max)
-	{
-	  max = t[i];
-	  *idx = i;
-	}
+      ERROR (0.0, -1, "division by zero");
     }
-  return max;
+  return tr_kernel->diff_of_means (l, dest, src1, (float) (n1), src2,
+				   (float) (n2), idx);
+}
+
+float
+tr_sub_absmax_1 (int l, float *dest, float *src1, float *src2, int *idx)
+{
+  return tr_kernel->sub_absmax (l, dest, src1, src2, idx);
+}
+
+void
+tr_axpy_1 (int l, float *dest, float a, float *src)
+{
+  tr_kernel->axpy (l, dest, a, src);
+}
+
+void
+tr_acc_with_sqr_1 (int l, float *sum, float *sumsq, float *src)
+{
+  tr_kernel->acc_sqr (l, sum, sumsq, src);
 }
 
 void
@@ -715,3 +2493,146 @@ tr_plot (tr_context ctx, char *prefix, int n, int i, float **t)
   fclose (fpc);
   free (fname);
 }
+
+struct tr_stats_s
+{
+  int l;			/* Number of points per trace */
+  int64_t n;			/* Number of traces */
+  double *mean;			/* Per-point mean */
+  double *m2;			/* Per-point sum of squared deviations */
+};
+
+tr_stats
+tr_stats_init (tr_context ctx)
+{
+  tr_stats st;
+
+  st = XCALLOC (1, sizeof (struct tr_stats_s));
+  st->l = ctx->l;
+  st->n = 0;
+  st->mean = XCALLOC (st->l, sizeof (double));
+  st->m2 = XCALLOC (st->l, sizeof (double));
+  return st;
+}
+
+void
+tr_stats_free (tr_stats st)
+{
+  free (st->mean);
+  free (st->m2);
+  free (st);
+}
+
+void
+tr_stats_add (tr_stats st, float *t)
+{
+  int i;
+  double r, d;
+
+  st->n += 1;
+  r = 1.0 / (double) (st->n);
+  for (i = 0; i < st->l; i++)
+    {
+      d = (double) (t[i]) - st->mean[i];
+      st->mean[i] += d * r;
+      st->m2[i] += d * ((double) (t[i]) - st->mean[i]);
+    }
+}
+
+void
+tr_stats_add_batch (tr_stats st, tr_context ctx)
+{
+  int i;
+
+  if (ctx->l != st->l)
+    {
+      ERROR ((void) 0, -1, "length mismatch: %d (accumulator: %d)", ctx->l, st->l);
+    }
+  for (i = 0; i < ctx->n; i++)
+    {
+      tr_stats_add (st, tr_trace (ctx, i));
+    }
+}
+
+/* Pairwise combination of Chan, Golub and LeVeque. */
+void
+tr_stats_merge (tr_stats dest, tr_stats src)
+{
+  int i;
+  int64_t n;
+  double a, b, d;
+
+  if (src->l != dest->l)
+    {
+      ERROR ((void) 0, -1, "length mismatch: %d (accumulator: %d)", src->l, dest->l);
+    }
+  if (src->n == 0)
+    {
+      return;
+    }
+  n = dest->n + src->n;
+  a = (double) (src->n) / (double) (n);
+  b = (double) (dest->n) * a;
+  for (i = 0; i < dest->l; i++)
+    {
+      d = src->mean[i] - dest->mean[i];
+      dest->mean[i] += d * a;
+      dest->m2[i] += src->m2[i] + d * d * b;
+    }
+  dest->n = n;
+}
+
+int64_t
+tr_stats_number (tr_stats st)
+{
+  return st->n;
+}
+
+void
+tr_stats_mean (tr_stats st, float *dest)
+{
+  int i;
+
+  if (st->n == 0)
+    {
+      ERROR ((void) 0, -1, "no traces");
+    }
+  for (i = 0; i < st->l; i++)
+    {
+      dest[i] = st->mean[i];
+    }
+}
+
+void
+tr_stats_variance (tr_stats st, float *dest)
+{
+  int i;
+  double r;
+
+  if (st->n < 2)
+    {
+      ERROR ((void) 0, -1, "less than two traces");
+    }
+  r = 1.0 / (double) (st->n - 1);
+  for (i = 0; i < st->l; i++)
+    {
+      dest[i] = st->m2[i] * r;
+    }
+}
+
+void
+tr_stats_std (tr_stats st, float *dest)
+{
+  int i;
+  double r;
+
+  if (st->n < 2)
+    {
+      ERROR ((void) 0, -1, "less than two traces");
+    }
+  r = 1.0 / (double) (st->n - 1);
+  for (i = 0; i < st->l; i++)
+    {
+      dest[i] = sqrt (st->m2[i] * r);
+    }
+}
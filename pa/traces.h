@@ -32,6 +32,39 @@
  * A trace file containing 50 traces, 100 points each will thus be 20813 bytes
  * long: 5 + 4 + 4 + 50 * (8 + 8 + 100 * 4).
  *
+ * The version 2 of the format stores the samples in a smaller type and can
+ * compress the records. Its header is HWSECV2HEADERSIZE bytes long:
+ * <ol>
+ * <li>"HWSv2" (a 5 bytes magic number)</li>
+ * <li>T, the sample type (1 byte, one of TR_SAMPLE_INT8, TR_SAMPLE_INT16,
+ * TR_SAMPLE_FP16 or TR_SAMPLE_FLOAT32)</li>
+ * <li>Z, the compression (1 byte, TR_COMPRESS_NONE or TR_COMPRESS_LZ)</li>
+ * <li>Y, the layout (1 byte, TR_LAYOUT_TRACE or TR_LAYOUT_SAMPLE)</li>
+ * <li>N, L and K, as in version 1</li>
+ * <li>S and O, the scale and offset of the samples (two 4 bytes floats)</li>
+ * <li>B, the number of traces per compressed block (a 4 bytes unsigned
+ * integer, zero if Z is TR_COMPRESS_NONE)</li>
+ * <li>12 reserved bytes (zero)</li>
+ * </ol>
+ * The records (plaintext, ciphertext and L samples of the size of T, in this
+ * order) follow. A sample x of type TR_SAMPLE_INT8, TR_SAMPLE_INT16 or
+ * TR_SAMPLE_FP16 stands for the point x * S + O; TR_SAMPLE_FLOAT32 samples are
+ * the points. If Z is TR_COMPRESS_LZ the records are grouped by blocks of B
+ * (the last one may be shorter) and each block is stored as its size R (a 4
+ * bytes unsigned integer), the size C of its compressed form (idem) and the C
+ * bytes of its compressed form, in the LZ4 block format. If C = R the block is
+ * stored uncompressed.
+ *
+ * The records are trace-major (TR_LAYOUT_TRACE). In sample-major files
+ * (TR_LAYOUT_SAMPLE, never compressed) the N plaintexts come first, then the N
+ * ciphertexts, then the L columns: the N samples of point 0, the N samples of
+ * point 1, etc. The per-point statistics then read contiguous columns and
+ * tr_init_window() and tr_stream_window() read only the columns of their
+ * window. tr_transpose() converts a file to this layout. All the functions
+ * that read trace files accept the two versions and the two layouts and
+ * convert the samples to floats on the fly; the contexts and the batches are
+ * always trace-major in memory.
+ *
  * Reading a trace file is done by a call to tr_init() which initializes
  * and returns a tr_context: \code
  * #include <traces.h>
@@ -89,20 +122,65 @@
 #define TRACES_H
 
 #include <stdio.h>
+#include <stddef.h>
 #include <inttypes.h>
 
 /** Magic number identifying trace files in HWSec format. */
 #define HWSECMAGICNUMBER "HWSec"
 
+/** Size of the header of trace files in HWSec format: magic number, N, L and K. */
+#define HWSECHEADERSIZE 21
+
+/** Magic number identifying trace files in HWSec format, version 2. */
+#define HWSECV2MAGICNUMBER "HWSv2"
+
+/** Size of the header of trace files in HWSec format, version 2. */
+#define HWSECV2HEADERSIZE 48
+
+/** Sample types of the trace files in HWSec format, version 2. */
+#define TR_SAMPLE_INT8 0
+#define TR_SAMPLE_INT16 1
+#define TR_SAMPLE_FP16 2
+#define TR_SAMPLE_FLOAT32 3
+
+/** Output format of tr_convert() for trace files in HWSec format, version 1. */
+#define TR_VERSION1 4
+
+/** Layouts of the trace files in HWSec format, version 2: trace-major
+ * (records) or sample-major (columns). */
+#define TR_LAYOUT_TRACE 0
+#define TR_LAYOUT_SAMPLE 1
+
+/** Compression of the records of the trace files in HWSec format, version 2. */
+#define TR_COMPRESS_NONE 0
+#define TR_COMPRESS_LZ 1
+
+/** Default number of traces per compressed block of tr_dump_v2(). */
+#define TR_LZ_BLOCK 64
+
+/** Size, in bytes, of the largest trace files that tr_init_mmap() pre-loads. */
+#define TR_MMAP_POPULATE (UINT64_C (1) << 30)
+
+/** Alignment, in bytes, of the power traces of the contexts and of the traces
+ * allocated by tr_new_trace(). */
+#define TR_ALIGN 64
+
 /** The data structure used to manage a set of traces */
 struct tr_context_s
 {
   int n;			/**< Number of traces in the context */
   int l;			/**< Number of points per trace */
   uint64_t k;			/**< Secret key */
-  uint64_t *p;			/**< Plaintexts */
-  uint64_t *c;			/**< Ciphertexts */
-  float **t;			/**< Power traces */
+  uint64_t *p;			/**< Plaintexts (NULL if mapped) */
+  uint64_t *c;			/**< Ciphertexts (NULL if mapped) */
+  float *m;			/**< Power traces, a n x l matrix stored by rows of ld floats (NULL if mapped) */
+  int ld;			/**< Number of floats between the starts of two consecutive rows of m, a multiple of TR_ALIGN / 4 */
+  char *map;			/**< Memory mapping of the trace file (NULL if the traces are in memory or if the context is a view) */
+  size_t size;			/**< Size of the mapping in bytes */
+  char *rec;			/**< First record (plaintext, ciphertext, trace) in the mapping (NULL if the traces are in memory) */
+  size_t stride;		/**< Size of a record in the mapping, in bytes */
+  size_t off;			/**< Offset of the first point of the trace in a record of the mapping, in bytes */
+  int view;			/**< Non-zero if the context is a view, that shares the storage of another context */
 };
 
 /** Pointer to the data structure */
@@ -120,11 +198,102 @@ tr_context tr_init (char *filename,
     /** Maximum number of traces to read from the file (read all traces if 0) */
 		    int max);
 
-/** Closes and deallocates the previously initialized context. */
+/** Same as tr_init() but maps the trace file in memory, read-only, instead of
+ * reading it. Zero-copy only for the uncompressed, trace-major,
+ * TR_SAMPLE_FLOAT32 files of version 2: the plaintexts, ciphertexts and power
+ * traces are accessed directly in the mapping, through the usual accessors
+ * (tr_plaintext(), tr_ciphertext(), tr_trace()), opening a context is almost
+ * free, whatever the file size, and the traces do not use any memory besides
+ * the page cache. Files up to TR_MMAP_POPULATE bytes are pre-loaded
+ * (MAP_POPULATE), larger ones are read ahead sequentially by the kernel
+ * (madvise()).
+ * \attention
+ * <ol>
+ * <li>tr_init_mmap() is NOT zero-copy for files of version 1, nor for the
+ * other files of version 2: they are decoded from the mapping into memory,
+ * exactly as tr_init() would (same memory footprint), and unmapped. In files of
+ * version 1 the samples are not aligned on 4 bytes (the header is 21 bytes
+ * long) and cannot be accessed in place as floats. To process such files in
+ * bounded memory use a stream (see tr_stream_open()); to access them in place
+ * convert them once, out of core, with tr_convert() (tool tr_convert, type
+ * float32, no compression: -t float32 -z 0).</li>
+ * <li>The power traces of a mapped context are read-only: do not use them as
+ * destination of the arithmetic functions. tr_trim() and tr_select() only
+ * update the context, as for a view (see tr_view()); tr_shrink(),
+ * tr_matrix() and tr_stride() exit with an error: call tr_materialize() first
+ * to copy the context in memory, as tr_init() would have.</li>
+ * <li>If the file cannot be mapped, the function falls back to tr_init().</li>
+ * </ol>
+ * \return the initialized context. */
+tr_context tr_init_mmap (char *filename,
+		    /**< Name of the trace file in HWSec format */
+    /** Maximum number of traces to map from the file (map all traces if 0) */
+			 int max);
+
+/** Same as tr_init() followed by tr_trim() to <b>length</b> points, starting
+ * from point number <b>first_index</b>, but only decodes the points of this
+ * window. In sample-major files (see TR_LAYOUT_SAMPLE) only the columns of the
+ * window are read. \return the initialized context. */
+tr_context tr_init_window (char *filename,
+		    /**< Name of the trace file in HWSec format */
+    /** Maximum number of traces to read from the file (read all traces if 0) */
+			   int max,
+			   int first_index, /**< Index of first point of the window. */
+			   int length
+			   /**< Number of points of the window. */
+  );
+
+/** Creates a view of the context: a context made of <b>n</b> of its traces,
+ * starting from trace number <b>first_trace</b>, each restricted to
+ * <b>length</b> points, starting from point number <b>first_index</b>. The
+ * view shares the plaintexts, ciphertexts and power traces of the context:
+ * its creation takes a constant time, whatever the size of the context. On a
+ * view, tr_trim() and tr_select() also take a constant time and the result is
+ * still a view. Example, to search a window without copying the traces:
+ * \code
+ * for (i = 0; i + 50 <= tr_length (ctx); i += 10)
+ *   {
+ *     v = tr_view (ctx, 0, tr_number (ctx), i, 50);
+ *     ... // attack v
+ *     tr_free (v);
+ *   }
+ * \endcode
+ * \attention
+ * <ol>
+ * <li>The context must not be modified (tr_trim(), tr_select(), tr_shrink(),
+ * tr_materialize()) or freed while it has views.</li>
+ * <li>The power traces of a view are those of the context: using them as
+ * destination of the arithmetic functions also modifies the context.</li>
+ * <li>The rows of tr_matrix() of a view are aligned on TR_ALIGN bytes only if
+ * <b>first_index</b> is a multiple of TR_ALIGN / 4.</li>
+ * </ol>
+ * \return the view. */
+tr_context tr_view (tr_context ctx,
+		    /**< The context. */
+		    int first_trace,
+		     /**< Index of first trace of the view. */
+		    int n,
+		     /**< Number of traces of the view. */
+		    int first_index,
+		    /**< The index of first point of the traces of the view. */
+		    int length
+		    /**< The number of points of the traces of the view. */
+  );
+
+/** Copies the plaintexts, ciphertexts and power traces of a view or of a
+ * mapped context (see tr_view() and tr_init_mmap()) in memory, as tr_init()
+ * would have read them, such that the context no longer depends on another
+ * context or on the trace file. Does nothing if the context is neither a view
+ * nor mapped. */
+void tr_materialize (tr_context ctx /**< The context. */ );
+
+/** Closes and deallocates the previously initialized context. The storage of a
+ * view belongs to its context: it is not freed. */
 void tr_free (tr_context ctx /**< The context. */ );
 
 /** Trim all the traces of the context, keeping only <b>length</b> 
- * points, starting from point number <b>first_index</b> */
+ * points, starting from point number <b>first_index</b>. In place, without
+ * allocation; constant time on views and mapped contexts. */
 void tr_trim (tr_context ctx,
 		    /**< The context. */
 	      int first_index,
@@ -134,7 +303,8 @@ void tr_trim (tr_context ctx,
   );
 
 /** Selects <b>n</b> traces of the context, starting from trace number <b>first_trace</b>,
- * and discards the others */
+ * and discards the others. In place, without allocation; constant time on
+ * views and mapped contexts. */
 void tr_select (tr_context ctx,
 		    /**< The context. */
 		int first_trace,
@@ -145,7 +315,8 @@ void tr_select (tr_context ctx,
 
 /** Shrink all the traces of the context, by replacing each chunk of
  * <b>chunk_size</b> points by their sum. If incomplete, the last chunk is
- * discarded */
+ * discarded. In place: views and mapped contexts must be copied in memory
+ * first (see tr_materialize()). */
 void tr_shrink (tr_context ctx,
 		    /**< The context. */
 		int chunk_size
@@ -159,6 +330,137 @@ void tr_dump (tr_context ctx,
 		   /**< Name of output HWSec trace file. */
   );
 
+/** Writes the context in a HWSec trace file <b>filename</b>, version 2, with
+ * samples of type <b>type</b>. Each point p is stored as the sample nearest to
+ * (p - <b>offset</b>) / <b>scale</b>; the integer samples saturate and a
+ * warning gives the number of saturated samples. If <b>scale</b> is zero or
+ * negative, the scale and offset are computed from the extreme points of the
+ * context so that the integer samples cover them exactly (1 and 0 for
+ * TR_SAMPLE_FP16). They are ignored (1 and 0) for TR_SAMPLE_FLOAT32, which
+ * does not lose anything. */
+void tr_dump_v2 (tr_context ctx,
+		    /**< The context. */
+		 char *filename, /**< Name of output HWSec trace file. */
+		 int type, /**< The sample type (TR_SAMPLE_INT8, TR_SAMPLE_INT16, TR_SAMPLE_FP16 or TR_SAMPLE_FLOAT32). */
+		 float scale, /**< The scale of the samples (automatic if zero or negative). */
+		 float offset, /**< The offset of the samples. */
+		 int block
+		   /**< Number of traces per compressed block (see TR_LZ_BLOCK); zero: no compression. */
+  );
+
+/***************************
+ * Streaming of trace files *
+ **************************/
+
+/** Default number of traces per batch of a stream. */
+#define TR_STREAM_BATCH 4096
+
+/** The data structure used to read a trace file by batches */
+typedef struct tr_stream_s *tr_stream;
+
+/** Opens the trace file <b>filename</b> for reading by batches of at most
+ * <b>batch</b> traces, in file order. Only two batches are in memory at any
+ * time, whatever the file size: while the caller processes a batch, a reader
+ * thread reads the next one. Example:
+ * \code
+ * tr_stream s;
+ * tr_context b;
+ * int i;
+ *
+ * s = tr_stream_open ("MyTraceFile.hws", 0, 0);
+ * while (tr_stream_next (s, &b))
+ *   {
+ *     for (i = 0; i < tr_number (b); i++)
+ *       {
+ *         ... // use tr_plaintext (b, i), tr_ciphertext (b, i), tr_trace (b, i)
+ *       }
+ *   }
+ * tr_stream_close (s);
+ * \endcode
+ * \return the opened stream. */
+tr_stream tr_stream_open (char *filename,
+		    /**< Name of the trace file in HWSec format */
+    /** Maximum number of traces to read from the file (read all traces if 0) */
+			  int max,
+    /** Maximum number of traces per batch (TR_STREAM_BATCH if 0) */
+			  int batch);
+
+/** Returns the next batch of a stream, as a context of at most
+ * <b>batch</b> traces (see tr_stream_open()). The batch belongs to the
+ * stream: it must not be modified nor freed and it is only valid until the
+ * next call to tr_stream_next() or tr_stream_close(). Its length and secret key
+ * are those of the file; its power traces can be used with all the functions
+ * of the library. \return the number of traces in the batch, zero (and NULL in
+ * <b>*batch</b>) when all traces have been read. */
+int tr_stream_next (tr_stream s,
+		    /**< The stream. */
+		    tr_context * batch
+		    /**< The batch. */
+  );
+
+/** Restricts the batches of stream <b>s</b> to <b>length</b> points,
+ * starting from point number <b>first_index</b>. Only the points of this
+ * window are decoded and, in sample-major files (see TR_LAYOUT_SAMPLE), only
+ * the columns of the window are read. Must be called before the first call to
+ * tr_stream_next(). */
+void tr_stream_window (tr_stream s,
+		    /**< The stream. */
+		       int first_index, /**< Index of first point of the window. */
+		       int length
+		       /**< Number of points of the window. */
+  );
+
+/** Returns the number of traces of a stream (all batches). \return The number
+ * of traces of the stream. */
+int tr_stream_number (tr_stream s
+		    /**< The stream. */
+  );
+
+/** Returns the number of points per trace of a stream (of its window, see
+ * tr_stream_window()). \return The number of points per trace of the
+ * stream. */
+int tr_stream_length (tr_stream s
+		    /**< The stream. */
+  );
+
+/** Stops the reader thread, closes the trace file and deallocates the stream
+ * and its batches. Can be called before the end of the stream. */
+void tr_stream_close (tr_stream s /**< The stream. */ );
+
+/** Converts the trace file <b>filename</b> (any version and layout) to the
+ * sample-major trace file <b>output</b> (HWSec format, version 2, see
+ * TR_LAYOUT_SAMPLE) with samples of type <b>type</b>, quantized as by
+ * tr_dump_v2(). The input is streamed: each batch is transposed in memory by
+ * cache-sized tiles and written as one segment of each column, so that the
+ * memory footprint does not depend on the file size. With automatic scaling
+ * the input is read twice. */
+void tr_transpose (char *filename,
+		    /**< Name of the input trace file. */
+		   char *output, /**< Name of the output trace file. */
+		   int type, /**< The sample type (see tr_dump_v2()). */
+		   float scale, /**< The scale of the samples (automatic if zero or negative). */
+		   float offset
+		   /**< The offset of the samples. */
+  );
+
+/** Converts the first <b>max</b> traces (all if zero) of the trace file
+ * <b>filename</b> (any version and layout) to the trace-major trace file
+ * <b>output</b>, as tr_init() followed by tr_dump_v2(), or by tr_dump() if
+ * <b>type</b> is TR_VERSION1. The input is streamed (see tr_stream_open()) and
+ * the records are written as they are encoded, so that the memory footprint
+ * does not depend on the file size. With automatic scaling the input is read
+ * twice. */
+void tr_convert (char *filename,
+		    /**< Name of the input trace file. */
+		 char *output, /**< Name of the output trace file. */
+		 int max, /**< Maximum number of traces to convert (all if 0). */
+		 int type, /**< The sample type (see tr_dump_v2()) or TR_VERSION1. */
+		 float scale, /**< The scale of the samples (automatic if zero or negative). */
+		 float offset, /**< The offset of the samples. */
+		 int block
+		   /**< Number of traces per compressed block (see tr_dump_v2()). */
+  );
+
 /********************************************************************
  * Functions used to get information about a context or to retreive *
  * ciphertexts and power traces from it                             *
@@ -205,12 +507,34 @@ float *tr_trace (tr_context ctx,
       /**< Index of trace to return. */
   );
 
+/** Returns the power traces of the context as a single matrix: trace
+ * #<b>i</b> starts at index <b>i</b> * tr_stride() and its first point is
+ * aligned on TR_ALIGN bytes. The padding points at the end of each row are
+ * zero after tr_init() but unspecified after the other functions, and may be
+ * overwritten, for instance by vector kernels. The matrix of a view (see
+ * tr_view()) is a sub-matrix of the matrix of its context: its rows may be
+ * unaligned and its padding points belong to the context. A mapped context
+ * (see tr_init_mmap()) has no matrix: call tr_materialize() first. \return A
+ * pointer to the first point of the first trace. */
+float *tr_matrix (tr_context ctx
+		    /**< The context. */
+  );
+
+/** Returns the row stride of the matrix of the power traces (see tr_matrix()).
+ * A mapped context (see tr_init_mmap()) has no matrix: call tr_materialize()
+ * first. \return The number of floats between the first points of two
+ * consecutive traces, a multiple of TR_ALIGN / 4, at least tr_length(). */
+int tr_stride (tr_context ctx
+		    /**< The context. */
+  );
+
 /***********************************************************************
  * Functions used to create, destroy, initialize and copy power traces *
  ***********************************************************************/
 
 /** Allocates a new power trace which size is the size of the traces of the
- * context. \return A pointer to the allocated trace */
+ * context, aligned on TR_ALIGN bytes and padded with zeros up to a multiple of
+ * TR_ALIGN bytes. \return A pointer to the allocated trace */
 float *tr_new_trace (tr_context ctx
 		    /**< The context. */
   );
@@ -240,6 +564,39 @@ void tr_copy (tr_context ctx,
  * Arithmetic functions on traces *
  **********************************/
 
+/** Identifier of the portable backend of the arithmetic functions: scalar
+ * loops. */
+#define TR_BACKEND_SCALAR 0
+
+/** Identifier of the SSE backend of the arithmetic functions: 4 points per
+ * instruction. */
+#define TR_BACKEND_SSE 1
+
+/** Identifier of the AVX2 backend of the arithmetic functions: 8 points per
+ * instruction. */
+#define TR_BACKEND_AVX2 2
+
+/** Identifier of the AVX-512 backend of the arithmetic functions: 16 points per
+ * instruction. */
+#define TR_BACKEND_AVX512 3
+
+/** Selects the backend of the arithmetic functions of the library (tr_acc(),
+ * tr_add(), tr_sub(), tr_mul(), tr_div(), tr_scalar_mul(), tr_scalar_div(),
+ * tr_sqr(), tr_sqrt(), tr_abs(), tr_min(), tr_max() and the fused functions).
+ * At program startup the widest backend supported by the processor is
+ * selected. All backends compute the same results, bit for bit; the vector
+ * ones check the inputs of tr_div() and tr_sqrt() in a first vector pass.
+ * This function is mainly useful to compare the backends. It is not thread
+ * safe: call it before starting threads. \return The selected backend, the widest supported by the
+ * processor that is not wider than <b>backend</b>. */
+int tr_set_backend (int backend
+		    /**< One of TR_BACKEND_SCALAR, TR_BACKEND_SSE, TR_BACKEND_AVX2 or TR_BACKEND_AVX512. */
+  );
+
+/** Returns the backend currently used by the arithmetic functions. \return One
+ * of TR_BACKEND_SCALAR, TR_BACKEND_SSE, TR_BACKEND_AVX2 or TR_BACKEND_AVX512. */
+int tr_backend (void);
+
 /** Adds traces <b>src</b> and <b>dest</b> and stores the result in <b>dest</b>: <b>dest</b>[i] =
  * <b>dest</b>[i] + <b>src</b>[i].  The traces <b>dest</b> and <b>src</b> must be existing traces. */
 void tr_acc (tr_context ctx,
@@ -344,6 +701,61 @@ float tr_max (tr_context ctx,
 	      float *t,	/**< The trace. */
 	      int *idx /**< The argmax. */ );
 
+/** \name Fused functions
+ * Each of these functions computes in one pass over the points what would
+ * otherwise take several calls to the functions above, with the same results,
+ * bit for bit. They are meant for the inner loops of the attacks, where the
+ * traces do not fit in the caches and the memory traffic dominates. */
+/**@{*/
+
+/** Computes the difference of the means of two sets of traces from their sums
+ * and stores it in <b>dest</b>: <b>dest</b>[i] = <b>src1</b>[i] / <b>n1</b> -
+ * <b>src2</b>[i] / <b>n2</b>, and returns its maximum value and stores the
+ * index in *<b>idx</b>. Same as tr_scalar_div() of <b>src1</b> and
+ * <b>src2</b>, tr_sub() and tr_max(), without modifying the sums. Exits with
+ * an error if <b>n1</b> or <b>n2</b> is zero. \return The maximum value of
+ * <b>dest</b> and the corresponding index in *<b>idx</b>. */
+float tr_diff_of_means (tr_context ctx,
+		    /**< The context. */
+			float *dest, /**< The destination trace. */
+			float *src1, /**< The sum of the first set. */
+			int n1,	/**< The number of traces of the first set. */
+			float *src2, /**< The sum of the second set. */
+			int n2,	/**< The number of traces of the second set. */
+			int *idx /**< The argmax. */ );
+
+/** Subtracts trace <b>src2</b> from trace <b>src1</b> and stores the result in
+ * <b>dest</b>, as tr_sub(), and returns the maximum absolute value of the
+ * result and stores its index in *<b>idx</b>. \return The maximum of
+ * |<b>dest</b>[i]| and the corresponding index in *<b>idx</b>. */
+float tr_sub_absmax (tr_context ctx,
+		    /**< The context. */
+		     float *dest, /**< The destination trace. */
+		     float *src1, /**< The first source trace. */
+		     float *src2, /**< The second source trace. */
+		     int *idx /**< The argmax of the absolute value. */ );
+
+/** Adds trace <b>src</b> multiplied by the scalar <b>a</b> to trace
+ * <b>dest</b>: <b>dest</b>[i] += <b>a</b> * <b>src</b>[i]. The product is
+ * rounded before the addition (no fused multiply-add), as with
+ * tr_scalar_mul() and tr_acc(). */
+void tr_axpy (tr_context ctx,
+		    /**< The context. */
+	      float *dest, /**< The destination trace. */
+	      float a, /**< The scalar value. */
+	      float *src /**< The source trace. */ );
+
+/** Accumulates trace <b>src</b> and its square: <b>sum</b>[i] +=
+ * <b>src</b>[i] and <b>sumsq</b>[i] += <b>src</b>[i] * <b>src</b>[i], for
+ * the first and second order moments. */
+void tr_acc_with_sqr (tr_context ctx,
+		    /**< The context. */
+		      float *sum, /**< The sum of the traces. */
+		      float *sumsq, /**< The sum of the squared traces. */
+		      float *src /**< The source trace. */ );
+
+/**@}*/
+
 /** Prints trace <b>t</b> in ascii form, one point per line on standard output. */
 void tr_print (tr_context ctx,
 		    /**< The context. */
@@ -380,4 +792,83 @@ void tr_plot (tr_context ctx, /**< The context. */
 			  /**< The traces. */
   );
 
+/*************************************
+ * Online statistics of sets of traces *
+ *************************************/
+
+/** The data structure used to accumulate the per-point mean and variance of a
+ * set of traces. */
+typedef struct tr_stats_s *tr_stats;
+
+/** Creates an empty accumulator for traces of the length of context
+ * <b>ctx</b>. The traces are added one at a time or by batches, in a single
+ * pass; the per-point mean and sum of squared deviations are updated in double
+ * precision with Welford's algorithm, which does not lose precision with the
+ * number of traces as a float sum does. Accumulators fed with disjoint sets of
+ * traces, for instance by different threads, can be merged. Example:
+ * \code
+ * tr_stats st;
+ * float *avg;
+ *
+ * st = tr_stats_init (ctx);
+ * while (tr_stream_next (s, &b))
+ *   {
+ *     tr_stats_add_batch (st, b);
+ *   }
+ * avg = tr_new_trace (ctx);
+ * tr_stats_mean (st, avg);
+ * tr_stats_free (st);
+ * \endcode
+ * \return the new accumulator. */
+tr_stats tr_stats_init (tr_context ctx
+		    /**< The context. */
+  );
+
+/** Deallocates an accumulator. */
+void tr_stats_free (tr_stats st /**< The accumulator. */ );
+
+/** Adds trace <b>t</b> to accumulator <b>st</b>. */
+void tr_stats_add (tr_stats st,
+		    /**< The accumulator. */
+		   float *t /**< The trace. */ );
+
+/** Adds all the power traces of context <b>ctx</b> (for instance a batch of a
+ * stream) to accumulator <b>st</b>. Their length must be that of the
+ * accumulator. */
+void tr_stats_add_batch (tr_stats st,
+		    /**< The accumulator. */
+			 tr_context ctx /**< The context. */ );
+
+/** Merges accumulator <b>src</b> into accumulator <b>dest</b>, which then
+ * holds the statistics of the union of their sets of traces. <b>src</b> is
+ * left unchanged. The two accumulators must have the same length. */
+void tr_stats_merge (tr_stats dest,
+		    /**< The destination accumulator. */
+		     tr_stats src /**< The source accumulator. */ );
+
+/** Returns the number of traces added to an accumulator (merges included).
+ * \return the number of traces. */
+int64_t tr_stats_number (tr_stats st /**< The accumulator. */ );
+
+/** Stores the per-point mean of the traces of accumulator <b>st</b> in trace
+ * <b>dest</b>. Exits with an error if the accumulator is empty. */
+void tr_stats_mean (tr_stats st,
+		    /**< The accumulator. */
+		    float *dest /**< The destination trace. */ );
+
+/** Stores the per-point unbiased variance (sum of squared deviations divided
+ * by the number of traces minus one) of the traces of accumulator <b>st</b>
+ * in trace <b>dest</b>. Exits with an error if the accumulator holds less than
+ * two traces. */
+void tr_stats_variance (tr_stats st,
+		    /**< The accumulator. */
+			float *dest /**< The destination trace. */ );
+
+/** Stores the per-point standard deviation (square root of the variance of
+ * tr_stats_variance()) of the traces of accumulator <b>st</b> in trace
+ * <b>dest</b>. */
+void tr_stats_std (tr_stats st,
+		    /**< The accumulator. */
+		   float *dest /**< The destination trace. */ );
+
 #endif /* not TRACES_H */
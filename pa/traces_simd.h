@@ -0,0 +1,536 @@
+/*
+ * Copyright (C) Telecom Paris
+ *
+ * This file must be used under the terms of the CeCILL. This source
+ * file is licensed as described in the file COPYING, which you should
+ * have received as part of this distribution. The terms are also
+ * available at:
+ * http://www.cecill.info/licences/Licence_CeCILL_V1.1-US.txt
+*/
+
+/* Vector kernels of the arithmetic functions of the traces library,
+ * instruction set independent. Not a public header: it is included by
+ * traces.c once per instruction set, with the following macros defined:
+ * - TR_VEC: a GCC vector of TR_LANES floats,
+ * - TR_IVEC: a GCC vector of TR_LANES 32 bits integers,
+ * - TR_LANES: the number of floats in a TR_VEC,
+ * - TR_SQRT(v): the square roots of the lanes of v,
+ * - TR_MIN(a, b), TR_MAX(a, b): the minimums and maximums of the lanes of a
+ *   and b, b when a lane of a or b is a NaN,
+ * - TR_ANY(e): non-zero if a lane of e, a comparison result, is set,
+ * - TR_NAME(f): the name of function f for this instruction set.
+ * and with the tr_kernels type in scope. The loads and stores are unaligned
+ * (the traces of views are not aligned), the vector loops are unrolled 4 times
+ * and the last l % TR_LANES points are processed one at a time. The results
+ * are the same as with the scalar kernels, bit for bit. */
+
+static inline TR_VEC
+TR_NAME (load) (float *p)
+{
+  TR_VEC v;
+
+  memcpy (&v, p, sizeof (TR_VEC));
+  return v;
+}
+
+static inline void
+TR_NAME (store) (float *p, TR_VEC v)
+{
+  memcpy (p, &v, sizeof (TR_VEC));
+}
+
+static inline TR_VEC
+TR_NAME (set1) (float x)
+{
+  TR_VEC v;
+  int i;
+
+  for (i = 0; i < TR_LANES; i++)
+    {
+      v[i] = x;
+    }
+  return v;
+}
+
+static void
+TR_NAME (acc) (int l, float *dest, float *src)
+{
+  int i;
+
+#pragma GCC unroll 4
+  for (i = 0; i + TR_LANES <= l; i += TR_LANES)
+    {
+      TR_NAME (store) (dest + i,
+		       TR_NAME (load) (dest + i) + TR_NAME (load) (src + i));
+    }
+  for (; i < l; i++)
+    {
+      dest[i] += src[i];
+    }
+}
+
+static void
+TR_NAME (add) (int l, float *dest, float *src1, float *src2)
+{
+  int i;
+
+#pragma GCC unroll 4
+  for (i = 0; i + TR_LANES <= l; i += TR_LANES)
+    {
+      TR_NAME (store) (dest + i,
+		       TR_NAME (load) (src1 + i) + TR_NAME (load) (src2 + i));
+    }
+  for (; i < l; i++)
+    {
+      dest[i] = src1[i] + src2[i];
+    }
+}
+
+static void
+TR_NAME (sub) (int l, float *dest, float *src1, float *src2)
+{
+  int i;
+
+#pragma GCC unroll 4
+  for (i = 0; i + TR_LANES <= l; i += TR_LANES)
+    {
+      TR_NAME (store) (dest + i,
+		       TR_NAME (load) (src1 + i) - TR_NAME (load) (src2 + i));
+    }
+  for (; i < l; i++)
+    {
+      dest[i] = src1[i] - src2[i];
+    }
+}
+
+static void
+TR_NAME (mul) (int l, float *dest, float *src1, float *src2)
+{
+  int i;
+
+#pragma GCC unroll 4
+  for (i = 0; i + TR_LANES <= l; i += TR_LANES)
+    {
+      TR_NAME (store) (dest + i,
+		       TR_NAME (load) (src1 + i) * TR_NAME (load) (src2 + i));
+    }
+  for (; i < l; i++)
+    {
+      dest[i] = src1[i] * src2[i];
+    }
+}
+
+static void
+TR_NAME (div) (int l, float *dest, float *src1, float *src2)
+{
+  int i;
+
+#pragma GCC unroll 4
+  for (i = 0; i + TR_LANES <= l; i += TR_LANES)
+    {
+      TR_NAME (store) (dest + i,
+		       TR_NAME (load) (src1 + i) / TR_NAME (load) (src2 + i));
+    }
+  for (; i < l; i++)
+    {
+      dest[i] = src1[i] / src2[i];
+    }
+}
+
+static void
+TR_NAME (scalar_mul) (int l, float *dest, float *src, float val)
+{
+  TR_VEC v;
+  int i;
+
+  v = TR_NAME (set1) (val);
+#pragma GCC unroll 4
+  for (i = 0; i + TR_LANES <= l; i += TR_LANES)
+    {
+      TR_NAME (store) (dest + i, TR_NAME (load) (src + i) * v);
+    }
+  for (; i < l; i++)
+    {
+      dest[i] = src[i] * val;
+    }
+}
+
+static void
+TR_NAME (scalar_div) (int l, float *dest, float *src, float val)
+{
+  TR_VEC v;
+  int i;
+
+  v = TR_NAME (set1) (val);
+#pragma GCC unroll 4
+  for (i = 0; i + TR_LANES <= l; i += TR_LANES)
+    {
+      TR_NAME (store) (dest + i, TR_NAME (load) (src + i) / v);
+    }
+  for (; i < l; i++)
+    {
+      dest[i] = src[i] / val;
+    }
+}
+
+static void
+TR_NAME (sqr) (int l, float *dest, float *src)
+{
+  TR_VEC v;
+  int i;
+
+#pragma GCC unroll 4
+  for (i = 0; i + TR_LANES <= l; i += TR_LANES)
+    {
+      v = TR_NAME (load) (src + i);
+      TR_NAME (store) (dest + i, v * v);
+    }
+  for (; i < l; i++)
+    {
+      dest[i] = src[i] * src[i];
+    }
+}
+
+static void
+TR_NAME (sqrt) (int l, float *dest, float *src)
+{
+  int i;
+
+#pragma GCC unroll 4
+  for (i = 0; i + TR_LANES <= l; i += TR_LANES)
+    {
+      TR_NAME (store) (dest + i, TR_SQRT (TR_NAME (load) (src + i)));
+    }
+  for (; i < l; i++)
+    {
+      dest[i] = sqrt (src[i]);
+    }
+}
+
+static void
+TR_NAME (abs) (int l, float *dest, float *src)
+{
+  int i;
+
+#pragma GCC unroll 4
+  for (i = 0; i + TR_LANES <= l; i += TR_LANES)
+    {
+      TR_NAME (store) (dest + i,
+		       (TR_VEC) ((TR_IVEC) TR_NAME (load) (src + i) &
+				 0x7fffffff));
+    }
+  for (; i < l; i++)
+    {
+      dest[i] = fabs (src[i]);
+    }
+}
+
+/* Running argmax of the fused kernels: lane j of m is the maximum of the
+ * points seen so far by lane j and lane j of im the index of its first
+ * occurrence (see TR_NAME (argmax_end)). x holds points i, i + 1, ... */
+static inline void
+TR_NAME (argmax_step) (TR_VEC * m, TR_IVEC * im, TR_VEC x, TR_IVEC i)
+{
+  TR_IVEC gt;
+
+  gt = x > *m;
+  *m = (TR_VEC) (((TR_IVEC) x & gt) | ((TR_IVEC) * m & ~gt));
+  *im = (i & gt) | (*im & ~gt);
+}
+
+/* Combines the lanes of a running argmax: the greatest maximum, with the
+ * smallest index if several lanes have the same, as the scalar loops. */
+static inline float
+TR_NAME (argmax_end) (TR_VEC m, TR_IVEC im, int *idx)
+{
+  float max;
+  int j;
+
+  max = m[0];
+  *idx = im[0];
+  for (j = 1; j < TR_LANES; j++)
+    {
+      if (m[j] > max || (m[j] == max && im[j] < *idx))
+	{
+	  max = m[j];
+	  *idx = im[j];
+	}
+    }
+  return max;
+}
+
+/* Index vector {0, 1, ..., TR_LANES - 1}. */
+static inline TR_IVEC
+TR_NAME (iota) (void)
+{
+  TR_IVEC v;
+  int j;
+
+  for (j = 0; j < TR_LANES; j++)
+    {
+      v[j] = j;
+    }
+  return v;
+}
+
+/* The fused kernels with an argmax start from -infinity at index 0 in all
+ * lanes: the first point is only replaced by a strictly greater one. A NaN
+ * first point is returned as is, as by the scalar loops. */
+static float
+TR_NAME (diff_of_means) (int l, float *dest, float *src1, float n1,
+			 float *src2, float n2, int *idx)
+{
+  TR_VEC v1, v2, d, m;
+  TR_IVEC i, im;
+  float max;
+  int k;
+
+  v1 = TR_NAME (set1) (n1);
+  v2 = TR_NAME (set1) (n2);
+  m = TR_NAME (set1) (-INFINITY);
+  im = (TR_IVEC) TR_NAME (set1) (0.0);
+  i = TR_NAME (iota) ();
+#pragma GCC unroll 4
+  for (k = 0; k + TR_LANES <= l; k += TR_LANES)
+    {
+      d = TR_NAME (load) (src1 + k) / v1 - TR_NAME (load) (src2 + k) / v2;
+      TR_NAME (store) (dest + k, d);
+      TR_NAME (argmax_step) (&m, &im, d, i);
+      i += TR_LANES;
+    }
+  max = TR_NAME (argmax_end) (m, im, idx);
+  for (; k < l; k++)
+    {
+      dest[k] = src1[k] / n1 - src2[k] / n2;
+      if (dest[k] > max)
+	{
+	  max = dest[k];
+	  *idx = k;
+	}
+    }
+  if (dest[0] != dest[0])
+    {
+      *idx = 0;
+      return dest[0];
+    }
+  return max;
+}
+
+static float
+TR_NAME (sub_absmax) (int l, float *dest, float *src1, float *src2, int *idx)
+{
+  TR_VEC d, m;
+  TR_IVEC i, im;
+  float max;
+  int k;
+
+  m = TR_NAME (set1) (-INFINITY);
+  im = (TR_IVEC) TR_NAME (set1) (0.0);
+  i = TR_NAME (iota) ();
+#pragma GCC unroll 4
+  for (k = 0; k + TR_LANES <= l; k += TR_LANES)
+    {
+      d = TR_NAME (load) (src1 + k) - TR_NAME (load) (src2 + k);
+      TR_NAME (store) (dest + k, d);
+      TR_NAME (argmax_step) (&m, &im, (TR_VEC) ((TR_IVEC) d & 0x7fffffff), i);
+      i += TR_LANES;
+    }
+  max = TR_NAME (argmax_end) (m, im, idx);
+  for (; k < l; k++)
+    {
+      dest[k] = src1[k] - src2[k];
+      if (fabs (dest[k]) > max)
+	{
+	  max = fabs (dest[k]);
+	  *idx = k;
+	}
+    }
+  if (dest[0] != dest[0])
+    {
+      *idx = 0;
+      return fabs (dest[0]);
+    }
+  return max;
+}
+
+static void
+TR_NAME (axpy) (int l, float *dest, float a, float *src)
+{
+  TR_VEC v;
+  int i;
+
+  v = TR_NAME (set1) (a);
+#pragma GCC unroll 4
+  for (i = 0; i + TR_LANES <= l; i += TR_LANES)
+    {
+      TR_NAME (store) (dest + i,
+		       TR_NAME (load) (dest + i) + v * TR_NAME (load) (src + i));
+    }
+  for (; i < l; i++)
+    {
+      dest[i] += a * src[i];
+    }
+}
+
+static void
+TR_NAME (acc_sqr) (int l, float *sum, float *sumsq, float *src)
+{
+  TR_VEC v;
+  int i;
+
+#pragma GCC unroll 4
+  for (i = 0; i + TR_LANES <= l; i += TR_LANES)
+    {
+      v = TR_NAME (load) (src + i);
+      TR_NAME (store) (sum + i, TR_NAME (load) (sum + i) + v);
+      TR_NAME (store) (sumsq + i, TR_NAME (load) (sumsq + i) + v * v);
+    }
+  for (; i < l; i++)
+    {
+      sum[i] += src[i];
+      sumsq[i] += src[i] * src[i];
+    }
+}
+
+/* Returns the index of the first point of t equal to val, which must exist. */
+static int
+TR_NAME (find) (int l, float *t, float val)
+{
+  TR_VEC v;
+  int i;
+
+  v = TR_NAME (set1) (val);
+#pragma GCC unroll 4
+  for (i = 0; i + TR_LANES <= l; i += TR_LANES)
+    {
+      if (TR_ANY (TR_NAME (load) (t + i) == v))
+	{
+	  break;
+	}
+    }
+  while (t[i] != val)
+    {
+      i += 1;
+    }
+  return i;
+}
+
+/* Minimum in a first pass, index of its first occurrence in a second one, as
+ * the scalar loop: the NaNs are ignored, unless t[0] is a NaN. */
+static float
+TR_NAME (min) (int l, float *t, int *idx)
+{
+  TR_VEC m;
+  float min;
+  int i;
+
+  min = t[0];
+  *idx = 0;
+  if (min != min)
+    {
+      return min;
+    }
+  m = TR_NAME (set1) (min);
+#pragma GCC unroll 4
+  for (i = 0; i + TR_LANES <= l; i += TR_LANES)
+    {
+      m = TR_MIN (TR_NAME (load) (t + i), m);
+    }
+  for (; i < l; i++)
+    {
+      min = t[i] < min ? t[i] : min;
+    }
+  for (i = 0; i < TR_LANES; i++)
+    {
+      min = m[i] < min ? m[i] : min;
+    }
+  *idx = TR_NAME (find) (l, t, min);
+  return t[*idx];
+}
+
+static float
+TR_NAME (max) (int l, float *t, int *idx)
+{
+  TR_VEC m;
+  float max;
+  int i;
+
+  max = t[0];
+  *idx = 0;
+  if (max != max)
+    {
+      return max;
+    }
+  m = TR_NAME (set1) (max);
+#pragma GCC unroll 4
+  for (i = 0; i + TR_LANES <= l; i += TR_LANES)
+    {
+      m = TR_MAX (TR_NAME (load) (t + i), m);
+    }
+  for (; i < l; i++)
+    {
+      max = t[i] > max ? t[i] : max;
+    }
+  for (i = 0; i < TR_LANES; i++)
+    {
+      max = m[i] > max ? m[i] : max;
+    }
+  *idx = TR_NAME (find) (l, t, max);
+  return t[*idx];
+}
+
+static int
+TR_NAME (any_zero) (int l, float *t)
+{
+  TR_VEC z;
+  TR_IVEC e;
+  int i;
+
+  z = TR_NAME (set1) (0.0);
+  e = (TR_IVEC) z;
+#pragma GCC unroll 4
+  for (i = 0; i + TR_LANES <= l; i += TR_LANES)
+    {
+      e |= TR_NAME (load) (t + i) == z;
+    }
+  for (; i < l; i++)
+    {
+      if (t[i] == 0.0)
+	{
+	  return 1;
+	}
+    }
+  return TR_ANY (e) != 0;
+}
+
+static int
+TR_NAME (any_negative) (int l, float *t)
+{
+  TR_VEC z;
+  TR_IVEC e;
+  int i;
+
+  z = TR_NAME (set1) (0.0);
+  e = (TR_IVEC) z;
+#pragma GCC unroll 4
+  for (i = 0; i + TR_LANES <= l; i += TR_LANES)
+    {
+      e |= TR_NAME (load) (t + i) < z;
+    }
+  for (; i < l; i++)
+    {
+      if (t[i] < 0.0)
+	{
+	  return 1;
+	}
+    }
+  return TR_ANY (e) != 0;
+}
+
+static const tr_kernels TR_NAME (kernels) = {
+  TR_NAME (acc), TR_NAME (add), TR_NAME (sub), TR_NAME (mul), TR_NAME (div),
+  TR_NAME (scalar_mul), TR_NAME (scalar_div), TR_NAME (sqr), TR_NAME (sqrt),
+  TR_NAME (abs), TR_NAME (min), TR_NAME (max), TR_NAME (any_zero),
+  TR_NAME (any_negative), TR_NAME (diff_of_means), TR_NAME (sub_absmax),
+  TR_NAME (axpy), TR_NAME (acc_sqr)
+};
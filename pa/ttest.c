@@ -0,0 +1,251 @@
+/*
+ * Copyright (C) Telecom Paris
+ *
+ * This file must be used under the terms of the CeCILL. This source
+ * file is licensed as described in the file COPYING, which you should
+ * have received as part of this distribution. The terms are also
+ * available at:
+ * http://www.cecill.info/licences/Licence_CeCILL_V1.1-US.txt
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "utils.h"
+#include "traces.h"
+#include "ttest.h"
+
+/* Per-point central moments of a class: mean and sums of the squared, cubed
+ * and fourth powers of the deviations from the mean. */
+typedef struct {
+  int64_t n;
+  double *mean, *m2, *m3, *m4;
+} tt_class;
+
+struct tt_context_s {
+  int l;			/* Number of points per trace. */
+  tt_class c[2];
+};
+
+/* Work of a thread of tt_run() on the current batch. */
+typedef struct {
+  tr_context b;			/* The batch. */
+  int first, last;		/* Slice of the batch: traces first to last - 1. */
+  tt_classifier classify;
+  void *arg;
+  tt_context tt;		/* The t-test of the thread. */
+} tt_slice;
+
+tt_context
+tt_init (tr_context ctx) {
+  tt_context tt;
+  int c;
+
+  tt = XCALLOC (1, sizeof (struct tt_context_s));
+  tt->l = tr_length (ctx);
+  for (c = 0; c < 2; c++) {
+    tt->c[c].n = 0;
+    tt->c[c].mean = XCALLOC (tt->l, sizeof (double));
+    tt->c[c].m2 = XCALLOC (tt->l, sizeof (double));
+    tt->c[c].m3 = XCALLOC (tt->l, sizeof (double));
+    tt->c[c].m4 = XCALLOC (tt->l, sizeof (double));
+  }
+  return tt;
+}
+
+void
+tt_free (tt_context tt) {
+  int c;
+
+  for (c = 0; c < 2; c++) {
+    free (tt->c[c].mean);
+    free (tt->c[c].m2);
+    free (tt->c[c].m3);
+    free (tt->c[c].m4);
+  }
+  free (tt);
+}
+
+void
+tt_add (tt_context tt, int c, float *t) {
+  tt_class *k;
+  double n, a, b, r, d, dn, dn2, t1;
+  int i;
+
+  if (c == -1) {
+    return;
+  }
+  if (c != 0 && c != 1) {
+    ERROR (, -1, "Invalid class: %d", c);
+  }
+  k = tt->c + c;
+  k->n += 1;
+  n = (double) (k->n);
+  r = 1.0 / n;
+  a = (n - 1.0) * r;		/* t1 = d^2 (n - 1) / n */
+  b = n * n - 3.0 * n + 3.0;
+  for (i = 0; i < tt->l; i++) {
+    d = (double) (t[i]) - k->mean[i];
+    dn = d * r;
+    dn2 = dn * dn;
+    t1 = d * d * a;
+    k->mean[i] += dn;
+    k->m4[i] += t1 * dn2 * b + 6.0 * dn2 * k->m2[i] - 4.0 * dn * k->m3[i];
+    k->m3[i] += t1 * dn * (n - 2.0) - 3.0 * dn * k->m2[i];
+    k->m2[i] += t1;
+  }
+}
+
+void
+tt_merge (tt_context dest, tt_context src) {
+  tt_class *a, *b;
+  double na, nb, n, d, d2, ab, a2b2;
+  int c, i;
+
+  if (src->l != dest->l) {
+    ERROR (, -1, "length mismatch: %d (t-test: %d)", src->l, dest->l);
+  }
+  for (c = 0; c < 2; c++) {
+    a = dest->c + c;
+    b = src->c + c;
+    if (b->n == 0) {
+      continue;
+    }
+    na = (double) (a->n);
+    nb = (double) (b->n);
+    n = na + nb;
+    ab = na * nb / n;
+    a2b2 = na * na - na * nb + nb * nb;
+    for (i = 0; i < dest->l; i++) {
+      d = b->mean[i] - a->mean[i];
+      d2 = d * d;
+      a->m4[i] += b->m4[i] + d2 * d2 * ab * a2b2 / (n * n)
+	+ 6.0 * d2 * (na * na * b->m2[i] + nb * nb * a->m2[i]) / (n * n)
+	+ 4.0 * d * (na * b->m3[i] - nb * a->m3[i]) / n;
+      a->m3[i] += b->m3[i] + d2 * d * ab * (na - nb) / n
+	+ 3.0 * d * (na * b->m2[i] - nb * a->m2[i]) / n;
+      a->m2[i] += b->m2[i] + d2 * ab;
+      a->mean[i] += d * nb / n;
+    }
+    a->n += b->n;
+  }
+}
+
+int64_t
+tt_number (tt_context tt, int c) {
+  if (c != 0 && c != 1) {
+    ERROR (-1, -1, "Invalid class: %d", c);
+  }
+  return tt->c[c].n;
+}
+
+void
+tt_t (tt_context tt, int order, float *dest) {
+  tt_class *a, *b;
+  double na, nb, u, v, x, y;
+  int i;
+
+  if (order != 1 && order != 2) {
+    ERROR (, -1, "Invalid order: %d (shall be 1 or 2)", order);
+  }
+  a = tt->c;
+  b = tt->c + 1;
+  if (a->n < 2 || b->n < 2) {
+    ERROR (, -1, "less than two traces in a class (%" PRId64 ", %" PRId64 ")", a->n, b->n);
+  }
+  na = (double) (a->n);
+  nb = (double) (b->n);
+  for (i = 0; i < tt->l; i++) {
+    if (order == 1) {
+      /* Means and unbiased variances. */
+      x = a->mean[i] - b->mean[i];
+      u = a->m2[i] / (na - 1.0);
+      v = b->m2[i] / (nb - 1.0);
+    }
+    else {
+      /* Means and variances of the centered squared traces. */
+      x = a->m2[i] / na - b->m2[i] / nb;
+      u = a->m4[i] / na - (a->m2[i] / na) * (a->m2[i] / na);
+      v = b->m4[i] / nb - (b->m2[i] / nb) * (b->m2[i] / nb);
+    }
+    y = u / na + v / nb;
+    dest[i] = y > 0.0 ? x / sqrt (y) : 0.0;
+  }
+}
+
+static void *
+tt_worker (void *arg) {
+  tt_slice *s;
+  int i;
+
+  s = arg;
+  for (i = s->first; i < s->last; i++) {
+    tt_add (s->tt, s->classify (tr_plaintext (s->b, i), tr_ciphertext (s->b, i), s->arg), tr_trace (s->b, i));
+  }
+  return NULL;
+}
+
+void
+tt_run (char *filename, int max, int threads, tt_classifier classify, void *arg, float *t1, float *t2, int64_t n[2]) {
+  tr_stream s;
+  tr_context b;
+  tt_slice *p;
+  pthread_t *tid;
+  int i, m;
+
+  if (threads < 1) {
+    threads = (int) sysconf (_SC_NPROCESSORS_ONLN);
+  }
+  s = tr_stream_open (filename, max, 0);
+  p = XCALLOC (threads, sizeof (tt_slice));
+  tid = XCALLOC (threads, sizeof (pthread_t));
+  b = NULL;
+  while ((m = tr_stream_next (s, &b))) {
+    for (i = 0; i < threads; i++) {
+      if (p[i].tt == NULL) {
+	p[i].tt = tt_init (b);
+      }
+      p[i].b = b;
+      p[i].first = (int) ((int64_t) m * i / threads);
+      p[i].last = (int) ((int64_t) m * (i + 1) / threads);
+      p[i].classify = classify;
+      p[i].arg = arg;
+    }
+    if (threads == 1) {
+      tt_worker (p);
+    }
+    else {
+      for (i = 0; i < threads; i++) {
+	if (pthread_create (tid + i, NULL, tt_worker, p + i) != 0)
+	  ERROR (, -1, "cannot create thread #%d", i);
+      }
+      for (i = 0; i < threads; i++) {
+	pthread_join (tid[i], NULL);
+      }
+    }
+  }
+  tr_stream_close (s);
+  if (p[0].tt == NULL) {
+    ERROR (, -1, "no traces in file %s", filename);
+  }
+  for (i = 1; i < threads; i++) {
+    tt_merge (p[0].tt, p[i].tt);
+    tt_free (p[i].tt);
+  }
+  n[0] = tt_number (p[0].tt, 0);
+  n[1] = tt_number (p[0].tt, 1);
+  if (t1 != NULL) {
+    tt_t (p[0].tt, 1, t1);
+  }
+  if (t2 != NULL) {
+    tt_t (p[0].tt, 2, t2);
+  }
+  tt_free (p[0].tt);
+  free (tid);
+  free (p);
+}
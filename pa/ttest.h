@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) Telecom Paris
+ *
+ * This file must be used under the terms of the CeCILL. This source
+ * file is licensed as described in the file COPYING, which you should
+ * have received as part of this distribution. The terms are also
+ * available at:
+ * http://www.cecill.info/licences/Licence_CeCILL_V1.1-US.txt
+*/
+
+/** \file ttest.h
+The **ttest** library, a leakage assessment engine (TVLA): per-point Welch's t-tests between two classes of power traces, at first order (means) and second order (variances, that is, means of the centered squared traces).
+\attention
+- The class of each trace is decided by a callback on its plaintext and ciphertext. With a fixed-vs-random campaign the class is whether the plaintext is the fixed one. With a specific-value test it is the value of a bit of an intermediate value, computed with the known key.
+- The first four central moments of each class are accumulated per point in double precision, in a single pass, with the update and merge formulas of P. Pébay (Sandia report SAND2008-6212). Both orders come from the same pass; there is no second pass to center the traces.
+- A leakage is usually reported when |t| exceeds `TT_THRESHOLD` at some point.
+- Example of use:
+\code
+tt_context tt;
+tr_context b;
+float *t;
+int i;
+
+tt = tt_init (ctx);
+while (tr_stream_next (s, &b)) {
+  for (i = 0; i < tr_number (b); i++) {
+    tt_add (tt, my_class (tr_plaintext (b, i), tr_ciphertext (b, i)), tr_trace (b, i));
+  }
+}
+t = tr_new_trace (ctx);
+tt_t (tt, 1, t);
+tt_free (tt);
+\endcode
+*/
+
+#ifndef TTEST_H
+#define TTEST_H
+
+#include <stdint.h>
+#include <inttypes.h>
+
+#include "traces.h"
+
+/** The usual leakage detection threshold on |t|. */
+#define TT_THRESHOLD 4.5
+
+/** The data structure used to accumulate the two classes of a t-test. */
+typedef struct tt_context_s *tt_context;
+
+/** Classification callback of `tt_run()`. Called concurrently by several threads: must be thread safe.
+ * \return The class of the trace: 0 or 1, or -1 to discard the trace. */
+typedef int (*tt_classifier) (uint64_t pt /**< The 64 bits plaintext. */ ,
+			      uint64_t ct /**< The 64 bits ciphertext. */ ,
+			      void *arg
+			      /**< User data passed to `tt_run()`. */
+  );
+
+/** Creates an empty t-test for traces of the length of context `ctx`.
+ * \return The new t-test. */
+tt_context tt_init (tr_context ctx /**< The context. */ );
+
+/** Frees a t-test. */
+void tt_free (tt_context tt /**< The t-test. */ );
+
+/** Adds trace `t` to class `c` of t-test `tt`. Does nothing if `c` is -1. */
+void tt_add (tt_context tt /**< The t-test. */ ,
+	     int c /**< The class: 0, 1 or -1. */ ,
+	     float *t
+	     /**< The trace. */
+  );
+
+/** Merges t-test `src` into t-test `dest`, class by class. `src` is left unchanged. The two t-tests must have the same length. */
+void tt_merge (tt_context dest /**< The destination t-test. */ ,
+	       tt_context src
+	       /**< The source t-test. */
+  );
+
+/** Returns the number of traces of a class.
+ * \return The number of traces of class `c`. */
+int64_t tt_number (tt_context tt /**< The t-test. */ ,
+		   int c
+		   /**< The class: 0 or 1. */
+  );
+
+/** Computes the per-point t-statistics of order `order` and stores them in trace `dest`. A point where the denominator is zero gets t = 0. Exits with an error if a class holds less than two traces. */
+void tt_t (tt_context tt /**< The t-test. */ ,
+	   int order /**< 1 (difference of means) or 2 (difference of variances). */ ,
+	   float *dest
+	   /**< The destination trace. */
+  );
+
+/** Runs a t-test on the trace file `filename`, in a single streaming pass. Each batch of the stream is split in `threads` contiguous slices, classified and accumulated by as many threads, each in its own t-test; the per-thread t-tests are merged at the end, in thread order. The result depends on the number of threads only through the rounding errors.
+ * \return Nothing; the t-statistics of orders 1 and 2 are stored in `t1` and `t2` (if not NULL), and the class sizes in `n`. */
+void tt_run (char *filename /**< Name of the trace file in HWSec format. */ ,
+	     int max /**< Maximum number of traces to read from the file (all if 0). */ ,
+	     int threads /**< Number of threads; zero or negative: one per online processor. */ ,
+	     tt_classifier classify /**< Classification callback. */ ,
+	     void *arg /**< User data, passed to `classify`. */ ,
+	     float *t1 /**< The first order t-trace (may be NULL). */ ,
+	     float *t2 /**< The second order t-trace (may be NULL). */ ,
+	     int64_t n[2]
+	     /**< The number of traces of classes 0 and 1. */
+  );
+
+#endif /** not TTEST_H */
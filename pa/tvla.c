@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) Telecom Paris
+ *
+ * This file must be used under the terms of the CeCILL. This source
+ * file is licensed as described in the file COPYING, which you should
+ * have received as part of this distribution. The terms are also
+ * available at:
+ * http://www.cecill.info/licences/Licence_CeCILL_V1.1-US.txt
+*/
+
+/* Leakage assessment of a trace file (TVLA), with first and second order
+ * Welch's t-tests, in a single streaming pass (see ttest.h). Two tests are
+ * available:
+ * - fixed-vs-random (default): the file interleaves acquisitions with a fixed
+ *   plaintext and with random plaintexts; the classes are fixed / random.
+ * - specific-value (-b): the classes are the values of a bit of L15, computed
+ *   from the ciphertext and the secret key of the file.
+ * The two t-traces are stored in <prefix>.dat, to plot with: $ gnuplot
+ * -persist <prefix>.cmd */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+#include "utils.h"
+#include "traces.h"
+#include "des.h"
+#include "ttest.h"
+
+/* Parameters of the classifiers. */
+typedef struct {
+  uint64_t pt;  // Fixed plaintext (fixed-vs-random)
+  uint64_t k16; // Last round key (specific-value)
+  int bit;      // Index of bit of L15 (specific-value), 0 for fixed-vs-random
+} tvla_param;
+
+/* Fixed-vs-random classifier: 0 if the plaintext is the fixed one, else 1. */
+int fixed_vs_random (uint64_t pt, uint64_t ct, void *arg);
+
+/* Specific-value classifier: value of bit <bit> of L15. */
+int specific_value (uint64_t pt, uint64_t ct, void *arg);
+
+/* Prints the maximum of |t| of a t-trace and the verdict on the standard
+ * error. Returns 1 if the threshold is exceeded, else 0. */
+int report (tr_context ctx, int order, float *t);
+
+int main (int argc, char **argv) {
+  int c;             // Option character
+  int n;             // Number of acquisitions to use (0: all)
+  int threads;       // Number of threads (0: one per online processor)
+  int leak;          // Leakage detected
+  char *prefix;      // Prefix of output files
+  char *end;         // End of parsed plaintext
+  int64_t nc[2];     // Number of traces in each class
+  uint64_t ks[16];   // Key schedule of the secret key
+  tvla_param p;      // Parameters of the classifier
+  tr_context ctx;    // First trace of the datafile: length and secret key
+  float *t[2];       // First and second order t-traces
+  int fixed;         // Fixed plaintext given on the command line
+
+  n = 0;
+  threads = 0;
+  prefix = "tvla";
+  fixed = 0;
+  p.pt = 0;
+  p.bit = 0;
+  while (optind <= argc && (c = getopt (argc, argv, "n:j:f:b:o:")) != -1) {
+    switch (c) {
+      case 'n':
+        n = atoi (optarg);
+        if (n < 1) {
+          ERROR (0, -1, "Invalid number of acquisitions: %d (shall be at least 1)", n);
+        }
+        break;
+      case 'j':
+        threads = atoi (optarg);
+        break;
+      case 'f':
+        p.pt = strtoull (optarg, &end, 16);
+        if (*optarg == '\0' || *end != '\0') {
+          ERROR (0, -1, "Invalid plaintext: %s (shall be hexadecimal)", optarg);
+        }
+        fixed = 1;
+        break;
+      case 'b':
+        p.bit = atoi (optarg);
+        if (p.bit < 1 || p.bit > 32) {
+          ERROR (0, -1, "Invalid target bit index: %d (shall be between 1 and 32 included)", p.bit);
+        }
+        break;
+      case 'o':
+        prefix = optarg;
+        break;
+      default:
+        optind = argc + 1;
+    }
+  }
+  if (optind != argc - 1 || (fixed && p.bit)) {
+    ERROR (0, -1, "\
+usage: tvla [-n N] [-j THREADS] [-f PLAINTEXT | -b B] [-o PREFIX] FILE\n\
+  FILE: name of the traces file in HWSec format\n\
+  -n N: number of acquisitions to use (default: all)\n\
+  -j THREADS: number of threads (default: one per online processor)\n\
+  -f PLAINTEXT: fixed plaintext of fixed-vs-random test, in hexadecimal\n\
+     (default: plaintext of first acquisition)\n\
+  -b B: specific-value test on bit B of L15 (1 to 32, as in DES standard)\n\
+  -o PREFIX: prefix of output files (default: tvla)\n");
+  }
+  ctx = tr_init (argv[optind], 1);
+  if (!fixed) {
+    p.pt = tr_plaintext (ctx, 0);
+  }
+  des_ks (ks, tr_key (ctx));
+  p.k16 = ks[15];
+  t[0] = tr_new_trace (ctx);
+  t[1] = tr_new_trace (ctx);
+  if (p.bit) {
+    fprintf (stderr, "Specific-value test, bit %d of L15\n", p.bit);
+    tt_run (argv[optind], n, threads, specific_value, &p, t[0], t[1], nc);
+  }
+  else {
+    fprintf (stderr, "Fixed-vs-random test, fixed plaintext 0x%016" PRIx64 "\n", p.pt);
+    tt_run (argv[optind], n, threads, fixed_vs_random, &p, t[0], t[1], nc);
+  }
+  fprintf (stderr, "Classes: %" PRId64 " and %" PRId64 " traces\n", nc[0], nc[1]);
+  leak = report (ctx, 1, t[0]);
+  leak |= report (ctx, 2, t[1]);
+  tr_plot (ctx, prefix, 2, -1, t);
+  fprintf (stderr, "First and second order t-traces stored in file '%s.dat'.\n", prefix);
+  tr_free_trace (ctx, t[0]);
+  tr_free_trace (ctx, t[1]);
+  tr_free (ctx);
+  return leak;
+}
+
+int fixed_vs_random (uint64_t pt, uint64_t ct, void *arg) {
+  tvla_param *p = arg;
+
+  return pt != p->pt;
+}
+
+int specific_value (uint64_t pt, uint64_t ct, void *arg) {
+  tvla_param *p = arg;
+  uint64_t x;   // R16|L16, as in DES standard
+  uint64_t l15; // L15 (as in DES standard)
+
+  x = des_ip (ct);
+  l15 = des_left_half (x) ^ des_f (p->k16, des_right_half (x));
+  return (l15 >> (32 - p->bit)) & UINT64_C (1);
+}
+
+int report (tr_context ctx, int order, float *t) {
+  float *a;  // |t|
+  float max; // Max of |t|
+  int idx;   // Argmax of |t|
+
+  a = tr_new_trace (ctx);
+  tr_abs (ctx, a, t);
+  max = tr_max (ctx, a, &idx);
+  tr_free_trace (ctx, a);
+  fprintf (stderr, "Order %d: max |t| = %f at index %d: %s\n", order, max, idx,
+           max > TT_THRESHOLD ? "LEAKAGE" : "no leakage detected");
+  return max > TT_THRESHOLD;
+}
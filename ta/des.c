@@ -13,6 +13,8 @@
 #include <stdint.h>
 #include <inttypes.h>
 #include "utils.h"
+#include "des.h"
+#include "des_fast.h"
 
 #define FP_K N_IP_K
 #define N_FP_K IP_K
@@ -8035,6 +8037,282 @@ uint64_t SBOX_K[8][64] = {
    0, 15, 6, 12, 10, 9, 13, 0, 15, 3, 3, 5, 5, 6, 8, 11}
 };
 
+/* SBoxes combined with the P permutation: SP_K[i][v] = des_p (des_sbox (i + 1,
+ * v) << (4 * (7 - i))). */
+uint64_t SP_K[8][64] = {
+  {
+   UINT64_C (0x0000000000808200), UINT64_C (0x0000000000000000),
+   UINT64_C (0x0000000000008000), UINT64_C (0x0000000000808202),
+   UINT64_C (0x0000000000808002), UINT64_C (0x0000000000008202),
+   UINT64_C (0x0000000000000002), UINT64_C (0x0000000000008000),
+   UINT64_C (0x0000000000000200), UINT64_C (0x0000000000808200),
+   UINT64_C (0x0000000000808202), UINT64_C (0x0000000000000200),
+   UINT64_C (0x0000000000800202), UINT64_C (0x0000000000808002),
+   UINT64_C (0x0000000000800000), UINT64_C (0x0000000000000002),
+   UINT64_C (0x0000000000000202), UINT64_C (0x0000000000800200),
+   UINT64_C (0x0000000000800200), UINT64_C (0x0000000000008200),
+   UINT64_C (0x0000000000008200), UINT64_C (0x0000000000808000),
+   UINT64_C (0x0000000000808000), UINT64_C (0x0000000000800202),
+   UINT64_C (0x0000000000008002), UINT64_C (0x0000000000800002),
+   UINT64_C (0x0000000000800002), UINT64_C (0x0000000000008002),
+   UINT64_C (0x0000000000000000), UINT64_C (0x0000000000000202),
+   UINT64_C (0x0000000000008202), UINT64_C (0x0000000000800000),
+   UINT64_C (0x0000000000008000), UINT64_C (0x0000000000808202),
+   UINT64_C (0x0000000000000002), UINT64_C (0x0000000000808000),
+   UINT64_C (0x0000000000808200), UINT64_C (0x0000000000800000),
+   UINT64_C (0x0000000000800000), UINT64_C (0x0000000000000200),
+   UINT64_C (0x0000000000808002), UINT64_C (0x0000000000008000),
+   UINT64_C (0x0000000000008200), UINT64_C (0x0000000000800002),
+   UINT64_C (0x0000000000000200), UINT64_C (0x0000000000000002),
+   UINT64_C (0x0000000000800202), UINT64_C (0x0000000000008202),
+   UINT64_C (0x0000000000808202), UINT64_C (0x0000000000008002),
+   UINT64_C (0x0000000000808000), UINT64_C (0x0000000000800202),
+   UINT64_C (0x0000000000800002), UINT64_C (0x0000000000000202),
+   UINT64_C (0x0000000000008202), UINT64_C (0x0000000000808200),
+   UINT64_C (0x0000000000000202), UINT64_C (0x0000000000800200),
+   UINT64_C (0x0000000000800200), UINT64_C (0x0000000000000000),
+   UINT64_C (0x0000000000008002), UINT64_C (0x0000000000008200),
+   UINT64_C (0x0000000000000000), UINT64_C (0x0000000000808002)}
+  ,
+  {
+   UINT64_C (0x0000000040084010), UINT64_C (0x0000000040004000),
+   UINT64_C (0x0000000000004000), UINT64_C (0x0000000000084010),
+   UINT64_C (0x0000000000080000), UINT64_C (0x0000000000000010),
+   UINT64_C (0x0000000040080010), UINT64_C (0x0000000040004010),
+   UINT64_C (0x0000000040000010), UINT64_C (0x0000000040084010),
+   UINT64_C (0x0000000040084000), UINT64_C (0x0000000040000000),
+   UINT64_C (0x0000000040004000), UINT64_C (0x0000000000080000),
+   UINT64_C (0x0000000000000010), UINT64_C (0x0000000040080010),
+   UINT64_C (0x0000000000084000), UINT64_C (0x0000000000080010),
+   UINT64_C (0x0000000040004010), UINT64_C (0x0000000000000000),
+   UINT64_C (0x0000000040000000), UINT64_C (0x0000000000004000),
+   UINT64_C (0x0000000000084010), UINT64_C (0x0000000040080000),
+   UINT64_C (0x0000000000080010), UINT64_C (0x0000000040000010),
+   UINT64_C (0x0000000000000000), UINT64_C (0x0000000000084000),
+   UINT64_C (0x0000000000004010), UINT64_C (0x0000000040084000),
+   UINT64_C (0x0000000040080000), UINT64_C (0x0000000000004010),
+   UINT64_C (0x0000000000000000), UINT64_C (0x0000000000084010),
+   UINT64_C (0x0000000040080010), UINT64_C (0x0000000000080000),
+   UINT64_C (0x0000000040004010), UINT64_C (0x0000000040080000),
+   UINT64_C (0x0000000040084000), UINT64_C (0x0000000000004000),
+   UINT64_C (0x0000000040080000), UINT64_C (0x0000000040004000),
+   UINT64_C (0x0000000000000010), UINT64_C (0x0000000040084010),
+   UINT64_C (0x0000000000084010), UINT64_C (0x0000000000000010),
+   UINT64_C (0x0000000000004000), UINT64_C (0x0000000040000000),
+   UINT64_C (0x0000000000004010), UINT64_C (0x0000000040084000),
+   UINT64_C (0x0000000000080000), UINT64_C (0x0000000040000010),
+   UINT64_C (0x0000000000080010), UINT64_C (0x0000000040004010),
+   UINT64_C (0x0000000040000010), UINT64_C (0x0000000000080010),
+   UINT64_C (0x0000000000084000), UINT64_C (0x0000000000000000),
+   UINT64_C (0x0000000040004000), UINT64_C (0x0000000000004010),
+   UINT64_C (0x0000000040000000), UINT64_C (0x0000000040080010),
+   UINT64_C (0x0000000040084010), UINT64_C (0x0000000000084000)}
+  ,
+  {
+   UINT64_C (0x0000000000000104), UINT64_C (0x0000000004010100),
+   UINT64_C (0x0000000000000000), UINT64_C (0x0000000004010004),
+   UINT64_C (0x0000000004000100), UINT64_C (0x0000000000000000),
+   UINT64_C (0x0000000000010104), UINT64_C (0x0000000004000100),
+   UINT64_C (0x0000000000010004), UINT64_C (0x0000000004000004),
+   UINT64_C (0x0000000004000004), UINT64_C (0x0000000000010000),
+   UINT64_C (0x0000000004010104), UINT64_C (0x0000000000010004),
+   UINT64_C (0x0000000004010000), UINT64_C (0x0000000000000104),
+   UINT64_C (0x0000000004000000), UINT64_C (0x0000000000000004),
+   UINT64_C (0x0000000004010100), UINT64_C (0x0000000000000100),
+   UINT64_C (0x0000000000010100), UINT64_C (0x0000000004010000),
+   UINT64_C (0x0000000004010004), UINT64_C (0x0000000000010104),
+   UINT64_C (0x0000000004000104), UINT64_C (0x0000000000010100),
+   UINT64_C (0x0000000000010000), UINT64_C (0x0000000004000104),
+   UINT64_C (0x0000000000000004), UINT64_C (0x0000000004010104),
+   UINT64_C (0x0000000000000100), UINT64_C (0x0000000004000000),
+   UINT64_C (0x0000000004010100), UINT64_C (0x0000000004000000),
+   UINT64_C (0x0000000000010004), UINT64_C (0x0000000000000104),
+   UINT64_C (0x0000000000010000), UINT64_C (0x0000000004010100),
+   UINT64_C (0x0000000004000100), UINT64_C (0x0000000000000000),
+   UINT64_C (0x0000000000000100), UINT64_C (0x0000000000010004),
+   UINT64_C (0x0000000004010104), UINT64_C (0x0000000004000100),
+   UINT64_C (0x0000000004000004), UINT64_C (0x0000000000000100),
+   UINT64_C (0x0000000000000000), UINT64_C (0x0000000004010004),
+   UINT64_C (0x0000000004000104), UINT64_C (0x0000000000010000),
+   UINT64_C (0x0000000004000000), UINT64_C (0x0000000004010104),
+   UINT64_C (0x0000000000000004), UINT64_C (0x0000000000010104),
+   UINT64_C (0x0000000000010100), UINT64_C (0x0000000004000004),
+   UINT64_C (0x0000000004010000), UINT64_C (0x0000000004000104),
+   UINT64_C (0x0000000000000104), UINT64_C (0x0000000004010000),
+   UINT64_C (0x0000000000010104), UINT64_C (0x0000000000000004),
+   UINT64_C (0x0000000004010004), UINT64_C (0x0000000000010100)}
+  ,
+  {
+   UINT64_C (0x0000000080401000), UINT64_C (0x0000000080001040),
+   UINT64_C (0x0000000080001040), UINT64_C (0x0000000000000040),
+   UINT64_C (0x0000000000401040), UINT64_C (0x0000000080400040),
+   UINT64_C (0x0000000080400000), UINT64_C (0x0000000080001000),
+   UINT64_C (0x0000000000000000), UINT64_C (0x0000000000401000),
+   UINT64_C (0x0000000000401000), UINT64_C (0x0000000080401040),
+   UINT64_C (0x0000000080000040), UINT64_C (0x0000000000000000),
+   UINT64_C (0x0000000000400040), UINT64_C (0x0000000080400000),
+   UINT64_C (0x0000000080000000), UINT64_C (0x0000000000001000),
+   UINT64_C (0x0000000000400000), UINT64_C (0x0000000080401000),
+   UINT64_C (0x0000000000000040), UINT64_C (0x0000000000400000),
+   UINT64_C (0x0000000080001000), UINT64_C (0x0000000000001040),
+   UINT64_C (0x0000000080400040), UINT64_C (0x0000000080000000),
+   UINT64_C (0x0000000000001040), UINT64_C (0x0000000000400040),
+   UINT64_C (0x0000000000001000), UINT64_C (0x0000000000401040),
+   UINT64_C (0x0000000080401040), UINT64_C (0x0000000080000040),
+   UINT64_C (0x0000000000400040), UINT64_C (0x0000000080400000),
+   UINT64_C (0x0000000000401000), UINT64_C (0x0000000080401040),
+   UINT64_C (0x0000000080000040), UINT64_C (0x0000000000000000),
+   UINT64_C (0x0000000000000000), UINT64_C (0x0000000000401000),
+   UINT64_C (0x0000000000001040), UINT64_C (0x0000000000400040),
+   UINT64_C (0x0000000080400040), UINT64_C (0x0000000080000000),
+   UINT64_C (0x0000000080401000), UINT64_C (0x0000000080001040),
+   UINT64_C (0x0000000080001040), UINT64_C (0x0000000000000040),
+   UINT64_C (0x0000000080401040), UINT64_C (0x0000000080000040),
+   UINT64_C (0x0000000080000000), UINT64_C (0x0000000000001000),
+   UINT64_C (0x0000000080400000), UINT64_C (0x0000000080001000),
+   UINT64_C (0x0000000000401040), UINT64_C (0x0000000080400040),
+   UINT64_C (0x0000000080001000), UINT64_C (0x0000000000001040),
+   UINT64_C (0x0000000000400000), UINT64_C (0x0000000080401000),
+   UINT64_C (0x0000000000000040), UINT64_C (0x0000000000400000),
+   UINT64_C (0x0000000000001000), UINT64_C (0x0000000000401040)}
+  ,
+  {
+   UINT64_C (0x0000000000000080), UINT64_C (0x0000000001040080),
+   UINT64_C (0x0000000001040000), UINT64_C (0x0000000021000080),
+   UINT64_C (0x0000000000040000), UINT64_C (0x0000000000000080),
+   UINT64_C (0x0000000020000000), UINT64_C (0x0000000001040000),
+   UINT64_C (0x0000000020040080), UINT64_C (0x0000000000040000),
+   UINT64_C (0x0000000001000080), UINT64_C (0x0000000020040080),
+   UINT64_C (0x0000000021000080), UINT64_C (0x0000000021040000),
+   UINT64_C (0x0000000000040080), UINT64_C (0x0000000020000000),
+   UINT64_C (0x0000000001000000), UINT64_C (0x0000000020040000),
+   UINT64_C (0x0000000020040000), UINT64_C (0x0000000000000000),
+   UINT64_C (0x0000000020000080), UINT64_C (0x0000000021040080),
+   UINT64_C (0x0000000021040080), UINT64_C (0x0000000001000080),
+   UINT64_C (0x0000000021040000), UINT64_C (0x0000000020000080),
+   UINT64_C (0x0000000000000000), UINT64_C (0x0000000021000000),
+   UINT64_C (0x0000000001040080), UINT64_C (0x0000000001000000),
+   UINT64_C (0x0000000021000000), UINT64_C (0x0000000000040080),
+   UINT64_C (0x0000000000040000), UINT64_C (0x0000000021000080),
+   UINT64_C (0x0000000000000080), UINT64_C (0x0000000001000000),
+   UINT64_C (0x0000000020000000), UINT64_C (0x0000000001040000),
+   UINT64_C (0x0000000021000080), UINT64_C (0x0000000020040080),
+   UINT64_C (0x0000000001000080), UINT64_C (0x0000000020000000),
+   UINT64_C (0x0000000021040000), UINT64_C (0x0000000001040080),
+   UINT64_C (0x0000000020040080), UINT64_C (0x0000000000000080),
+   UINT64_C (0x0000000001000000), UINT64_C (0x0000000021040000),
+   UINT64_C (0x0000000021040080), UINT64_C (0x0000000000040080),
+   UINT64_C (0x0000000021000000), UINT64_C (0x0000000021040080),
+   UINT64_C (0x0000000001040000), UINT64_C (0x0000000000000000),
+   UINT64_C (0x0000000020040000), UINT64_C (0x0000000021000000),
+   UINT64_C (0x0000000000040080), UINT64_C (0x0000000001000080),
+   UINT64_C (0x0000000020000080), UINT64_C (0x0000000000040000),
+   UINT64_C (0x0000000000000000), UINT64_C (0x0000000020040000),
+   UINT64_C (0x0000000001040080), UINT64_C (0x0000000020000080)}
+  ,
+  {
+   UINT64_C (0x0000000010000008), UINT64_C (0x0000000010200000),
+   UINT64_C (0x0000000000002000), UINT64_C (0x0000000010202008),
+   UINT64_C (0x0000000010200000), UINT64_C (0x0000000000000008),
+   UINT64_C (0x0000000010202008), UINT64_C (0x0000000000200000),
+   UINT64_C (0x0000000010002000), UINT64_C (0x0000000000202008),
+   UINT64_C (0x0000000000200000), UINT64_C (0x0000000010000008),
+   UINT64_C (0x0000000000200008), UINT64_C (0x0000000010002000),
+   UINT64_C (0x0000000010000000), UINT64_C (0x0000000000002008),
+   UINT64_C (0x0000000000000000), UINT64_C (0x0000000000200008),
+   UINT64_C (0x0000000010002008), UINT64_C (0x0000000000002000),
+   UINT64_C (0x0000000000202000), UINT64_C (0x0000000010002008),
+   UINT64_C (0x0000000000000008), UINT64_C (0x0000000010200008),
+   UINT64_C (0x0000000010200008), UINT64_C (0x0000000000000000),
+   UINT64_C (0x0000000000202008), UINT64_C (0x0000000010202000),
+   UINT64_C (0x0000000000002008), UINT64_C (0x0000000000202000),
+   UINT64_C (0x0000000010202000), UINT64_C (0x0000000010000000),
+   UINT64_C (0x0000000010002000), UINT64_C (0x0000000000000008),
+   UINT64_C (0x0000000010200008), UINT64_C (0x0000000000202000),
+   UINT64_C (0x0000000010202008), UINT64_C (0x0000000000200000),
+   UINT64_C (0x0000000000002008), UINT64_C (0x0000000010000008),
+   UINT64_C (0x0000000000200000), UINT64_C (0x0000000010002000),
+   UINT64_C (0x0000000010000000), UINT64_C (0x0000000000002008),
+   UINT64_C (0x0000000010000008), UINT64_C (0x0000000010202008),
+   UINT64_C (0x0000000000202000), UINT64_C (0x0000000010200000),
+   UINT64_C (0x0000000000202008), UINT64_C (0x0000000010202000),
+   UINT64_C (0x0000000000000000), UINT64_C (0x0000000010200008),
+   UINT64_C (0x0000000000000008), UINT64_C (0x0000000000002000),
+   UINT64_C (0x0000000010200000), UINT64_C (0x0000000000202008),
+   UINT64_C (0x0000000000002000), UINT64_C (0x0000000000200008),
+   UINT64_C (0x0000000010002008), UINT64_C (0x0000000000000000),
+   UINT64_C (0x0000000010202000), UINT64_C (0x0000000010000000),
+   UINT64_C (0x0000000000200008), UINT64_C (0x0000000010002008)}
+  ,
+  {
+   UINT64_C (0x0000000000100000), UINT64_C (0x0000000002100001),
+   UINT64_C (0x0000000002000401), UINT64_C (0x0000000000000000),
+   UINT64_C (0x0000000000000400), UINT64_C (0x0000000002000401),
+   UINT64_C (0x0000000000100401), UINT64_C (0x0000000002100400),
+   UINT64_C (0x0000000002100401), UINT64_C (0x0000000000100000),
+   UINT64_C (0x0000000000000000), UINT64_C (0x0000000002000001),
+   UINT64_C (0x0000000000000001), UINT64_C (0x0000000002000000),
+   UINT64_C (0x0000000002100001), UINT64_C (0x0000000000000401),
+   UINT64_C (0x0000000002000400), UINT64_C (0x0000000000100401),
+   UINT64_C (0x0000000000100001), UINT64_C (0x0000000002000400),
+   UINT64_C (0x0000000002000001), UINT64_C (0x0000000002100000),
+   UINT64_C (0x0000000002100400), UINT64_C (0x0000000000100001),
+   UINT64_C (0x0000000002100000), UINT64_C (0x0000000000000400),
+   UINT64_C (0x0000000000000401), UINT64_C (0x0000000002100401),
+   UINT64_C (0x0000000000100400), UINT64_C (0x0000000000000001),
+   UINT64_C (0x0000000002000000), UINT64_C (0x0000000000100400),
+   UINT64_C (0x0000000002000000), UINT64_C (0x0000000000100400),
+   UINT64_C (0x0000000000100000), UINT64_C (0x0000000002000401),
+   UINT64_C (0x0000000002000401), UINT64_C (0x0000000002100001),
+   UINT64_C (0x0000000002100001), UINT64_C (0x0000000000000001),
+   UINT64_C (0x0000000000100001), UINT64_C (0x0000000002000000),
+   UINT64_C (0x0000000002000400), UINT64_C (0x0000000000100000),
+   UINT64_C (0x0000000002100400), UINT64_C (0x0000000000000401),
+   UINT64_C (0x0000000000100401), UINT64_C (0x0000000002100400),
+   UINT64_C (0x0000000000000401), UINT64_C (0x0000000002000001),
+   UINT64_C (0x0000000002100401), UINT64_C (0x0000000002100000),
+   UINT64_C (0x0000000000100400), UINT64_C (0x0000000000000000),
+   UINT64_C (0x0000000000000001), UINT64_C (0x0000000002100401),
+   UINT64_C (0x0000000000000000), UINT64_C (0x0000000000100401),
+   UINT64_C (0x0000000002100000), UINT64_C (0x0000000000000400),
+   UINT64_C (0x0000000002000001), UINT64_C (0x0000000002000400),
+   UINT64_C (0x0000000000000400), UINT64_C (0x0000000000100001)}
+  ,
+  {
+   UINT64_C (0x0000000008000820), UINT64_C (0x0000000000000800),
+   UINT64_C (0x0000000000020000), UINT64_C (0x0000000008020820),
+   UINT64_C (0x0000000008000000), UINT64_C (0x0000000008000820),
+   UINT64_C (0x0000000000000020), UINT64_C (0x0000000008000000),
+   UINT64_C (0x0000000000020020), UINT64_C (0x0000000008020000),
+   UINT64_C (0x0000000008020820), UINT64_C (0x0000000000020800),
+   UINT64_C (0x0000000008020800), UINT64_C (0x0000000000020820),
+   UINT64_C (0x0000000000000800), UINT64_C (0x0000000000000020),
+   UINT64_C (0x0000000008020000), UINT64_C (0x0000000008000020),
+   UINT64_C (0x0000000008000800), UINT64_C (0x0000000000000820),
+   UINT64_C (0x0000000000020800), UINT64_C (0x0000000000020020),
+   UINT64_C (0x0000000008020020), UINT64_C (0x0000000008020800),
+   UINT64_C (0x0000000000000820), UINT64_C (0x0000000000000000),
+   UINT64_C (0x0000000000000000), UINT64_C (0x0000000008020020),
+   UINT64_C (0x0000000008000020), UINT64_C (0x0000000008000800),
+   UINT64_C (0x0000000000020820), UINT64_C (0x0000000000020000),
+   UINT64_C (0x0000000000020820), UINT64_C (0x0000000000020000),
+   UINT64_C (0x0000000008020800), UINT64_C (0x0000000000000800),
+   UINT64_C (0x0000000000000020), UINT64_C (0x0000000008020020),
+   UINT64_C (0x0000000000000800), UINT64_C (0x0000000000020820),
+   UINT64_C (0x0000000008000800), UINT64_C (0x0000000000000020),
+   UINT64_C (0x0000000008000020), UINT64_C (0x0000000008020000),
+   UINT64_C (0x0000000008020020), UINT64_C (0x0000000008000000),
+   UINT64_C (0x0000000000020000), UINT64_C (0x0000000008000820),
+   UINT64_C (0x0000000000000000), UINT64_C (0x0000000008020820),
+   UINT64_C (0x0000000000020020), UINT64_C (0x0000000008000020),
+   UINT64_C (0x0000000008020000), UINT64_C (0x0000000008000800),
+   UINT64_C (0x0000000008000820), UINT64_C (0x0000000000000000),
+   UINT64_C (0x0000000008020820), UINT64_C (0x0000000000020800),
+   UINT64_C (0x0000000000020800), UINT64_C (0x0000000000000820),
+   UINT64_C (0x0000000000000820), UINT64_C (0x0000000000020020),
+   UINT64_C (0x0000000008000000), UINT64_C (0x0000000008020800)}
+};
+
 uint8_t left_shifts[16] = {
   0, 0, 1, 1, 1, 1, 1, 1, 0, 1, 1, 1, 1, 1, 1, 0
 };
@@ -8179,41 +8457,284 @@ permutation permutations[NUMBER_OF_PERMUTATIONS] = {
   {"N_PC2", 6, N_PC2_K}
 };
 
-uint64_t
-permutate (uint64_t val, int perm) {
+/* Byte-indexed tables backend. */
+static uint64_t
+permutate_tables (uint64_t val, int perm) {
   int i, bytes;
-  uint64_t tmp, res, *table;
-  char *name;
+  uint64_t res, *table;
 
   res = UINT64_C (0x0);
-  tmp = val;
-  if ((perm < 0) || (perm >= NUMBER_OF_PERMUTATIONS))
-    ERROR (0, -1, "unknown permutation: %d", perm);
-  name = permutations[perm].name;
   bytes = permutations[perm].bytes;
   table = permutations[perm].table;
-  if ((bytes < 8) && ((tmp >> (8 * bytes)) != UINT64_C (0x0)))
-    ERROR (0, -1, "Invalid input value for %s permutation: 0x%016" PRIx64, name, tmp);
   for (i = 0; i < bytes; i++) {
-    res |= table[i * 256 + (tmp & UINT64_C (0xff))];
-    tmp >>= 8;
+    res |= table[i * 256 + (val & UINT64_C (0xff))];
+    val >>= 8;
+  }
+  return res;
+}
+
+/* Current backend, selected at startup by des_init(). */
+static uint64_t (*permutate_backend) (uint64_t, int) = permutate_tables;
+static int des_current_backend = DES_BACKEND_TABLES;
+
+#if defined (__x86_64__) && defined (__GNUC__)
+#define DES_X86_64
+#include <immintrin.h>
+#include <cpuid.h>
+
+/* BMI2 backend. Each permutation is split in chains: sets of input bits that
+ * keep their relative order in the output. A chain is extracted with a single
+ * pext and deposited with a single pdep. The permutations of the standard
+ * need 4 (E) to 11 (PC1) chains: the whole backend fits in 3 kB, instead of
+ * 127 kB for the tables. */
+#define MAX_CHAINS 16
+
+typedef struct {
+  int n;			/* Number of chains. */
+  uint64_t src[MAX_CHAINS];	/* Input bits of each chain. */
+  uint64_t dst[MAX_CHAINS];	/* Output bits of each chain. */
+} chains;
+
+static chains permutation_chains[NUMBER_OF_PERMUTATIONS];
+
+static uint64_t __attribute__ ((target ("bmi2")))
+permutate_bmi2 (uint64_t val, int perm) {
+  chains *c;
+  uint64_t res;
+  int i;
+
+  c = &(permutation_chains[perm]);
+  res = UINT64_C (0x0);
+  for (i = 0; i < c->n; i++) {
+    res |= _pdep_u64 (_pext_u64 (val, c->src[i]), c->dst[i]);
   }
   return res;
 }
 
+/* Computes the chains of permutation perm from its table. Input bits are
+ * visited from right to left; each (input, output) bit pair is appended to
+ * the chain which last output bit is the closest one on the right of the
+ * current output bit, or starts a new chain. An input bit appears at most
+ * once per chain (the E permutation duplicates some bits). */
+static void
+des_chains (int perm) {
+  chains *c;
+  uint64_t v;
+  int i, j, k, best, last[64];
+
+  c = &(permutation_chains[perm]);
+  c->n = 0;
+  for (i = 0; i < 8 * permutations[perm].bytes; i++) {
+    v = permutate_tables (UINT64_C (0x1) << i, perm);
+    for (j = 0; j < 64; j++) {
+      if (((v >> j) & UINT64_C (0x1)) == 0)
+        continue;
+      best = -1;
+      for (k = 0; k < c->n; k++) {
+        if (last[k] < j && ((c->src[k] >> i) & UINT64_C (0x1)) == 0 && (best == -1 || last[k] > last[best]))
+          best = k;
+      }
+      if (best == -1) {
+        if (c->n == MAX_CHAINS)
+          ERROR (, -1, "too many chains for %s permutation", permutations[perm].name);
+        best = c->n;
+        c->n += 1;
+        c->src[best] = UINT64_C (0x0);
+        c->dst[best] = UINT64_C (0x0);
+      }
+      c->src[best] |= UINT64_C (0x1) << i;
+      c->dst[best] |= UINT64_C (0x1) << j;
+      last[best] = j;
+    }
+  }
+}
+#endif /* x86-64 */
+
+/* Branch-free Hamming weight (SWAR), that compilers vectorize. */
+static inline int
+hamming_weight_swar (uint64_t val) {
+  val -= (val >> 1) & UINT64_C (0x5555555555555555);
+  val = (val & UINT64_C (0x3333333333333333)) + ((val >> 2) & UINT64_C (0x3333333333333333));
+  val = (val + (val >> 4)) & UINT64_C (0x0f0f0f0f0f0f0f0f);
+  return (int) ((val * UINT64_C (0x0101010101010101)) >> 56);
+}
+
+/* Kernels of hamming_weight_n() (in2 == NULL) and hamming_distance_n(): out[i]
+ * = HW(in1[i]) or HW(in1[i] ^ in2[i]), 0 <= i < n. */
+static void
+hamming_n_swar (uint64_t * in1, uint64_t * in2, int *out, int n) {
+  int i;
+
+  if (in2 == NULL)
+    for (i = 0; i < n; i++)
+      out[i] = hamming_weight_swar (in1[i]);
+  else
+    for (i = 0; i < n; i++)
+      out[i] = hamming_weight_swar (in1[i] ^ in2[i]);
+}
+
+#ifdef DES_X86_64
+/* Population counts of the 4 64 bits words of v, with a 16 entries look-up
+ * table of the nibbles Hamming weights (vpshufb) and a horizontal sum of the 8
+ * bytes of each word (vpsadbw). */
+static inline __m256i __attribute__ ((target ("avx2")))
+hamming_popcnt_avx2 (__m256i v) {
+  __m256i lut, nibble, lo, hi;
+
+  lut = _mm256_setr_epi8 (0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+			  0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  nibble = _mm256_set1_epi8 (0x0f);
+  lo = _mm256_shuffle_epi8 (lut, _mm256_and_si256 (v, nibble));
+  hi = _mm256_shuffle_epi8 (lut, _mm256_and_si256 (_mm256_srli_epi16 (v, 4), nibble));
+  return _mm256_sad_epu8 (_mm256_add_epi8 (lo, hi), _mm256_setzero_si256 ());
+}
+
+/* 8 words per iteration: the two vectors of 4 counts are interleaved in a
+ * single vector of 8 32 bits counts, then put back in order. */
+static void __attribute__ ((target ("popcnt,avx2")))
+hamming_n_avx2 (uint64_t * in1, uint64_t * in2, int *out, int n) {
+  __m256i v0, v1, order;
+  int i;
+
+  order = _mm256_setr_epi32 (0, 2, 4, 6, 1, 3, 5, 7);
+  for (i = 0; i + 8 <= n; i += 8) {
+    v0 = _mm256_loadu_si256 ((__m256i *) (in1 + i));
+    v1 = _mm256_loadu_si256 ((__m256i *) (in1 + i + 4));
+    if (in2 != NULL) {
+      v0 = _mm256_xor_si256 (v0, _mm256_loadu_si256 ((__m256i *) (in2 + i)));
+      v1 = _mm256_xor_si256 (v1, _mm256_loadu_si256 ((__m256i *) (in2 + i + 4)));
+    }
+    v0 = hamming_popcnt_avx2 (v0);
+    v1 = hamming_popcnt_avx2 (v1);
+    v0 = _mm256_blend_epi32 (v0, _mm256_slli_epi64 (v1, 32), 0xaa);
+    _mm256_storeu_si256 ((__m256i *) (out + i), _mm256_permutevar8x32_epi32 (v0, order));
+  }
+  for (; i < n; i++)
+    out[i] = __builtin_popcountll (in1[i] ^ (in2 == NULL ? UINT64_C (0x0) : in2[i]));
+}
+
+/* 8 words per iteration with the vpopcntq instruction and a truncation of the
+ * 8 counts to 32 bits. */
+static void __attribute__ ((target ("popcnt,avx2,avx512f,avx512vpopcntdq")))
+hamming_n_avx512 (uint64_t * in1, uint64_t * in2, int *out, int n) {
+  __m512i v;
+  int i;
+
+  for (i = 0; i + 8 <= n; i += 8) {
+    v = _mm512_loadu_si512 ((void *) (in1 + i));
+    if (in2 != NULL)
+      v = _mm512_xor_si512 (v, _mm512_loadu_si512 ((void *) (in2 + i)));
+    _mm256_storeu_si256 ((__m256i *) (out + i), _mm512_cvtepi64_epi32 (_mm512_popcnt_epi64 (v)));
+  }
+  for (; i < n; i++)
+    out[i] = __builtin_popcountll (in1[i] ^ (in2 == NULL ? UINT64_C (0x0) : in2[i]));
+}
+#endif /* x86-64 */
+
+/* Kernel of the array Hamming weights and distances, selected at startup. */
+static void (*hamming_kernel) (uint64_t *, uint64_t *, int *, int) = hamming_n_swar;
+
+#ifdef DES_X86_64
+/* Returns 1 if pext and pdep are microcoded, thus much slower than the lookup
+ * tables: AMD processors before Zen 3 (family 0x19). */
+static int
+des_slow_bmi2 (void) {
+  unsigned int eax, ebx, ecx, edx, family;
+
+  if (!__get_cpuid (0, &eax, &ebx, &ecx, &edx))
+    return 1;
+  /* Vendor string "AuthenticAMD" in ebx, edx, ecx. */
+  if (ebx != 0x68747541 || edx != 0x69746e65 || ecx != 0x444d4163)
+    return 0;
+  if (!__get_cpuid (1, &eax, &ebx, &ecx, &edx))
+    return 1;
+  family = (eax >> 8) & 0xf;
+  if (family == 0xf)
+    family += (eax >> 20) & 0xff;
+  return family < 0x19;
+}
+#endif
+
+/* Selects the fastest available backend and Hamming weights kernel, once, at
+ * program startup: BMI2 if the processor supports it, unless pext and pdep are
+ * microcoded (see des_slow_bmi2), else the portable tables. */
+static void __attribute__ ((constructor))
+des_init (void) {
+#ifdef DES_X86_64
+  int i;
+
+  for (i = 0; i < NUMBER_OF_PERMUTATIONS; i++)
+    des_chains (i);
+  __builtin_cpu_init ();
+  if (__builtin_cpu_supports ("avx512vpopcntdq") && __builtin_cpu_supports ("avx512f"))
+    hamming_kernel = hamming_n_avx512;
+  else if (__builtin_cpu_supports ("avx2"))
+    hamming_kernel = hamming_n_avx2;
+  if (!des_slow_bmi2 ())
+    des_set_backend (DES_BACKEND_BMI2);
+#endif
+}
+
+int
+des_set_backend (int backend) {
+  if (backend != DES_BACKEND_TABLES && backend != DES_BACKEND_BMI2)
+    ERROR (0, -1, "unknown backend: %d", backend);
+  permutate_backend = permutate_tables;
+  des_current_backend = DES_BACKEND_TABLES;
+#ifdef DES_X86_64
+  __builtin_cpu_init ();
+  if (backend == DES_BACKEND_BMI2 && __builtin_cpu_supports ("bmi2")) {
+    permutate_backend = permutate_bmi2;
+    des_current_backend = DES_BACKEND_BMI2;
+  }
+#endif
+  return des_current_backend;
+}
+
+int
+des_backend (void) {
+  return des_current_backend;
+}
+
+uint64_t
+permutate (uint64_t val, int perm) {
+  int bytes;
+  char *name;
+
+  if ((perm < 0) || (perm >= NUMBER_OF_PERMUTATIONS))
+    ERROR (0, -1, "unknown permutation: %d", perm);
+  name = permutations[perm].name;
+  bytes = permutations[perm].bytes;
+  if ((bytes < 8) && ((val >> (8 * bytes)) != UINT64_C (0x0)))
+    ERROR (0, -1, "Invalid input value for %s permutation: 0x%016" PRIx64, name, val);
+  return permutate_backend (val, perm);
+}
+
+/* With the popcnt instruction when the processor supports it (selected by the
+ * dynamic loader), else with the compiler's portable population count. */
+#ifdef DES_X86_64
+__attribute__ ((target_clones ("popcnt", "default")))
+#endif
 int
 hamming_weight (uint64_t val)
 {
-  int res;
-  int i;
+  return __builtin_popcountll (val);
+}
 
-  res = 0;
-  for (i = 0; i < 64; i++)
-    {
-      res += (int) (val & UINT64_C (1));
-      val >>= 1;
-    }
-  return res;
+int
+hamming_weight4 (uint64_t val)
+{
+  if (val > UINT64_C (0xf))
+    ERROR (0, -1, "Invalid 4 bits input value: 0x%016" PRIx64, val);
+  return hamming_weight4_fast (val);
+}
+
+int
+hamming_weight6 (uint64_t val)
+{
+  if (val > UINT64_C (0x3f))
+    ERROR (0, -1, "Invalid 6 bits input value: 0x%016" PRIx64, val);
+  return hamming_weight6_fast (val);
 }
 
 int
@@ -8332,6 +8853,16 @@ des_sboxes (uint64_t val) {
   return res;
 }
 
+uint64_t
+des_sp (uint64_t val) {
+  if (val >> 48)
+    ERROR (0, -1, "Invalid SP input value: 0x%016" PRIx64, val);
+  return SP_K[0][(val >> 42) & UINT64_C (0x3f)] ^ SP_K[1][(val >> 36) & UINT64_C (0x3f)] ^
+    SP_K[2][(val >> 30) & UINT64_C (0x3f)] ^ SP_K[3][(val >> 24) & UINT64_C (0x3f)] ^
+    SP_K[4][(val >> 18) & UINT64_C (0x3f)] ^ SP_K[5][(val >> 12) & UINT64_C (0x3f)] ^
+    SP_K[6][(val >> 6) & UINT64_C (0x3f)] ^ SP_K[7][val & UINT64_C (0x3f)];
+}
+
 uint64_t
 des_right_half (uint64_t val) {
   return val & UINT64_C (0xffffffff);
@@ -8342,6 +8873,141 @@ des_left_half (uint64_t val) {
   return val >> 32;
 }
 
+/* Checks that n is not negative and that the n values of array in are less
+ * than width bits wide. Scans the whole array once, with a branch-free
+ * reduction, and only locates the first invalid value on errors. name is the
+ * calling function, for error messages. */
+static void
+des_check_n (char *name, uint64_t * in, int n, int width) {
+  uint64_t acc;
+  int i;
+
+  if (n < 0)
+    ERROR (, -1, "%s: invalid number of values: %d", name, n);
+  if (width >= 64)
+    return;
+  acc = UINT64_C (0x0);
+  for (i = 0; i < n; i++)
+    acc |= in[i];
+  if (acc >> width) {
+    i = 0;
+    while ((in[i] >> width) == UINT64_C (0x0))
+      i++;
+    ERROR (, -1, "%s: invalid input value #%d: 0x%016" PRIx64, name, i, in[i]);
+  }
+}
+
+void
+des_ip_n (uint64_t * in, uint64_t * out, int n) {
+  int i;
+
+  des_check_n ("des_ip_n", in, n, 64);
+  for (i = 0; i < n; i++)
+    out[i] = des_ip_fast (in[i]);
+}
+
+void
+des_n_ip_n (uint64_t * in, uint64_t * out, int n) {
+  int i;
+
+  des_check_n ("des_n_ip_n", in, n, 64);
+  for (i = 0; i < n; i++)
+    out[i] = des_n_ip_fast (in[i]);
+}
+
+void
+des_fp_n (uint64_t * in, uint64_t * out, int n) {
+  int i;
+
+  des_check_n ("des_fp_n", in, n, 64);
+  for (i = 0; i < n; i++)
+    out[i] = des_fp_fast (in[i]);
+}
+
+void
+des_n_fp_n (uint64_t * in, uint64_t * out, int n) {
+  int i;
+
+  des_check_n ("des_n_fp_n", in, n, 64);
+  for (i = 0; i < n; i++)
+    out[i] = des_n_fp_fast (in[i]);
+}
+
+void
+des_e_n (uint64_t * in, uint64_t * out, int n) {
+  int i;
+
+  des_check_n ("des_e_n", in, n, 32);
+  for (i = 0; i < n; i++)
+    out[i] = des_e_fast (in[i]);
+}
+
+void
+des_p_n (uint64_t * in, uint64_t * out, int n) {
+  int i;
+
+  des_check_n ("des_p_n", in, n, 32);
+  for (i = 0; i < n; i++)
+    out[i] = des_p_fast (in[i]);
+}
+
+void
+des_n_p_n (uint64_t * in, uint64_t * out, int n) {
+  int i;
+
+  des_check_n ("des_n_p_n", in, n, 32);
+  for (i = 0; i < n; i++)
+    out[i] = des_n_p_fast (in[i]);
+}
+
+void
+des_sboxes_n (uint64_t * in, uint64_t * out, int n) {
+  int i;
+
+  des_check_n ("des_sboxes_n", in, n, 48);
+  for (i = 0; i < n; i++)
+    out[i] = des_sboxes_fast (in[i]);
+}
+
+void
+des_sp_n (uint64_t * in, uint64_t * out, int n) {
+  int i;
+
+  des_check_n ("des_sp_n", in, n, 48);
+  for (i = 0; i < n; i++)
+    out[i] = des_sp_fast (in[i]);
+}
+
+void
+des_right_half_n (uint64_t * in, uint64_t * out, int n) {
+  int i;
+
+  des_check_n ("des_right_half_n", in, n, 64);
+  for (i = 0; i < n; i++)
+    out[i] = des_right_half_fast (in[i]);
+}
+
+void
+des_left_half_n (uint64_t * in, uint64_t * out, int n) {
+  int i;
+
+  des_check_n ("des_left_half_n", in, n, 64);
+  for (i = 0; i < n; i++)
+    out[i] = des_left_half_fast (in[i]);
+}
+
+void
+hamming_weight_n (uint64_t * in, int *out, int n) {
+  des_check_n ("hamming_weight_n", in, n, 64);
+  hamming_kernel (in, NULL, out, n);
+}
+
+void
+hamming_distance_n (uint64_t * in1, uint64_t * in2, int *out, int n) {
+  des_check_n ("hamming_distance_n", in1, n, 64);
+  hamming_kernel (in1, in2, out, n);
+}
+
 uint64_t
 des_ls (uint64_t val) {
   uint64_t c, d;
@@ -8377,6 +9043,15 @@ des_f (uint64_t rk, uint64_t val) {
   return des_p (des_sboxes (des_e (val) ^ rk));
 }
 
+uint64_t
+des_f_sp (uint64_t rk, uint64_t val) {
+  if (val >> 32)
+    ERROR (0, -1, "Invalid R input value for F function: 0x%016" PRIx64, val);
+  if (rk >> 48)
+    ERROR (0, -1, "Invalid RK input value for F function: 0x%016" PRIx64, rk);
+  return des_sp (des_e (val) ^ rk);
+}
+
 void
 des_ks (uint64_t * ks, uint64_t val) {
   uint64_t cd;
@@ -8424,6 +9099,127 @@ des_dec (uint64_t * ks, uint64_t val) {
   return des_fp ((r << 32) | l);
 }
 
+uint64_t
+des_rounds_fwd (uint64_t * ks, uint64_t state, int from, int to) {
+  uint64_t r, l, tmp;
+  int i;
+
+  if (from < 0 || to > 16 || from > to)
+    ERROR (0, -1, "Invalid forward rounds range: %d to %d", from, to);
+  r = des_right_half (state);
+  l = des_left_half (state);
+  for (i = from; i < to; i++) {
+    tmp = r;
+    r = l ^ des_f_sp (ks[i], r);
+    l = tmp;
+  }
+  return (l << 32) | r;
+}
+
+uint64_t
+des_rounds_bwd (uint64_t * ks, uint64_t state, int from, int to) {
+  uint64_t r, l, tmp;
+  int i;
+
+  if (to < 0 || from > 16 || to > from)
+    ERROR (0, -1, "Invalid backward rounds range: %d to %d", from, to);
+  r = des_right_half (state);
+  l = des_left_half (state);
+  for (i = from - 1; i >= to; i--) {
+    tmp = l;
+    l = r ^ des_f_sp (ks[i], l);
+    r = tmp;
+  }
+  return (l << 32) | r;
+}
+
+/* Checks the round keys of a key schedule once, before the unchecked loops of
+ * the array variants. */
+static void
+des_check_ks (char *name, uint64_t * ks) {
+  int i;
+
+  for (i = 0; i < 16; i++) {
+    if (ks[i] >> 48)
+      ERROR (, -1, "%s: invalid round key #%d: 0x%016" PRIx64, name, i + 1, ks[i]);
+  }
+}
+
+void
+des_states_n (uint64_t * ks, uint64_t * pt, uint64_t * states, int n) {
+  uint64_t r, l, tmp, *s;
+  int i, j;
+
+  des_check_ks ("des_states_n", ks);
+  des_check_n ("des_states_n", pt, n, 64);
+  for (j = 0; j < n; j++) {
+    s = states + 17 * j;
+    s[0] = des_ip_fast (pt[j]);
+    r = des_right_half_fast (s[0]);
+    l = des_left_half_fast (s[0]);
+    for (i = 0; i < 16; i++) {
+      tmp = r;
+      r = l ^ des_f_sp_fast (ks[i], r);
+      l = tmp;
+      s[i + 1] = (l << 32) | r;
+    }
+  }
+}
+
+void
+des_states_bwd_n (uint64_t * ks, uint64_t * ct, uint64_t * states, int n) {
+  uint64_t r, l, tmp, *s;
+  int i, j;
+
+  des_check_ks ("des_states_bwd_n", ks);
+  des_check_n ("des_states_bwd_n", ct, n, 64);
+  for (j = 0; j < n; j++) {
+    s = states + 17 * j;
+    tmp = des_ip_fast (ct[j]);
+    l = des_right_half_fast (tmp);
+    r = des_left_half_fast (tmp);
+    s[16] = (l << 32) | r;
+    for (i = 15; i >= 0; i--) {
+      tmp = l;
+      l = r ^ des_f_sp_fast (ks[i], l);
+      r = tmp;
+      s[i] = (l << 32) | r;
+    }
+  }
+}
+
+uint64_t
+des_enc_sp (uint64_t * ks, uint64_t val) {
+  uint64_t lr, r, l, tmp;
+  int i;
+
+  lr = des_ip (val);
+  r = des_right_half (lr);
+  l = des_left_half (lr);
+  for (i = 0; i < 16; i++) {
+    tmp = r;
+    r = l ^ des_f_sp (ks[i], r);
+    l = tmp;
+  }
+  return des_fp ((r << 32) | l);
+}
+
+uint64_t
+des_dec_sp (uint64_t * ks, uint64_t val) {
+  uint64_t lr, r, l, tmp;
+  int i;
+
+  lr = des_ip (val);
+  r = des_right_half (lr);
+  l = des_left_half (lr);
+  for (i = 15; i >= 0; i--) {
+    tmp = r;
+    r = l ^ des_f_sp (ks[i], r);
+    l = tmp;
+  }
+  return des_fp ((r << 32) | l);
+}
+
 int
 des_check_f (uint64_t (*f_enc) (uint64_t *, uint64_t), uint64_t (*f_dec) (uint64_t *, uint64_t)) {
   uint64_t tmp, ks[16];
@@ -8465,5 +9261,5 @@ des_check_f (uint64_t (*f_enc) (uint64_t *, uint64_t), uint64_t (*f_dec) (uint64
 
 int
 des_check (void) {
-  return des_check_f (des_enc, des_dec);
+  return des_check_f (des_enc, des_dec) && des_check_f (des_enc_sp, des_dec_sp);
 }
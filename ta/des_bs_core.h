@@ -0,0 +1,410 @@
+/*
+ * Copyright (C) Telecom Paris
+ *
+ * This file must be used under the terms of the CeCILL. This source
+ * file is licensed as described in the file COPYING, which you should
+ * have received as part of this distribution. The terms are also
+ * available at:
+ * http://www.cecill.info/licences/Licence_CeCILL_V1.1-US.txt
+*/
+
+/* Bitsliced DES engine, word type independent. Not a public header: it is
+ * included by des_bs.c once per word type, with the following macros defined:
+ * - BS_WORD: the word type (uint64_t or a GCC vector of uint64_t),
+ * - BS_LANES: the number of uint64_t in a BS_WORD,
+ * - BS_LANE(w, g): lvalue of the g-th uint64_t of word w,
+ * - BS_ONES: a BS_WORD with all bits set,
+ * - BS_NAME(f): the name of function f for this word type.
+ * and with the ip_src, fp_src, e_src, p_src and ks_src tables and the
+ * des_bs_transpose() function in scope. */
+
+/* SBoxes: x[5..0] is the 6 bits input (x[5] leftmost), y[3..0] the 4 bits
+ * output (y[3] leftmost). Algebraic normal forms of the SBOX_K tables,
+ * monomials m[v] = AND of the x[i] such that bit i of v is set. */
+
+static void
+BS_NAME (sbox1) (BS_WORD * x, BS_WORD * y) {
+  BS_WORD m[64];
+
+  m[3] = x[0] & x[1]; m[5] = x[0] & x[2]; m[6] = x[1] & x[2]; m[7] = m[3] & x[2];
+  m[9] = x[0] & x[3]; m[10] = x[1] & x[3]; m[11] = m[3] & x[3]; m[12] = x[2] & x[3];
+  m[13] = m[5] & x[3]; m[14] = m[6] & x[3]; m[15] = m[7] & x[3]; m[17] = x[0] & x[4];
+  m[18] = x[1] & x[4]; m[19] = m[3] & x[4]; m[20] = x[2] & x[4]; m[21] = m[5] & x[4];
+  m[22] = m[6] & x[4]; m[23] = m[7] & x[4]; m[24] = x[3] & x[4]; m[25] = m[9] & x[4];
+  m[26] = m[10] & x[4]; m[27] = m[11] & x[4]; m[28] = m[12] & x[4]; m[29] = m[13] & x[4];
+  m[33] = x[0] & x[5]; m[34] = x[1] & x[5]; m[35] = m[3] & x[5]; m[36] = x[2] & x[5];
+  m[37] = m[5] & x[5]; m[38] = m[6] & x[5]; m[40] = x[3] & x[5]; m[42] = m[10] & x[5];
+  m[43] = m[11] & x[5]; m[44] = m[12] & x[5]; m[45] = m[13] & x[5]; m[46] = m[14] & x[5];
+  m[47] = m[15] & x[5]; m[48] = x[4] & x[5]; m[49] = m[17] & x[5]; m[50] = m[18] & x[5];
+  m[51] = m[19] & x[5]; m[52] = m[20] & x[5]; m[53] = m[21] & x[5]; m[54] = m[22] & x[5];
+  m[55] = m[23] & x[5]; m[56] = m[24] & x[5]; m[57] = m[25] & x[5]; m[58] = m[26] & x[5];
+  m[59] = m[27] & x[5]; m[60] = m[28] & x[5]; m[61] = m[29] & x[5];
+  y[3] = ~(x[0] ^ x[1] ^ m[7] ^ x[3] ^ m[12] ^ m[13] ^ m[14] ^ x[4] ^ m[24] ^
+    m[28] ^ x[5] ^ m[34] ^ m[36] ^ m[37] ^ m[42] ^ m[44] ^ m[45] ^ m[46] ^
+    m[51] ^ m[52] ^ m[53] ^ m[54] ^ m[56] ^ m[59] ^ m[60] ^ m[61]);
+  y[2] = ~(x[0] ^ m[3] ^ m[5] ^ m[6] ^ x[3] ^ m[10] ^ m[11] ^ m[13] ^ m[15] ^
+    x[4] ^ m[17] ^ m[20] ^ m[21] ^ m[22] ^ m[25] ^ m[33] ^ m[34] ^ m[38] ^
+    m[40] ^ m[43] ^ m[44] ^ m[47] ^ m[48] ^ m[49] ^ m[50] ^ m[55] ^ m[56] ^
+    m[57] ^ m[58] ^ m[59] ^ m[60] ^ m[61]);
+  y[1] = ~(x[0] ^ x[1] ^ x[2] ^ m[6] ^ m[7] ^ m[9] ^ m[10] ^ m[12] ^ m[13] ^
+    m[17] ^ m[18] ^ m[20] ^ m[21] ^ m[23] ^ m[24] ^ m[25] ^ m[26] ^ m[28] ^
+    m[29] ^ x[5] ^ m[34] ^ m[35] ^ m[44] ^ m[47] ^ m[48] ^ m[49] ^ m[51] ^
+    m[52] ^ m[53] ^ m[54] ^ m[55] ^ m[56] ^ m[57] ^ m[58] ^ m[59] ^ m[60] ^
+    m[61]);
+  y[0] = m[3] ^ x[2] ^ m[10] ^ x[4] ^ m[17] ^ m[18] ^ m[21] ^ m[22] ^ m[25] ^
+    m[27] ^ m[33] ^ m[34] ^ m[35] ^ m[36] ^ m[37] ^ m[38] ^ m[40] ^ m[42] ^
+    m[44] ^ m[45] ^ m[46] ^ m[47] ^ m[50] ^ m[51] ^ m[54] ^ m[56] ^ m[59] ^
+    m[60] ^ m[61];
+}
+
+static void
+BS_NAME (sbox2) (BS_WORD * x, BS_WORD * y) {
+  BS_WORD m[64];
+
+  m[3] = x[0] & x[1]; m[5] = x[0] & x[2]; m[6] = x[1] & x[2]; m[7] = m[3] & x[2];
+  m[9] = x[0] & x[3]; m[10] = x[1] & x[3]; m[11] = m[3] & x[3]; m[12] = x[2] & x[3];
+  m[13] = m[5] & x[3]; m[14] = m[6] & x[3]; m[15] = m[7] & x[3]; m[17] = x[0] & x[4];
+  m[18] = x[1] & x[4]; m[19] = m[3] & x[4]; m[20] = x[2] & x[4]; m[21] = m[5] & x[4];
+  m[22] = m[6] & x[4]; m[23] = m[7] & x[4]; m[24] = x[3] & x[4]; m[25] = m[9] & x[4];
+  m[26] = m[10] & x[4]; m[27] = m[11] & x[4]; m[28] = m[12] & x[4]; m[33] = x[0] & x[5];
+  m[35] = m[3] & x[5]; m[38] = m[6] & x[5]; m[39] = m[7] & x[5]; m[40] = x[3] & x[5];
+  m[41] = m[9] & x[5]; m[42] = m[10] & x[5]; m[43] = m[11] & x[5]; m[44] = m[12] & x[5];
+  m[45] = m[13] & x[5]; m[46] = m[14] & x[5]; m[48] = x[4] & x[5]; m[49] = m[17] & x[5];
+  m[50] = m[18] & x[5]; m[51] = m[19] & x[5]; m[52] = m[20] & x[5]; m[53] = m[21] & x[5];
+  m[54] = m[22] & x[5]; m[55] = m[23] & x[5]; m[56] = m[24] & x[5]; m[57] = m[25] & x[5];
+  m[58] = m[26] & x[5]; m[59] = m[27] & x[5]; m[60] = m[28] & x[5];
+  y[3] = ~(x[0] ^ x[1] ^ m[6] ^ x[3] ^ m[17] ^ m[20] ^ m[22] ^ m[24] ^ m[25] ^
+    x[5] ^ m[35] ^ m[38] ^ m[39] ^ m[43] ^ m[49] ^ m[51] ^ m[54] ^ m[55] ^
+    m[56] ^ m[57]);
+  y[2] = ~(x[0] ^ x[1] ^ x[2] ^ m[7] ^ m[9] ^ m[15] ^ x[4] ^ m[20] ^ m[21] ^
+    m[24] ^ x[5] ^ m[54] ^ m[55] ^ m[58] ^ m[59]);
+  y[1] = ~(x[1] ^ x[2] ^ m[10] ^ m[12] ^ m[13] ^ m[14] ^ x[4] ^ m[19] ^ m[21] ^
+    m[23] ^ m[25] ^ x[5] ^ m[35] ^ m[38] ^ m[40] ^ m[42] ^ m[44] ^ m[45] ^
+    m[46] ^ m[48] ^ m[49] ^ m[50] ^ m[52] ^ m[53] ^ m[55] ^ m[56] ^ m[58] ^
+    m[59] ^ m[60]);
+  y[0] = ~(x[2] ^ m[7] ^ x[3] ^ m[9] ^ m[10] ^ m[17] ^ m[22] ^ m[23] ^ m[26] ^
+    m[27] ^ x[5] ^ m[33] ^ m[35] ^ m[39] ^ m[40] ^ m[41] ^ m[42] ^ m[43] ^
+    m[48] ^ m[50] ^ m[51] ^ m[53] ^ m[57] ^ m[59]);
+}
+
+static void
+BS_NAME (sbox3) (BS_WORD * x, BS_WORD * y) {
+  BS_WORD m[64];
+
+  m[3] = x[0] & x[1]; m[5] = x[0] & x[2]; m[6] = x[1] & x[2]; m[7] = m[3] & x[2];
+  m[9] = x[0] & x[3]; m[10] = x[1] & x[3]; m[11] = m[3] & x[3]; m[12] = x[2] & x[3];
+  m[13] = m[5] & x[3]; m[14] = m[6] & x[3]; m[15] = m[7] & x[3]; m[17] = x[0] & x[4];
+  m[18] = x[1] & x[4]; m[19] = m[3] & x[4]; m[20] = x[2] & x[4]; m[21] = m[5] & x[4];
+  m[22] = m[6] & x[4]; m[23] = m[7] & x[4]; m[24] = x[3] & x[4]; m[25] = m[9] & x[4];
+  m[26] = m[10] & x[4]; m[27] = m[11] & x[4]; m[28] = m[12] & x[4]; m[29] = m[13] & x[4];
+  m[33] = x[0] & x[5]; m[34] = x[1] & x[5]; m[36] = x[2] & x[5]; m[37] = m[5] & x[5];
+  m[38] = m[6] & x[5]; m[39] = m[7] & x[5]; m[40] = x[3] & x[5]; m[42] = m[10] & x[5];
+  m[43] = m[11] & x[5]; m[44] = m[12] & x[5]; m[45] = m[13] & x[5]; m[47] = m[15] & x[5];
+  m[48] = x[4] & x[5]; m[49] = m[17] & x[5]; m[50] = m[18] & x[5]; m[51] = m[19] & x[5];
+  m[52] = m[20] & x[5]; m[53] = m[21] & x[5]; m[54] = m[22] & x[5]; m[55] = m[23] & x[5];
+  m[56] = m[24] & x[5]; m[57] = m[25] & x[5]; m[58] = m[26] & x[5]; m[59] = m[27] & x[5];
+  m[60] = m[28] & x[5]; m[61] = m[29] & x[5];
+  y[3] = ~(x[1] ^ m[5] ^ m[6] ^ m[7] ^ x[3] ^ m[10] ^ m[12] ^ m[15] ^ x[4] ^
+    m[20] ^ m[22] ^ m[23] ^ m[26] ^ m[27] ^ m[28] ^ m[33] ^ m[36] ^ m[37] ^
+    m[38] ^ m[39] ^ m[40] ^ m[43] ^ m[44] ^ m[47] ^ m[48] ^ m[52] ^ m[54] ^
+    m[55] ^ m[56] ^ m[60]);
+  y[2] = x[0] ^ m[5] ^ m[6] ^ m[7] ^ x[3] ^ m[10] ^ m[17] ^ m[18] ^ m[19] ^
+    m[20] ^ m[21] ^ m[24] ^ m[25] ^ m[26] ^ m[27] ^ m[28] ^ x[5] ^ m[39] ^
+    m[47] ^ m[48] ^ m[49] ^ m[50] ^ m[51] ^ m[52] ^ m[56] ^ m[57] ^ m[58] ^
+    m[59] ^ m[60];
+  y[1] = ~(x[0] ^ x[1] ^ x[2] ^ m[5] ^ m[7] ^ m[9] ^ m[10] ^ m[11] ^ m[12] ^
+    m[13] ^ m[14] ^ m[15] ^ x[4] ^ m[18] ^ m[19] ^ m[20] ^ m[22] ^ m[24] ^
+    m[25] ^ m[28] ^ m[29] ^ x[5] ^ m[33] ^ m[36] ^ m[37] ^ m[38] ^ m[39] ^
+    m[42] ^ m[43] ^ m[45] ^ m[47] ^ m[49] ^ m[50] ^ m[51] ^ m[52] ^ m[53] ^
+    m[55] ^ m[60] ^ m[61]);
+  y[0] = x[0] ^ x[2] ^ m[6] ^ m[10] ^ x[4] ^ x[5] ^ m[33] ^ m[34] ^ m[37] ^
+    m[38] ^ m[40] ^ m[42] ^ m[48] ^ m[49] ^ m[50] ^ m[51] ^ m[56] ^ m[57] ^
+    m[58] ^ m[61];
+}
+
+static void
+BS_NAME (sbox4) (BS_WORD * x, BS_WORD * y) {
+  BS_WORD m[64];
+
+  m[3] = x[0] & x[1]; m[5] = x[0] & x[2]; m[6] = x[1] & x[2]; m[7] = m[3] & x[2];
+  m[9] = x[0] & x[3]; m[10] = x[1] & x[3]; m[11] = m[3] & x[3]; m[12] = x[2] & x[3];
+  m[13] = m[5] & x[3]; m[14] = m[6] & x[3]; m[15] = m[7] & x[3]; m[17] = x[0] & x[4];
+  m[18] = x[1] & x[4]; m[19] = m[3] & x[4]; m[20] = x[2] & x[4]; m[22] = m[6] & x[4];
+  m[23] = m[7] & x[4]; m[24] = x[3] & x[4]; m[25] = m[9] & x[4]; m[26] = m[10] & x[4];
+  m[27] = m[11] & x[4]; m[28] = m[12] & x[4]; m[29] = m[13] & x[4]; m[33] = x[0] & x[5];
+  m[34] = x[1] & x[5]; m[35] = m[3] & x[5]; m[36] = x[2] & x[5]; m[37] = m[5] & x[5];
+  m[38] = m[6] & x[5]; m[39] = m[7] & x[5]; m[40] = x[3] & x[5]; m[41] = m[9] & x[5];
+  m[42] = m[10] & x[5]; m[43] = m[11] & x[5]; m[44] = m[12] & x[5]; m[45] = m[13] & x[5];
+  m[46] = m[14] & x[5]; m[47] = m[15] & x[5]; m[48] = x[4] & x[5]; m[50] = m[18] & x[5];
+  m[51] = m[19] & x[5]; m[52] = m[20] & x[5]; m[54] = m[22] & x[5]; m[56] = m[24] & x[5];
+  m[57] = m[25] & x[5]; m[58] = m[26] & x[5]; m[59] = m[27] & x[5]; m[60] = m[28] & x[5];
+  y[3] = x[0] ^ x[1] ^ m[3] ^ x[2] ^ m[5] ^ m[7] ^ m[9] ^ m[10] ^ m[17] ^ m[18]
+    ^ m[19] ^ m[22] ^ m[23] ^ m[24] ^ m[26] ^ m[27] ^ m[29] ^ x[5] ^ m[35] ^
+    m[36] ^ m[37] ^ m[43] ^ m[44] ^ m[45] ^ m[46] ^ m[47] ^ m[50] ^ m[51] ^
+    m[52] ^ m[54] ^ m[58] ^ m[59] ^ m[60];
+  y[2] = ~(m[3] ^ m[5] ^ m[6] ^ m[7] ^ x[3] ^ m[9] ^ m[10] ^ x[4] ^ m[17] ^
+    m[19] ^ m[23] ^ m[24] ^ m[27] ^ m[28] ^ m[29] ^ x[5] ^ m[34] ^ m[35] ^
+    m[37] ^ m[42] ^ m[43] ^ m[45] ^ m[47] ^ m[51] ^ m[52] ^ m[54] ^ m[59] ^
+    m[60]);
+  y[1] = ~(x[0] ^ x[1] ^ m[3] ^ m[5] ^ m[6] ^ x[3] ^ m[14] ^ m[15] ^ x[4] ^
+    m[17] ^ m[19] ^ m[23] ^ m[25] ^ m[28] ^ m[29] ^ m[33] ^ m[34] ^ m[35] ^
+    m[36] ^ m[37] ^ m[38] ^ m[39] ^ m[41] ^ m[42] ^ m[46] ^ m[47] ^ m[48] ^
+    m[50] ^ m[52] ^ m[54] ^ m[57] ^ m[58] ^ m[59] ^ m[60]);
+  y[0] = ~(m[3] ^ x[2] ^ m[5] ^ m[6] ^ x[3] ^ m[15] ^ m[17] ^ m[18] ^ m[19] ^
+    m[22] ^ m[23] ^ m[24] ^ m[25] ^ m[29] ^ x[5] ^ m[33] ^ m[35] ^ m[37] ^
+    m[39] ^ m[40] ^ m[41] ^ m[42] ^ m[47] ^ m[48] ^ m[50] ^ m[52] ^ m[54] ^
+    m[56] ^ m[57] ^ m[59] ^ m[60]);
+}
+
+static void
+BS_NAME (sbox5) (BS_WORD * x, BS_WORD * y) {
+  BS_WORD m[64];
+
+  m[3] = x[0] & x[1]; m[5] = x[0] & x[2]; m[6] = x[1] & x[2]; m[7] = m[3] & x[2];
+  m[9] = x[0] & x[3]; m[10] = x[1] & x[3]; m[11] = m[3] & x[3]; m[12] = x[2] & x[3];
+  m[13] = m[5] & x[3]; m[14] = m[6] & x[3]; m[15] = m[7] & x[3]; m[17] = x[0] & x[4];
+  m[18] = x[1] & x[4]; m[19] = m[3] & x[4]; m[20] = x[2] & x[4]; m[21] = m[5] & x[4];
+  m[22] = m[6] & x[4]; m[23] = m[7] & x[4]; m[24] = x[3] & x[4]; m[25] = m[9] & x[4];
+  m[26] = m[10] & x[4]; m[27] = m[11] & x[4]; m[28] = m[12] & x[4]; m[29] = m[13] & x[4];
+  m[33] = x[0] & x[5]; m[34] = x[1] & x[5]; m[35] = m[3] & x[5]; m[36] = x[2] & x[5];
+  m[37] = m[5] & x[5]; m[38] = m[6] & x[5]; m[39] = m[7] & x[5]; m[40] = x[3] & x[5];
+  m[41] = m[9] & x[5]; m[42] = m[10] & x[5]; m[43] = m[11] & x[5]; m[44] = m[12] & x[5];
+  m[45] = m[13] & x[5]; m[46] = m[14] & x[5]; m[47] = m[15] & x[5]; m[48] = x[4] & x[5];
+  m[49] = m[17] & x[5]; m[50] = m[18] & x[5]; m[51] = m[19] & x[5]; m[52] = m[20] & x[5];
+  m[53] = m[21] & x[5]; m[54] = m[22] & x[5]; m[55] = m[23] & x[5]; m[56] = m[24] & x[5];
+  m[57] = m[25] & x[5]; m[58] = m[26] & x[5]; m[59] = m[27] & x[5]; m[60] = m[28] & x[5];
+  m[61] = m[29] & x[5];
+  y[3] = x[0] ^ x[1] ^ m[3] ^ m[5] ^ m[6] ^ m[9] ^ m[12] ^ m[13] ^ m[14] ^
+    m[15] ^ x[4] ^ m[20] ^ m[21] ^ m[22] ^ m[25] ^ m[27] ^ m[34] ^ m[35] ^
+    m[37] ^ m[40] ^ m[41] ^ m[43] ^ m[46] ^ m[51] ^ m[52] ^ m[53] ^ m[54] ^
+    m[55] ^ m[57] ^ m[60];
+  y[2] = x[0] ^ x[1] ^ x[2] ^ x[3] ^ m[9] ^ m[11] ^ m[13] ^ m[15] ^ m[20] ^
+    m[25] ^ m[29] ^ x[5] ^ m[35] ^ m[38] ^ m[39] ^ m[46] ^ m[49] ^ m[53] ^
+    m[56] ^ m[57] ^ m[60] ^ m[61];
+  y[1] = ~(x[1] ^ m[3] ^ x[2] ^ m[5] ^ m[6] ^ m[9] ^ m[10] ^ m[12] ^ m[13] ^
+    m[14] ^ m[15] ^ x[4] ^ m[18] ^ m[19] ^ m[21] ^ m[22] ^ m[26] ^ m[27] ^
+    m[28] ^ m[29] ^ x[5] ^ m[33] ^ m[35] ^ m[36] ^ m[38] ^ m[40] ^ m[41] ^
+    m[42] ^ m[44] ^ m[45] ^ m[46] ^ m[47] ^ m[49] ^ m[50] ^ m[52] ^ m[55] ^
+    m[56] ^ m[59] ^ m[60] ^ m[61]);
+  y[0] = m[3] ^ m[6] ^ x[3] ^ m[9] ^ m[10] ^ m[11] ^ m[13] ^ m[14] ^ m[15] ^
+    m[17] ^ m[18] ^ m[19] ^ m[20] ^ m[21] ^ m[23] ^ m[26] ^ m[33] ^ m[36] ^
+    m[38] ^ m[40] ^ m[41] ^ m[45] ^ m[46] ^ m[47] ^ m[48] ^ m[49] ^ m[50] ^
+    m[51] ^ m[52] ^ m[54] ^ m[56] ^ m[57] ^ m[58] ^ m[59] ^ m[60];
+}
+
+static void
+BS_NAME (sbox6) (BS_WORD * x, BS_WORD * y) {
+  BS_WORD m[64];
+
+  m[3] = x[0] & x[1]; m[5] = x[0] & x[2]; m[6] = x[1] & x[2]; m[7] = m[3] & x[2];
+  m[9] = x[0] & x[3]; m[10] = x[1] & x[3]; m[11] = m[3] & x[3]; m[12] = x[2] & x[3];
+  m[13] = m[5] & x[3]; m[14] = m[6] & x[3]; m[15] = m[7] & x[3]; m[17] = x[0] & x[4];
+  m[19] = m[3] & x[4]; m[20] = x[2] & x[4]; m[21] = m[5] & x[4]; m[22] = m[6] & x[4];
+  m[23] = m[7] & x[4]; m[24] = x[3] & x[4]; m[25] = m[9] & x[4]; m[26] = m[10] & x[4];
+  m[27] = m[11] & x[4]; m[28] = m[12] & x[4]; m[29] = m[13] & x[4]; m[33] = x[0] & x[5];
+  m[34] = x[1] & x[5]; m[35] = m[3] & x[5]; m[37] = m[5] & x[5]; m[38] = m[6] & x[5];
+  m[39] = m[7] & x[5]; m[40] = x[3] & x[5]; m[41] = m[9] & x[5]; m[42] = m[10] & x[5];
+  m[43] = m[11] & x[5]; m[44] = m[12] & x[5]; m[45] = m[13] & x[5]; m[46] = m[14] & x[5];
+  m[47] = m[15] & x[5]; m[48] = x[4] & x[5]; m[49] = m[17] & x[5]; m[53] = m[21] & x[5];
+  m[54] = m[22] & x[5]; m[55] = m[23] & x[5]; m[56] = m[24] & x[5]; m[57] = m[25] & x[5];
+  m[58] = m[26] & x[5]; m[59] = m[27] & x[5]; m[61] = m[29] & x[5];
+  y[3] = ~(x[1] ^ m[3] ^ m[5] ^ m[6] ^ m[7] ^ m[9] ^ m[11] ^ m[12] ^ m[13] ^
+    m[14] ^ m[15] ^ x[4] ^ m[24] ^ m[29] ^ m[33] ^ m[34] ^ m[35] ^ m[37] ^
+    m[39] ^ m[40] ^ m[41] ^ m[42] ^ m[43] ^ m[53] ^ m[55] ^ m[57] ^ m[59] ^
+    m[61]);
+  y[2] = ~(x[0] ^ x[1] ^ x[2] ^ x[3] ^ m[10] ^ m[14] ^ x[4] ^ m[20] ^ m[23] ^
+    x[5] ^ m[38] ^ m[39] ^ m[40] ^ m[41] ^ m[43] ^ m[46] ^ m[54] ^ m[56] ^
+    m[57] ^ m[58] ^ m[59] ^ m[61]);
+  y[1] = x[0] ^ x[2] ^ m[7] ^ m[10] ^ m[19] ^ m[22] ^ m[24] ^ m[26] ^ m[33] ^
+    m[34] ^ m[39] ^ m[40] ^ m[41] ^ m[42] ^ m[43] ^ m[48] ^ m[54] ^ m[55] ^
+    m[56] ^ m[59];
+  y[0] = x[1] ^ m[7] ^ x[3] ^ m[12] ^ m[13] ^ m[14] ^ m[15] ^ m[20] ^ m[23] ^
+    m[24] ^ m[28] ^ m[29] ^ x[5] ^ m[33] ^ m[38] ^ m[39] ^ m[42] ^ m[44] ^
+    m[45] ^ m[46] ^ m[47] ^ m[49] ^ m[53] ^ m[55] ^ m[57];
+}
+
+static void
+BS_NAME (sbox7) (BS_WORD * x, BS_WORD * y) {
+  BS_WORD m[64];
+
+  m[3] = x[0] & x[1]; m[5] = x[0] & x[2]; m[6] = x[1] & x[2]; m[7] = m[3] & x[2];
+  m[9] = x[0] & x[3]; m[10] = x[1] & x[3]; m[11] = m[3] & x[3]; m[12] = x[2] & x[3];
+  m[13] = m[5] & x[3]; m[14] = m[6] & x[3]; m[15] = m[7] & x[3]; m[17] = x[0] & x[4];
+  m[19] = m[3] & x[4]; m[20] = x[2] & x[4]; m[21] = m[5] & x[4]; m[22] = m[6] & x[4];
+  m[23] = m[7] & x[4]; m[24] = x[3] & x[4]; m[25] = m[9] & x[4]; m[26] = m[10] & x[4];
+  m[27] = m[11] & x[4]; m[28] = m[12] & x[4]; m[29] = m[13] & x[4]; m[33] = x[0] & x[5];
+  m[34] = x[1] & x[5]; m[35] = m[3] & x[5]; m[36] = x[2] & x[5]; m[37] = m[5] & x[5];
+  m[39] = m[7] & x[5]; m[40] = x[3] & x[5]; m[41] = m[9] & x[5]; m[42] = m[10] & x[5];
+  m[43] = m[11] & x[5]; m[45] = m[13] & x[5]; m[46] = m[14] & x[5]; m[47] = m[15] & x[5];
+  m[48] = x[4] & x[5]; m[51] = m[19] & x[5]; m[52] = m[20] & x[5]; m[53] = m[21] & x[5];
+  m[54] = m[22] & x[5]; m[55] = m[23] & x[5]; m[56] = m[24] & x[5]; m[57] = m[25] & x[5];
+  m[58] = m[26] & x[5]; m[59] = m[27] & x[5]; m[60] = m[28] & x[5]; m[61] = m[29] & x[5];
+  y[3] = x[0] ^ x[1] ^ x[3] ^ m[14] ^ m[15] ^ m[20] ^ m[24] ^ m[25] ^ m[28] ^
+    m[29] ^ m[33] ^ m[34] ^ m[35] ^ m[36] ^ m[39] ^ m[41] ^ m[42] ^ m[46] ^
+    m[47] ^ m[48] ^ m[52] ^ m[54] ^ m[56] ^ m[57] ^ m[58] ^ m[60] ^ m[61];
+  y[2] = ~(x[1] ^ x[2] ^ m[15] ^ x[4] ^ m[17] ^ m[20] ^ m[23] ^ m[24] ^ x[5] ^
+    m[33] ^ m[36] ^ m[40] ^ m[46] ^ m[48] ^ m[53] ^ m[55] ^ m[57] ^ m[60]);
+  y[1] = x[1] ^ m[3] ^ x[2] ^ m[6] ^ m[7] ^ x[3] ^ m[9] ^ m[13] ^ m[15] ^ x[4]
+    ^ m[22] ^ m[23] ^ m[29] ^ m[33] ^ m[34] ^ m[35] ^ m[40] ^ m[42] ^ m[43] ^
+    m[45] ^ m[47] ^ m[52] ^ m[54] ^ m[56] ^ m[57] ^ m[58] ^ m[59] ^ m[61];
+  y[0] = x[0] ^ x[1] ^ m[6] ^ x[3] ^ m[12] ^ m[14] ^ x[4] ^ m[21] ^ m[23] ^
+    m[24] ^ x[5] ^ m[37] ^ m[39] ^ m[45] ^ m[47] ^ m[51] ^ m[53] ^ m[57];
+}
+
+static void
+BS_NAME (sbox8) (BS_WORD * x, BS_WORD * y) {
+  BS_WORD m[64];
+
+  m[3] = x[0] & x[1]; m[5] = x[0] & x[2]; m[6] = x[1] & x[2]; m[7] = m[3] & x[2];
+  m[9] = x[0] & x[3]; m[10] = x[1] & x[3]; m[11] = m[3] & x[3]; m[12] = x[2] & x[3];
+  m[13] = m[5] & x[3]; m[15] = m[7] & x[3]; m[17] = x[0] & x[4]; m[18] = x[1] & x[4];
+  m[19] = m[3] & x[4]; m[20] = x[2] & x[4]; m[21] = m[5] & x[4]; m[22] = m[6] & x[4];
+  m[23] = m[7] & x[4]; m[24] = x[3] & x[4]; m[25] = m[9] & x[4]; m[26] = m[10] & x[4];
+  m[27] = m[11] & x[4]; m[28] = m[12] & x[4]; m[29] = m[13] & x[4]; m[33] = x[0] & x[5];
+  m[34] = x[1] & x[5]; m[35] = m[3] & x[5]; m[36] = x[2] & x[5]; m[37] = m[5] & x[5];
+  m[38] = m[6] & x[5]; m[39] = m[7] & x[5]; m[40] = x[3] & x[5]; m[41] = m[9] & x[5];
+  m[42] = m[10] & x[5]; m[43] = m[11] & x[5]; m[44] = m[12] & x[5]; m[45] = m[13] & x[5];
+  m[50] = m[18] & x[5]; m[51] = m[19] & x[5]; m[52] = m[20] & x[5]; m[53] = m[21] & x[5];
+  m[54] = m[22] & x[5]; m[55] = m[23] & x[5]; m[56] = m[24] & x[5]; m[57] = m[25] & x[5];
+  m[58] = m[26] & x[5]; m[59] = m[27] & x[5]; m[60] = m[28] & x[5]; m[61] = m[29] & x[5];
+  y[3] = ~(x[0] ^ x[1] ^ m[5] ^ m[7] ^ x[3] ^ m[12] ^ m[13] ^ m[17] ^ m[18] ^
+    m[19] ^ m[20] ^ m[21] ^ m[22] ^ m[28] ^ m[29] ^ x[5] ^ m[33] ^ m[35] ^
+    m[38] ^ m[39] ^ m[41] ^ m[42] ^ m[44] ^ m[45] ^ m[53] ^ m[55] ^ m[57] ^
+    m[59] ^ m[60] ^ m[61]);
+  y[2] = ~(x[0] ^ x[1] ^ x[2] ^ m[10] ^ x[4] ^ m[18] ^ m[20] ^ m[22] ^ m[24] ^
+    m[35] ^ m[36] ^ m[37] ^ m[40] ^ m[42] ^ m[43] ^ m[44] ^ m[45] ^ m[50] ^
+    m[52] ^ m[54] ^ m[56] ^ m[60] ^ m[61]);
+  y[1] = x[1] ^ m[6] ^ x[3] ^ m[10] ^ x[4] ^ m[17] ^ m[19] ^ m[21] ^ m[23] ^
+    m[25] ^ m[29] ^ x[5] ^ m[34] ^ m[35] ^ m[36] ^ m[37] ^ m[38] ^ m[39] ^
+    m[42] ^ m[50] ^ m[55] ^ m[58] ^ m[59];
+  y[0] = ~(x[1] ^ m[3] ^ x[2] ^ m[5] ^ m[6] ^ x[3] ^ m[11] ^ m[13] ^ m[15] ^
+    x[4] ^ m[19] ^ m[22] ^ m[25] ^ m[33] ^ m[34] ^ m[39] ^ m[40] ^ m[42] ^
+    m[43] ^ m[45] ^ m[51] ^ m[52] ^ m[53] ^ m[54] ^ m[56] ^ m[58] ^ m[59] ^
+    m[61]);
+}
+
+/* Loads 64 * BS_LANES blocks (or keys) from src and stores them, bitsliced,
+ * in x: bit g * 64 + i of slice x[j] is bit j of src[g * 64 + i]. Missing
+ * blocks (n < 64 * BS_LANES) are replaced by zeros. */
+static void
+BS_NAME (load) (BS_WORD * x, uint64_t * src, int n) {
+  uint64_t tmp[64];
+  int g, i;
+
+  for (g = 0; g < BS_LANES; g++) {
+    for (i = 0; i < 64; i++) {
+      tmp[i] = (g * 64 + i < n) ? src[g * 64 + i] : UINT64_C (0x0);
+    }
+    des_bs_transpose (tmp);
+    for (i = 0; i < 64; i++) {
+      BS_LANE (x[i], g) = tmp[i];
+    }
+  }
+}
+
+/* Inverse of load: stores the first n blocks of the bitsliced x in dst. */
+static void
+BS_NAME (store) (uint64_t * dst, BS_WORD * x, int n) {
+  uint64_t tmp[64];
+  int g, i;
+
+  for (g = 0; g < BS_LANES && g * 64 < n; g++) {
+    for (i = 0; i < 64; i++) {
+      tmp[i] = BS_LANE (x[i], g);
+    }
+    des_bs_transpose (tmp);
+    for (i = 0; i < 64 && g * 64 + i < n; i++) {
+      dst[g * 64 + i] = tmp[i];
+    }
+  }
+}
+
+/* Bitsliced key schedule of a single pre-computed key schedule ks. */
+static void
+BS_NAME (ks) (BS_WORD k[16][48], uint64_t * ks) {
+  int i, j;
+
+  for (i = 0; i < 16; i++) {
+    for (j = 0; j < 48; j++) {
+      k[i][j] = ((ks[i] >> j) & UINT64_C (0x1)) ? BS_ONES : BS_ONES ^ BS_ONES;
+    }
+  }
+}
+
+/* Bitsliced key schedule of the bitsliced 64 bits keys kx. */
+static void
+BS_NAME (ks_keys) (BS_WORD k[16][48], BS_WORD * kx) {
+  int i, j;
+
+  for (i = 0; i < 16; i++) {
+    for (j = 0; j < 48; j++) {
+      k[i][j] = kx[ks_src[i][j]];
+    }
+  }
+}
+
+/* Enciphers (dec = 0) or deciphers (dec = 1) the bitsliced blocks x in place
+ * with the bitsliced key schedule k. */
+static void
+BS_NAME (crypt) (BS_WORD * x, BS_WORD k[16][48], int dec) {
+  BS_WORD lr[64], e[48], s[32], t[32], *l, *r, *rk;
+  int i, j;
+
+  /* lr is L|R: r = lr[0..31], l = lr[32..63]. */
+  r = lr;
+  l = lr + 32;
+  for (j = 0; j < 64; j++) {
+    lr[j] = x[ip_src[j]];
+  }
+  for (i = 0; i < 16; i++) {
+    rk = k[dec ? 15 - i : i];
+    for (j = 0; j < 48; j++) {
+      e[j] = r[e_src[j]] ^ rk[j];
+    }
+    BS_NAME (sbox1) (e + 42, s + 28);
+    BS_NAME (sbox2) (e + 36, s + 24);
+    BS_NAME (sbox3) (e + 30, s + 20);
+    BS_NAME (sbox4) (e + 24, s + 16);
+    BS_NAME (sbox5) (e + 18, s + 12);
+    BS_NAME (sbox6) (e + 12, s + 8);
+    BS_NAME (sbox7) (e + 6, s + 4);
+    BS_NAME (sbox8) (e, s);
+    for (j = 0; j < 32; j++) {
+      t[j] = l[j] ^ s[p_src[j]];
+      l[j] = r[j];
+      r[j] = t[j];
+    }
+  }
+  /* Pre-output is R16|L16. */
+  for (j = 0; j < 32; j++) {
+    t[j] = l[j];
+    l[j] = r[j];
+    r[j] = t[j];
+  }
+  for (j = 0; j < 64; j++) {
+    x[j] = lr[fp_src[j]];
+  }
+}
+
+/* Processes n blocks of in, stores the results in out. If keys is not NULL,
+ * block i is enciphered with the 64 bits key keys[i], else all blocks are
+ * processed with the key schedule ks. */
+static void
+BS_NAME (run) (uint64_t * ks, uint64_t * keys, uint64_t * in, uint64_t * out, int n, int dec) {
+  BS_WORD x[64], kx[64], k[16][48];
+  int i, m;
+
+  if (keys == NULL) {
+    BS_NAME (ks) (k, ks);
+  }
+  for (i = 0; i < n; i += 64 * BS_LANES) {
+    m = n - i;
+    BS_NAME (load) (x, in + i, m);
+    if (keys != NULL) {
+      BS_NAME (load) (kx, keys + i, m);
+      BS_NAME (ks_keys) (k, kx);
+    }
+    BS_NAME (crypt) (x, k, dec);
+    BS_NAME (store) (out + i, x, m);
+  }
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) Telecom Paris
+ *
+ * This file must be used under the terms of the CeCILL. This source
+ * file is licensed as described in the file COPYING, which you should
+ * have received as part of this distribution. The terms are also
+ * available at:
+ * http://www.cecill.info/licences/Licence_CeCILL_V1.1-US.txt
+*/
+
+/** \file des_key.h
+The **des_key** library: recovery of the 64 bits secret key of the Data Encryption Standard (DES) from a recovered last round key.
+\attention
+- The 28 bits halves of the key schedule register are rotated by 28 positions over the 16 rounds: C16D16 = C0D0 = PC1(key). The last round key K16 = PC2(C16D16) thus gives 48 of the 56 bits of PC1(key); the 8 missing bits are enumerated (256 candidate keys per last round key) and the candidates are verified against known plaintext / ciphertext pairs.
+- Candidates are verified 256 at a time with the bitsliced engine of the **des_bs** library, against the first pair; the survivors are confirmed with the other pairs, if any. Searches over several last round keys are split among threads, one last round key at a time.
+- Returned secret keys have their parity bits set (see `des_n_pc1()`).
+*/
+
+#ifndef DES_KEY_H
+#define DES_KEY_H
+
+#include <stdint.h>
+#include <inttypes.h>
+
+/** Number of candidate secret keys per last round key. */
+#define DES_KEY_CANDIDATES 256
+
+/** Computes the 256 secret keys whose last round key is `k16`. */
+void des_key_candidates (uint64_t k16 /**< 48 bits last round key. */ ,
+			 uint64_t * keys
+			 /**< The 256 64 bits candidate secret keys, with parity bits. Must be allocated prior the call. */
+  );
+
+/** Searches the secret key whose last round key is `k16` and that enciphers the `n` plaintexts `pt` into the `n` ciphertexts `ct`. Runs in the calling thread: the 256 candidates are a single batch of the bitsliced engine, a few microseconds of work, less than the creation of a thread.
+ * \return One if the secret key has been found and stored in `*key`, zero if none of the 256 candidates matches (wrong last round key or wrong pairs). */
+int des_recover_key (uint64_t k16 /**< 48 bits last round key. */ ,
+		     uint64_t * pt /**< The `n` known plaintexts. */ ,
+		     uint64_t * ct /**< The `n` corresponding ciphertexts. */ ,
+		     int n /**< Number of known pairs (at least one). */ ,
+		     uint64_t * key
+		     /**< The recovered 64 bits secret key, with parity bits. */
+  );
+
+/** Same as `des_recover_key()` but searches the `m` last round keys of `k16`, for instance the near-best candidates of an attack, in parallel.
+ * \return The index in `k16` of the first last round key (in array order) that leads to a matching secret key, stored in `*key`, or -1 if none matches. */
+int des_recover_key_list (uint64_t * k16 /**< The `m` 48 bits last round keys. */ ,
+			  int m /**< Number of last round keys. */ ,
+			  uint64_t * pt /**< The `n` known plaintexts. */ ,
+			  uint64_t * ct /**< The `n` corresponding ciphertexts. */ ,
+			  int n /**< Number of known pairs (at least one). */ ,
+			  int threads /**< Number of threads; zero or negative: one per online processor. */ ,
+			  uint64_t * key
+			  /**< The recovered 64 bits secret key, with parity bits. */
+  );
+
+/** Known plaintext / ciphertext pairs, for `des_key_check()`. */
+typedef struct {
+  uint64_t *pt;	/**< The `n` known plaintexts. */
+  uint64_t *ct;	/**< The `n` corresponding ciphertexts. */
+  int n;	/**< Number of known pairs (at least one). */
+  uint64_t key;	/**< The recovered 64 bits secret key, set on success. */
+} des_key_pairs;
+
+/** Checks whether last round key `k16` leads to a secret key that enciphers the known pairs. Has the signature of the verification callbacks of the **key_enum** library (see `ke_search()`) and is thread safe: only the right last round key writes `pairs->key`.
+ * \return One if the secret key has been found and stored in `pairs->key`, else zero. */
+int des_key_check (uint64_t k16 /**< 48 bits last round key. */ ,
+		   void *pairs
+		   /**< A pointer to a `des_key_pairs` structure. */
+  );
+
+#endif /** not DES_KEY_H */
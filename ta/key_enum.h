@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) Telecom Paris
+ *
+ * This file must be used under the terms of the CeCILL. This source
+ * file is licensed as described in the file COPYING, which you should
+ * have received as part of this distribution. The terms are also
+ * available at:
+ * http://www.cecill.info/licences/Licence_CeCILL_V1.1-US.txt
+*/
+
+/** \file key_enum.h
+The **key_enum** library, an enumerator of 48 bits last round keys in decreasing order of joint score, from the scores of the 64 guesses on each of the 8 6-bits subkeys, and a rank estimator of a known last round key, to evaluate attacks.
+\attention
+- The joint score of a last round key is the sum of the scores of its 8 subkeys. The enumeration order is optimal (exact decreasing joint score) when the scores are log-likelihoods; any other additive score (e.g. correlations) can be used but the order is then only as good as the scores.
+- The 8 sorted lists are merged pairwise along a binary tree (1-2, 3-4, 5-6, 7-8, then 12-34, 56-78, then the root). Each node is a best-first merge of its two children: from candidate (i, j) (i-th of the left child, j-th of the right child) the successors are (i, j + 1) and, if j is 0, (i + 1, 0). Each candidate has a single predecessor, of higher or equal score, so that every candidate is produced exactly once and in order. The inner nodes keep what they produced, for their parent; the memory footprint grows linearly with the number of enumerated candidates.
+- Example of use:
+\code
+ke_context ctx;
+uint64_t k16;
+double score;
+
+ctx = ke_init (scores);
+while (ke_next (ctx, &k16, &score)) {
+  ... // test k16
+}
+ke_free (ctx);
+\endcode
+*/
+
+#ifndef KEY_ENUM_H
+#define KEY_ENUM_H
+
+#include <stdint.h>
+#include <inttypes.h>
+
+/** The data structure used to manage an enumeration. */
+typedef struct ke_context_s *ke_context;
+
+/** Verification callback of `ke_search()`. Called concurrently by several threads: must be thread safe.
+ * \return Non-zero if `k16` is the right last round key. */
+typedef int (*ke_verify) (uint64_t k16 /**< 48 bits candidate last round key. */ ,
+			  void *arg
+			  /**< User data passed to `ke_search()`. */
+  );
+
+/** Creates an enumeration context. The scores are copied: `scores` can be freed or modified after the call.
+ * \return The new context. */
+ke_context ke_init (double scores[8][64]
+		    /**< `scores[s][g]` is the score of guess `g` on the 6-bits subkey of SBox `s + 1`. */
+  );
+
+/** Frees an enumeration context. */
+void ke_free (ke_context ctx /**< The context. */ );
+
+/** Produces the next last round key, in decreasing joint score order.
+ * \return One on success, zero when all 2^48 keys have been enumerated. */
+int ke_next (ke_context ctx /**< The context. */ ,
+	     uint64_t * k16 /**< The 48 bits last round key. */ ,
+	     double *score
+	     /**< Its joint score (may be NULL). */
+  );
+
+/** Returns the number of keys produced so far by `ke_next()`.
+ * \return The number of keys. */
+int64_t ke_count (ke_context ctx /**< The context. */ );
+
+/** Enumerates at most `budget` last round keys in decreasing joint score order and verifies them with `verify`, with `threads` threads. The keys are enumerated by the calling thread and verified by batches. The result does not depend on the number of threads: it is always the best ranked accepted key.
+ * \return The rank (from 0) of the first accepted key, stored in `*k16`, or -1 if no key within the budget was accepted. */
+int64_t ke_search (double scores[8][64] /**< The scores (see `ke_init()`). */ ,
+		   int64_t budget /**< Maximum number of keys to enumerate. */ ,
+		   int threads /**< Number of verification threads; zero or negative: one per online processor. */ ,
+		   ke_verify verify /**< Verification callback. */ ,
+		   void *arg /**< User data, passed to `verify`. */ ,
+		   uint64_t * k16
+		   /**< The accepted 48 bits last round key. */
+  );
+
+/** Default number of histogram bins per SBox of `ke_rank()`. */
+#define KE_RANK_BINS 4096
+
+/** Estimates the rank of last round key `k16` in the enumeration order, without enumerating. The rank of a key is one plus the number of keys with a strictly greater joint score. The scores of each SBox are quantized in a histogram of `bins` bins, all SBoxes using the same bin width (the widest score range divided by `bins - 1`), and the 8 histograms are convolved. Each quantized score is below the real one by less than one bin width, so keys 8 bins or more above (below) the bin of `k16` are certainly ranked before (after) it. More bins give tighter bounds; the computation time is proportional to `bins` (a few milliseconds with the default).
+ * \return Nothing; the bounds are stored in `*lo` and `*hi`, 1 <= `*lo` <= rank <= `*hi` <= 2^48. */
+void ke_rank (double scores[8][64] /**< The scores (see `ke_init()`). */ ,
+	      uint64_t k16 /**< The 48 bits last round key to rank, for instance the last round key of `tr_key()`. */ ,
+	      int bins /**< Number of bins per SBox, at least 2; zero or negative: `KE_RANK_BINS`. */ ,
+	      double *lo /**< Lower bound of the rank. */ ,
+	      double *hi
+	      /**< Upper bound of the rank. */
+  );
+
+#endif /** not KEY_ENUM_H */
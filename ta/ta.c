@@ -18,6 +18,8 @@
 
 #include "utils.h"
 #include "des.h"
+#include "des_fast.h"
+#include "des_key.h"
 
 uint64_t *ct; /* Array of cipher texts. */
 float *t; /* Array of timing measurements. */
@@ -37,6 +39,9 @@ main(int argc, char **argv) {
   float sum; /* Sum of timing measurements. */
   int i; /* Loop index. */
   uint64_t rk; /* Round key */
+  uint64_t pt, kct; /* Known plaintext / ciphertext pair. */
+  uint64_t key; /* Secret key */
+  char *end; /* End of a parsed argument. */
 
   /************************************************************************/
   /* Before doing anything else, check the correctness of the DES library */
@@ -50,8 +55,10 @@ main(int argc, char **argv) {
   /*************************************/
   /* If invalid number of arguments (including program name), exit with error
    * message. */
-  if(argc != 3) {
-    ERROR(0, -1, "usage: ta <datafile> <nexp>\n");
+  if(argc != 3 && argc != 5) {
+    ERROR(0, -1, "usage: ta <datafile> <nexp> [<pt> <ct>]\n\
+  <pt> <ct>: a known plaintext / ciphertext pair (hexadecimal), to recover the\n\
+             secret key from the last round key\n");
   }
   /* Number of experiments to use is argument #2, convert it to integer and
    * store the result in variable n. */
@@ -59,6 +66,17 @@ main(int argc, char **argv) {
   if(n < 1) { /* If invalid number of experiments. */
     ERROR(0, -1, "number of experiments to use (<nexp>) shall be greater than 1 (%d)", n);
   }
+  /* Known pair, if any, is arguments #3 and #4, in hexadecimal. */
+  if(argc == 5) {
+    pt = strtoull(argv[3], &end, 16);
+    if(*argv[3] == '\0' || *end != '\0') {
+      ERROR(0, -1, "invalid plaintext: %s (shall be hexadecimal)", argv[3]);
+    }
+    kct = strtoull(argv[4], &end, 16);
+    if(*argv[4] == '\0' || *end != '\0') {
+      ERROR(0, -1, "invalid ciphertext: %s (shall be hexadecimal)", argv[4]);
+    }
+  }
   /* Read data. Name of data file is argument #1. Number of experiments to use is n. */
   read_datafile(argv[1], n);
 
@@ -67,13 +85,15 @@ main(int argc, char **argv) {
    * round, under the assumption that the last round key is 0x0123456789ab     *
    *****************************************************************************/
   rk = UINT64_C(0x0123456789ab); /* last round key. */
-  /* Undoes the final permutation on cipher text of n-th experiment. */
-  r16l16 = des_ip(ct[n - 1]);
+  /* Undoes the final permutation on cipher text of n-th experiment. The
+   * unchecked primitives of des_fast.h are meant for such hypothesis
+   * computations, repeated for every experiment and every guess. */
+  r16l16 = des_ip_fast(ct[n - 1]);
   /* Extract right half (strange naming as in the DES standard). */
-  l16 = des_right_half(r16l16);
+  l16 = des_right_half_fast(r16l16);
   /* Compute output of SBoxes during last round of first experiment, assuming
    * the last round key is 0x0123456789ab. */
-  sbo = des_sboxes(des_e(l16) ^ rk); /* R15 = L16, K16 = rk */
+  sbo = des_sboxes_fast(des_e_fast(l16) ^ rk); /* R15 = L16, K16 = rk */
   /* Compute and print Hamming weight of output of first SBox (mask the others). */
   fprintf(stderr, "Hamming weight: %d\n", hamming_weight(sbo & UINT64_C(0xf0000000)));
 
@@ -87,6 +107,19 @@ main(int argc, char **argv) {
   /* Compute and print average timing measurements. */
   fprintf(stderr, "Average timing: %f\n", sum / (float)(n));
 
+  /**************************************************************
+   * If a known pair was given, recover the secret key from the *
+   * last round key                                             *
+   **************************************************************/
+  if(argc == 5) {
+    if(des_recover_key(rk, &pt, &kct, 1, &key)) {
+      fprintf(stderr, "Secret key (hex): 0x%016" PRIx64 "\n", key);
+    }
+    else {
+      fprintf(stderr, "Secret key not found: wrong last round key?\n");
+    }
+  }
+
   /************************
    * Print last round key *
    ************************/